@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief bump-pointer arena allocator
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define CHUNK_MIN   (64*1024) ///< minimum chunk size
+#define CHUNK_KEEP  (256*1024) ///< maximum size of the chunk kept by arena_reset()
+#define ALIGN(s)    (((s) + 7) & ~(size_t)7)
+
+/// @brief arena chunk header; the chunk's memory follows the header
+struct chunk {
+  struct chunk *next;         ///< previous chunk
+  size_t size;                ///< usable size of this chunk
+  double data[];              ///< chunk memory (aligned)
+};
+
+
+/// @brief add a chunk with at least @a size usable bytes to arena @a a
+///
+/// @retval 0 on success
+/// @retval -1 if out of memory (the arena is unchanged)
+static int add_chunk(struct arena *a, size_t size)
+{
+  if (size < CHUNK_MIN) size = CHUNK_MIN;
+
+  struct chunk *c = malloc(sizeof(struct chunk) + size);
+  if (!c) return -1;
+
+  c->next = a->head;
+  c->size = size;
+  a->head = c;
+  a->ptr = (char*)c->data;
+  a->end = a->ptr + size;
+
+  return 0;
+}
+
+
+void arena_init(struct arena *a)
+{
+  memset(a, 0, sizeof(struct arena));
+}
+
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+  size = ALIGN(size);
+
+  if (!a->head || ((size_t)(a->end - a->ptr) < size)) {
+    // grow geometrically so that the number of chunks stays logarithmic in the workload
+    if (add_chunk(a, a->head ? (a->head->size*2 > size ? a->head->size*2 : size) : size) < 0) {
+      return NULL;
+    }
+  }
+
+  a->last = a->ptr;
+  a->ptr += size;
+
+  return a->last;
+}
+
+
+void *arena_calloc(struct arena *a, size_t size)
+{
+  void *p = arena_alloc(a, size);
+
+  if (p) memset(p, 0, size);
+
+  return p;
+}
+
+
+void *arena_grow(struct arena *a, void *p, size_t old, size_t size)
+{
+  if (p && (p == a->last) && ((size_t)(a->end - (char*)p) >= ALIGN(size))) {
+    a->ptr = (char*)p + ALIGN(size);
+    return p;
+  }
+
+  void *np = arena_alloc(a, size);
+  if (p && np) memcpy(np, p, old);
+
+  return np;
+}
+
+
+void arena_reset(struct arena *a)
+{
+  size_t total = 0;
+
+  for (struct chunk *c = a->head; c; c = c->next) total += c->size;
+
+  // a peak above CHUNK_KEEP (one very wide directory) is not kept for the rest of the run
+  if (a->head && (a->head->next || (total > CHUNK_KEEP))) {
+    while (a->head) {
+      struct chunk *c = a->head;
+      a->head = c->next;
+      free(c);
+    }
+    a->ptr = a->end = NULL;
+    // if this fails, the arena starts over empty
+    add_chunk(a, total < CHUNK_KEEP ? total : CHUNK_KEEP);
+  }
+
+  if (a->head) {
+    a->ptr = (char*)a->head->data;
+    a->end = a->ptr + a->head->size;
+  }
+  a->last = NULL;
+}
+
+
+void arena_free(struct arena *a)
+{
+  while (a->head) {
+    struct chunk *c = a->head;
+    a->head = c->next;
+    free(c);
+  }
+  arena_init(a);
+}
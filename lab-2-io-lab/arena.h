@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief bump-pointer arena allocator
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+/// @brief bump-pointer arena. Allocations are carved out of large chunks and released all at once
+///        with arena_reset(), which keeps the memory for reuse. An arena must only be used by one
+///        thread at a time.
+struct arena {
+  struct chunk *head;         ///< current (most recently allocated) chunk
+  char *ptr;                  ///< next free byte in head
+  char *end;                  ///< end of head
+  void *last;                 ///< most recent allocation (can be grown in place)
+};
+
+/// @brief initialize an empty arena
+///
+/// @param a arena
+void arena_init(struct arena *a);
+
+/// @brief allocate @a size bytes (8-byte aligned)
+///
+/// @param a arena
+/// @param size number of bytes
+/// @retval pointer to uninitialized memory
+/// @retval NULL if out of memory
+void *arena_alloc(struct arena *a, size_t size);
+
+/// @brief allocate @a size zero-initialized bytes
+///
+/// @param a arena
+/// @param size number of bytes
+/// @retval pointer to zeroed memory
+/// @retval NULL if out of memory
+void *arena_calloc(struct arena *a, size_t size);
+
+/// @brief grow allocation @a p from @a old to @a size bytes. The allocation is extended in place if
+///        it is the most recent one and the chunk has room, otherwise it is moved.
+///
+/// @param a arena
+/// @param p allocation to grow (or NULL)
+/// @param old current size of @a p
+/// @param size new size
+/// @retval pointer to the (possibly moved) allocation
+/// @retval NULL if out of memory (@a p is unchanged)
+void *arena_grow(struct arena *a, void *p, size_t old, size_t size);
+
+/// @brief release all allocations. If the arena had to add chunks since the last reset, they are
+///        coalesced into a single chunk large enough for the same workload, so that a steady-state
+///        reset/allocate cycle does not touch the heap. The chunk kept is at most 256 KiB: the
+///        memory of larger workloads is returned to the heap.
+///
+/// @param a arena
+void arena_reset(struct arena *a);
+
+/// @brief release all memory held by the arena
+///
+/// @param a arena
+void arena_free(struct arena *a);
+
+#endif // __ARENA_H__
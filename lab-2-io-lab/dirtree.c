@@ -18,234 +18,902 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <assert.h>
-#include <grp.h>
-#include <pwd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <math.h>
+#include "dupes.h"
+#include "estimate.h"
+#include "filter.h"
+#include "idcache.h"
+#include "inoset.h"
+#include "libdirtree.h"
+#include "outbuf.h"
+#include "profile.h"
+#include "record.h"
+#include "snapshot.h"
+#include "spill.h"
+#include "topk.h"
+#include "pool.h"
+#include "watch.h"
+#include "util.h"
 
-#define MAX_DIR 64            ///< maximum number of directories supported
+#define OUTBUF_SIZE (256*1024) ///< size of the stdout buffer
+#define MAX_ROOTS 4           ///< default number of roots processed at the same time (--roots)
+#define EST_FRONTIER 1024     ///< --estimate: subtrees left by the full walk of the top levels
+#define LINK_MEM 64           ///< default memory budget of the hard link set in MiB (--link-mem)
 
 /// @brief output control flags
 #define F_TREE      0x1       ///< enable tree view
 #define F_SUMMARY   0x2       ///< enable summary
 #define F_VERBOSE   0x4       ///< turn on verbose mode
+#define F_STATS     0x8       ///< print run statistics to stderr
+#define F_RECORDS   0x10      ///< print one machine-readable record per entry (see recfmt)
 
-/// @brief struct holding the summary
-struct summary {
-  unsigned int dirs;          ///< number of directories encountered
-  unsigned int files;         ///< number of files
-  unsigned int links;         ///< number of links
-  unsigned int fifos;         ///< number of pipes
-  unsigned int socks;         ///< number of sockets
+/// @brief metadata demand flags
+#define MD_TYPE     0x1       ///< file type (counts, directory detection)
+#define MD_SIZE     0x2       ///< file size and number of blocks
+#define MD_OWNER    0x4       ///< user and group
 
-  unsigned long long size;    ///< total size (in bytes)
-  unsigned long long blocks;  ///< total number of blocks (512 byte blocks)
-};
 
+static __thread struct outbuf out; ///< buffered output of the calling thread: standard output for
+                                   ///< the main thread, the root's output for printing threads
 
 /// @brief abort the program with EXIT_FAILURE and an optional error message
 ///
 /// @param msg optional error message or NULL
 void panic(const char *msg)
 {
+  // pool workers never write to out
+  if (pool_worker_id() < 0) ob_flush(&out);
   if (msg) fprintf(stderr, "%s\n", msg);
   exit(EXIT_FAILURE);
 }
 
 
-/// @brief read next directory entry from open directory 'dir'. Ignores '.' and '..' entries
-///
-/// @param dir open DIR* stream
-/// @retval entry on success
-/// @retval NULL on error or if there are no more entries
-struct dirent *getNext(DIR *dir)
+static unsigned int demand;   ///< metadata needed by this run (MD_*), see planMetadata()
+static struct dirtree *dt;    ///< traversal configuration of this run
+static enum recformat recfmt; ///< record format if F_RECORDS is set
+static struct filter filter;  ///< entry filter (--name, --type, --size, ...)
+static struct snapshot *snap; ///< --snapshot: snapshot of the previous run (or NULL)
+static const char *snapfile; ///< --snapshot: snapshot file (or NULL)
+static __thread struct snapwriter *snapw; ///< --snapshot: snapshot of the root printed by the
+                              ///< calling thread; the main thread merges them (or NULL)
+static size_t spill_limit;    ///< --spill: maximum number of entries of a directory kept in memory
+static int inode_order = 1;   ///< stat entries in inode order (--stat-order)
+static int timing;            ///< --timing: measure the metadata lookups
+static struct profile *prof;  ///< --profile: phase counters of this run (or NULL)
+static __thread char *pstr;   ///< prefix string, extended and truncated as the walk descends
+static __thread size_t pstr_size; ///< allocated size of pstr
+static int dedup_links;       ///< --dedup-links: count the size of hard-linked inodes once
+static size_t link_mem = LINK_MEM; ///< --link-mem: memory budget of linkset in MiB
+static struct inoset *linkset; ///< inodes with several links counted so far (or NULL)
+static int top_k;             ///< --top: number of largest subtrees and files to report (0 = off)
+static __thread struct topk *topdirs;  ///< --top: largest subtrees seen by the calling thread
+static __thread struct topk *topfiles; ///< --top: largest files seen by the calling thread
+static int find_dupes;        ///< --dupes: report groups of identical files
+static __thread struct dupes *dupset; ///< --dupes: regular files seen by the calling thread
+
+
+/// @brief make sure buffer @a buf of size @a size can hold at least @a len bytes
+static void reserve(char **buf, size_t *size, size_t len)
 {
-  struct dirent *next;
-  int ignore;
+  if (len > *size) {
+    size_t nsize = *size ? *size : 256;
+    while (nsize < len) nsize *= 2;
+    *buf = realloc(*buf, nsize);
+    if (!*buf) panic("Out of memory");
+    *size = nsize;
+  }
+}
 
-  do {
-    errno = 0;
-    next = readdir(dir);
-    if (errno != 0) perror(NULL);
-    ignore = next && ((strcmp(next->d_name, ".") == 0) || (strcmp(next->d_name, "..") == 0));
-  } while (next && ignore);
 
-  return next;
+/// @brief walk the tree at @a path with visitor @a v (see dt_walk()). Aborts the program if the
+///        walk fails.
+static void walk(const char *path, unsigned int depth, const struct dt_visitor *v, void *ctx)
+{
+  if (dt_walk(dt, path, depth, v, ctx) < 0) panic(errno == ENOMEM ? "Out of memory" : strerror(errno));
 }
 
 
-/// @brief qsort comparator to sort directory entries. Sorted by name, directories first.
+/// @brief decide which inode metadata a run needs. Sizes, blocks and owners are only printed in
+///        verbose mode; otherwise the file type is all that is required, and that is supplied by
+///        getdents64() in d_type on most file systems.
 ///
-/// @param a pointer to first entry
-/// @param b pointer to second entry
-/// @retval -1 if a<b
-/// @retval 0  if a==b
-/// @retval 1  if a>b
-static int dirent_compare(const void *a, const void *b)
+/// @param flags output control flags (F_*)
+/// @retval metadata demand (MD_*)
+static unsigned int planMetadata(unsigned int flags)
 {
-  struct dirent *e1 = (struct dirent*)a;
-  struct dirent *e2 = (struct dirent*)b;
+  unsigned int need = MD_TYPE;
 
-  // if one of the entries is a directory, it comes first
-  if (e1->d_type != e2->d_type) {
-    if (e1->d_type == DT_DIR) return -1;
-    if (e2->d_type == DT_DIR) return 1;
-  }
+  if (flags & (F_VERBOSE | F_RECORDS)) need |= MD_SIZE | MD_OWNER;
+  if (filter.active & FILTER_STAT) need |= MD_SIZE;
+  if (top_k || find_dupes) need |= MD_SIZE;
 
-  // otherwise sorty by name
-  return strcmp(e1->d_name, e2->d_name);
+  return need;
 }
 
 
-/// @brief recursively process directory @a dn and print its tree
+/// @brief print a single directory entry
 ///
-/// @param dn absolute or relative path string
-/// @param pstr prefix string printed in front of each entry
-/// @param stats pointer to statistics
+/// @param plen length of the prefix string (pstr) of the directory
+/// @param name entry name
+/// @param last non-zero if this is the last entry of the directory
+/// @param info metadata of the entry (only used in verbose mode)
 /// @param flags output control flags (F_*)
-void processDir(const char *dn, const char *pstr, struct summary *stats, unsigned int flags)
+static void printEntry(size_t plen, const char *name, int last, const struct stat *info,
+                       unsigned int flags)
 {
-  
-  errno = 0;
-  DIR *sub_dir = opendir(dn);
-  struct dirent *dep;
-  struct dirent *files;
-  int len = 0;
-  int size = 50;
   unsigned int tree = flags & F_TREE;
   unsigned int verbose = flags & F_VERBOSE;
-  char *nstr, *shown_name;
+  size_t nlen = strlen(name);
+  size_t start, col;
 
-  if(errno){//find error about opendir
-    if(tree) printf("%s`-ERROR: %s\n", pstr, strerror(errno));
-    else printf("%s  ERROR: %s\n", pstr, strerror(errno));
-    return;
+  //shown name: pstr + '`-' or '|-' or '  ' + file name, composed in place in the output buffer
+  ob_reserve(&out, plen+nlen+2);
+  start = out.len;
+  ob_write(&out, pstr, plen);
+  if(last && tree) ob_write(&out, "`-", 2);
+  else if(tree) ob_write(&out, "|-", 2);
+  else ob_write(&out, "  ", 2);
+  ob_write(&out, name, nlen);
+
+  //verbose additional print
+  if(verbose){
+    char type=' ';
+    if(S_ISDIR(info->st_mode)) type = 'd';
+    else if(S_ISCHR(info->st_mode)) type = 'c';
+    else if(S_ISBLK(info->st_mode)) type = 'b';
+    else if(S_ISFIFO(info->st_mode)) type = 'f';
+    else if(S_ISLNK(info->st_mode)) type = 'l';
+    else if(S_ISSOCK(info->st_mode)) type = 's';
+
+    //if shown_name's length > 54 : omit last some words and make ...
+    col = out.len - start;
+    if(col>54){
+      out.len = start+51;
+      ob_write(&out, "...", 3);
+    }
+    else ob_fill(&out, ' ', 54-col);
+
+    prof_enter(prof, PROF_IDS);
+    const char *user = idcache_user(info->st_uid);
+    const char *group = idcache_group(info->st_gid);
+    prof_leave(prof);
+
+    ob_write(&out, "  ", 2);
+    ob_right(&out, user, 8);
+    ob_putc(&out, ':');
+    ob_left(&out, group, 8);
+    ob_write(&out, "  ", 2);
+    ob_int(&out, info->st_size, 10);
+    ob_write(&out, "  ", 2);
+    ob_uint(&out, info->st_blocks, 8);
+    ob_write(&out, "  ", 2);
+    ob_putc(&out, type);
   }
-  files = (struct dirent *)malloc(size*sizeof(struct dirent));
-  if(errno){//memory error found
-    panic("Out of memory");
+  ob_putc(&out, '\n');
+}
+
+
+/// @brief print "<n> <singular|plural>"
+static void printCount(unsigned int n, const char *singular, const char *plural)
+{
+  ob_uint(&out, n, 0);
+  ob_putc(&out, ' ');
+  ob_puts(&out, n == 1 ? singular : plural);
+}
+
+
+
+
+/// @brief a root path. Each root is printed by its own thread into its own output; up to --roots
+///        roots are processed at the same time, and their outputs are emitted in command line
+///        order by the main thread.
+struct root {
+  const char *path;           ///< path as given
+  unsigned int flags;         ///< output control flags (F_*)
+  struct dt_summary dstat;    ///< summary of the root (valid once printed)
+  int last;                   ///< the entry printed last is the last one of its directory
+  int fd;                     ///< output: standard output or a temporary file
+  unsigned long long written; ///< number of bytes written to fd
+  struct snapwriter *snapw;   ///< --snapshot: snapshot of the root (or NULL)
+  struct topk *topdirs;       ///< --top: largest subtrees of the root (or NULL)
+  struct topk *topfiles;      ///< --top: largest files of the root (or NULL)
+  struct dupes *dupes;        ///< --dupes: regular files of the root (or NULL)
+  pthread_t thread;           ///< printing thread
+};
+
+
+/// @brief print a separator line
+static void printSection(void)
+{
+  ob_fill(&out, '-', 100);
+  ob_putc(&out, '\n');
+}
+
+
+/// @brief print the summary line of @a dstat (without a newline)
+///
+/// @param dstat summary of a directory tree
+/// @param flags output control flags (F_*); with F_VERBOSE, size and blocks are included
+static void printSummary(const struct dt_summary *dstat, unsigned int flags)
+{
+  size_t start, len;
+
+  //summary data by directory and grammarly correct, cut off after 68 characters
+  ob_reserve(&out, 256);
+  start = out.len;
+  printCount(dstat->files, "file", "files");
+  ob_write(&out, ", ", 2);
+  printCount(dstat->dirs, "directory", "directories");
+  ob_write(&out, ", ", 2);
+  printCount(dstat->links, "link", "links");
+  ob_write(&out, ", ", 2);
+  printCount(dstat->fifos, "pipe", "pipes");
+  ob_write(&out, ", and ", 6);
+  printCount(dstat->socks, "socket", "sockets");
+  len = out.len - start;
+  if(len > 68) out.len = start+68;
+
+  //additional verbose summary
+  if(flags & F_VERBOSE){
+    if(len < 68) ob_fill(&out, ' ', 68-len);
+    ob_write(&out, "   ", 3);
+    ob_uint(&out, dstat->size, 14);   //current directory's size, blocks
+    ob_putc(&out, ' ');
+    ob_uint(&out, dstat->blocks, 9);
   }
+}
 
-  //store files in directory
-  while((dep = getNext(sub_dir))!=NULL){
-    if(len==size){//if allocated memory got full -> realloc
-      size*=2;
-      files = realloc(files, size*sizeof(struct dirent));
-      if(errno){
-        panic("Out of memory");
-      }
-    }
-    files[len++] = *dep;
+
+/// @brief print the error of directory @a d below its entries (a record with --format)
+///
+/// @param r root being printed
+/// @param d directory with dt_dir.err set
+static void printDirError(const struct root *r, const struct dt_dir *d)
+{
+  size_t plen = 2*d->depth;
+
+  if(r->flags & F_RECORDS){
+    //path of the directory without the trailing '/'
+    rec_error(&out, recfmt, d->path, d->len > 1 ? d->len-1 : d->len, d->depth, d->err);
   }
-  free(dep);
+  else{
+    ob_write(&out, pstr, plen);
+    ob_puts(&out, (r->flags & F_TREE) ? "`-ERROR: " : "  ERROR: ");
+    ob_puts(&out, strerror(d->err));
+    ob_putc(&out, '\n');
+  }
+}
 
-  //sort by filetype, filename
-  qsort(files, len, sizeof(struct dirent), dirent_compare);
-  
-  for(int i=0; i<len; i++){
-    errno = 0;
-    nstr = strdup(pstr);//add pstr with '| ' or '  ' to make inner files' pstr
-    nstr = realloc(nstr, strlen(nstr)+3);
-    shown_name = strdup(pstr);//current file name includint pstr + '`-' or '|-' or '  '(shown name when print)
-    shown_name = realloc(shown_name, strlen(shown_name)+strlen(files[i].d_name)+4);
-
-    char *sub_file_name = strdup(dn);//subfile's name
-    sub_file_name = realloc(sub_file_name, strlen(sub_file_name)+strlen(files[i].d_name)+3);
-
-    if(!nstr || !shown_name || !sub_file_name){// memory error detect
-      printf("err: %d ", errno);
-      panic("Out of memory");
-    }
 
-    strcat(sub_file_name, "/");
-    strcat(sub_file_name, files[i].d_name);//complete subfile's name
-    //make shown_name, nstr according to conditions
-    if(i==len-1 && tree) {
-      strcat(shown_name, "`-");
-      strcat(nstr, "  ");
-    }
-    else if(tree) {
-      strcat(shown_name, "|-");
-      strcat(nstr, "| ");
-    }
-    else {
-      strcat(shown_name, "  ");
-      strcat(nstr, "  ");
-    }
+/// @brief dt_visitor enter(): extend the prefix string for the entries of directory @a d, print
+///        the error if it cannot be read and record its entries in the snapshot
+///
+/// @param ctx struct root* being printed
+/// @param d directory
+static int enterDir(void *ctx, const struct dt_dir *d)
+{
+  struct root *r = (struct root*)ctx;
+  unsigned int tree = r->flags & F_TREE;
+  size_t plen = 2*d->depth;
 
-    strcat(shown_name, files[i].d_name);
+  //text: extend pstr with '| ' or '  ' for the inner files
+  if(!(r->flags & F_RECORDS) && (d->depth > 0)){
+    reserve(&pstr, &pstr_size, plen+1);
+    memcpy(pstr+plen-2, (tree && !r->last) ? "| " : "  ", 2);
+  }
 
-    //if shown_name's length > 54 : omit last some words and make ...
-    if(strlen(shown_name)>54 && verbose){
-      shown_name[51]='.';
-      shown_name[52]='.';
-      shown_name[53]='.';
-    }
-    if(verbose){
-      printf("%-54.54s", shown_name);
-    }
-    else{
-      printf("%s", shown_name);
-    }
-    free(shown_name);
-    shown_name = NULL;
-  
-    struct stat info;
-    lstat(sub_file_name, &info);//get information of subfile
-    char type='\0';
-    //statistic sum according to types, accumulate size, blocks
-    if(S_ISDIR(info.st_mode)) {
-      type = 'd';
-      stats->dirs++;
-    }
-    else if(S_ISCHR(info.st_mode)) {
-      type = 'c';
-    }
-    else if(S_ISBLK(info.st_mode)) {
-      type = 'b';
-    }
-    else if(S_ISFIFO(info.st_mode)) {
-      type = 'f';
-      stats->fifos++;
-    }
-    else if(S_ISLNK(info.st_mode)) {
-      type = 'l';
-      stats->links++;
+  if(d->err){//error about opendir
+    printDirError(r, d);
+    return DTW_CONTINUE;
+  }
+
+  if(snapw){
+    //spilled directories are recorded without entries under a key that never matches, so
+    //they are always read again
+    static const struct stat nokey;
+    snapw_enter(snapw, d->spilled ? &nokey : d->st, d->name);
+    for(int i=0; !d->spilled && (i<d->count); i++){
+      struct dt_entry e;
+      dt_list(d, i, &e);
+      snapw_entry(snapw, e.ino, e.name, e.len, e.type, e.st);
     }
-    else if(S_ISSOCK(info.st_mode)) {
-      type = 's';
-      stats->socks++;
+  }
+
+  return DTW_CONTINUE;
+}
+
+
+/// @brief dt_visitor entry(): print entry @a e of directory @a d. With --top, regular files are
+///        offered to topfiles; only paths that enter the set are ever copied. With --dupes, the
+///        paths of all regular files are collected in dupset.
+///
+/// @param ctx struct root* being printed
+/// @param d directory
+/// @param e entry
+static int printEntryOf(void *ctx, const struct dt_dir *d, const struct dt_entry *e)
+{
+  struct root *r = (struct root*)ctx;
+
+  //records: directories that do not match the filter are traversed without a record; the tree
+  //view shows them to connect the matching entries
+  if(r->flags & F_RECORDS){
+    if(e->flags & DTF_MATCH) rec_entry(&out, recfmt, d->path, d->len, e->name, d->depth+1, e->st);
+  }
+  else printEntry(2*d->depth, e->name, e->last, e->st, r->flags);
+  r->last = e->last;
+
+  //--top: only regular files are listed; symlinks, pipes, sockets and devices are not files
+  if(top_k && ((e->flags & (DTF_MATCH | DTF_DUPLINK)) == DTF_MATCH) && e->st &&
+     S_ISREG(e->st->st_mode) && topk_admits(topfiles, e->st->st_size)){
+    topk_add(topfiles, e->st->st_size, e->st->st_blocks, d->path, d->len, e->name);
+  }
+
+  //--dupes: regular files are candidates; further links of an inode are dropped later
+  if(find_dupes && (e->flags & DTF_MATCH) && e->st && S_ISREG(e->st->st_mode)){
+    dupes_add(dupset, e->st->st_dev, e->st->st_ino, e->st->st_size, d->path, d->len, e->name);
+  }
+
+  return DTW_CONTINUE;
+}
+
+
+/// @brief dt_visitor leave(): offer directory @a d with the total size @a s of its subtree to
+///        topdirs, close it in the snapshot and keep the totals of the root. A spilled directory
+///        that failed after some of its entries has its error printed below them.
+///
+/// @param ctx struct root* being printed
+/// @param d directory
+/// @param s totals of the subtree
+static int leaveDir(void *ctx, const struct dt_dir *d, const struct dt_summary *s)
+{
+  struct root *r = (struct root*)ctx;
+
+  if(d->err && !d->count) return DTW_CONTINUE;
+  if(d->err) printDirError(r, d);
+
+  //the path of the directory without the trailing '/' (but "/" for the root directory)
+  if(top_k) topk_add(topdirs, s->size, s->blocks, d->path, d->len > 1 ? d->len-1 : d->len, "");
+  if(snapw) snapw_leave(snapw);
+  if(d->depth == 0) r->dstat = *s;
+
+  return DTW_CONTINUE;
+}
+
+
+/// @brief thread function: print root @a arg (struct root*) with its header and summary
+static void *printRoot(void *arg)
+{
+  static const struct dt_visitor printer = { enterDir, printEntryOf, leaveDir };
+  struct root *r = (struct root*)arg;
+  unsigned int flags = r->flags;
+
+  ob_init(&out, r->fd, OUTBUF_SIZE);
+  out.prof = prof;
+  snapw = r->snapw;
+  topdirs = r->topdirs;
+  topfiles = r->topfiles;
+  dupset = r->dupes;
+
+  //-s : title
+  if(!(flags & F_RECORDS) && (flags & F_SUMMARY)){
+    //-v : additional title
+    if(flags & F_VERBOSE){
+      ob_left(&out, "Name", 60);
+      ob_left(&out, "User:Group", 21);
+      ob_left(&out, "Size", 8);
+      ob_left(&out, "Blocks", 7);
+      ob_puts(&out, "Type ");
     }
-    else{
-      stats->files++;
+    else ob_puts(&out, "Name");
+    ob_putc(&out, '\n');
+    printSection();
+  }
+  if(!(flags & F_RECORDS)){
+    ob_puts(&out, r->path);
+    ob_putc(&out, '\n');
+  }
+
+  // statistic data of this directory is in dstat
+  walk(r->path, 0, &printer, r);
+
+  //summary
+  if(flags & F_SUMMARY){
+    printSection();
+    printSummary(&r->dstat, flags);
+    ob_write(&out, "\n\n", 2);
+  }
+
+  ob_free(&out);
+  r->written = out.written;
+
+  free(pstr);
+  pstr = NULL;
+  pstr_size = 0;
+
+  return NULL;
+}
+
+
+/// @brief start the printing thread of root @a r writing to @a fd
+static void startRoot(struct root *r, int fd)
+{
+  r->fd = fd;
+  if (snapfile && !filter.active) r->snapw = snapw_create((demand & MD_SIZE) ? SNAP_SIZES : 0);
+  if (top_k) {
+    r->topdirs = topk_create(top_k);
+    r->topfiles = topk_create(top_k);
+  }
+  if (find_dupes) r->dupes = dupes_create();
+
+  if (pthread_create(&r->thread, NULL, printRoot, r) != 0) panic("Cannot create thread");
+}
+
+
+/// @brief wait for root @a r and append its output to standard output unless it was written
+///        there directly
+static void finishRoot(struct root *r)
+{
+  pthread_join(r->thread, NULL);
+
+  if (r->fd != STDOUT_FILENO) {
+    off_t off = 0;
+    ssize_t got;
+
+    // read the temporary file straight into the free part of the output buffer
+    for(;;){
+      ob_reserve(&out, OUTBUF_SIZE);
+      got = pread(r->fd, out.buf + out.len, out.size - out.len, off);
+      if ((got < 0) && (errno == EINTR)) continue;
+      if (got <= 0) break;
+      out.len += got;
+      off += got;
     }
-    stats->size+=info.st_size;
-    stats->blocks+=info.st_blocks;
-
-    //verbose additional print
-    if(verbose){
-      errno = 0;
-      struct passwd *user = getpwuid(info.st_uid);
-      struct group *group = getgrgid(info.st_gid);
-      if(!user || !group){// memory error detect
-        printf("\n%d ", errno);
-        panic("Out of memory");
-      }
+    if (got < 0) panic("Cannot read temporary output file");
+    close(r->fd);
+    r->written = 0;
+  }
+
+  if (r->snapw) {
+    snapw_merge(snapw, r->snapw);
+    snapw_free(r->snapw);
+    r->snapw = NULL;
+  }
+  if (r->topdirs) {
+    topk_merge(topdirs, r->topdirs);
+    topk_merge(topfiles, r->topfiles);
+    topk_free(r->topdirs);
+    topk_free(r->topfiles);
+    r->topdirs = r->topfiles = NULL;
+  }
+  if (r->dupes) {
+    dupes_merge(dupset, r->dupes);
+    dupes_free(r->dupes);
+    r->dupes = NULL;
+  }
+}
 
-      printf("  %8s:%-8s  %10ld  %8lu  %1c", getpwuid(info.st_uid)->pw_name, getgrgid(info.st_gid)->gr_name, info.st_size, info.st_blocks, type);
+
+/// @brief print the items of top-K set @a t, largest first, to @a o
+///
+/// @param o output buffer
+/// @param title heading
+/// @param t set
+static void printTop(struct outbuf *o, const char *title, struct topk *t)
+{
+  struct topitem *it = topk_sort(t);
+
+  ob_putc(o, '\n');
+  ob_puts(o, title);
+  ob_puts(o, "\n              size     blocks  path\n");
+  for (int i = 0; i < t->n; i++) {
+    ob_uint(o, it[i].size, 18);
+    ob_putc(o, ' ');
+    ob_uint(o, it[i].blocks, 10);
+    ob_write(o, "  ", 2);
+    ob_puts(o, it[i].path);
+    ob_putc(o, '\n');
+  }
+}
+
+
+/// @brief dupes_fn: print a group of @a n identical files of @a size bytes to the output buffer
+///        @a ctx (struct outbuf*). Called with @a n == 0 before the finder waits for the files to
+///        be read; the groups printed so far are flushed then.
+static void printDupes(void *ctx, unsigned long long size, const char **paths, int n)
+{
+  struct outbuf *o = (struct outbuf*)ctx;
+
+  if (n == 0) {
+    ob_flush(o);
+    return;
+  }
+
+  ob_uint(o, size, 18);
+  ob_putc(o, ' ');
+  ob_uint(o, n, 6);
+  for (int i = 0; i < n; i++) {
+    if (i > 0) ob_fill(o, ' ', 25);
+    ob_write(o, "  ", 2);
+    ob_puts(o, paths[i]);
+    ob_putc(o, '\n');
+  }
+}
+
+
+/// @brief append the paths in file @a fn (one per line, '-' for standard input) to @a dirs. The
+///        paths point into the returned buffer.
+///
+/// @param fn file name
+/// @param dirs array of paths, grown as needed
+/// @param ndir number of paths in @a dirs
+/// @param sdir allocated size of @a dirs
+/// @retval buffer holding the paths
+/// @retval NULL if the file cannot be read (errno is set)
+static char *readPaths(const char *fn, const char ***dirs, int *ndir, int *sdir)
+{
+  int fd = strcmp(fn, "-") ? open(fn, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+  char *buf = NULL;
+  size_t len = 0, size = 0;
+  ssize_t got;
+
+  if (fd < 0) return NULL;
+
+  for(;;){
+    reserve(&buf, &size, len + 65536);
+    got = read(fd, buf + len, size - len - 1);
+    if ((got < 0) && (errno == EINTR)) continue;
+    if (got <= 0) break;
+    len += got;
+  }
+  if (fd != STDIN_FILENO) close(fd);
+  if (got < 0) {
+    free(buf);
+    return NULL;
+  }
+  buf[len] = '\0';
+
+  // split into lines; empty lines are ignored
+  for (char *p = buf, *nl; p < buf + len; p = nl + 1) {
+    nl = memchr(p, '\n', buf + len - p);
+    if (!nl) nl = buf + len;
+    *nl = '\0';
+    if (nl == p) continue;
+
+    if (*ndir == *sdir) {
+      *sdir = *sdir ? *sdir*2 : 64;
+      *dirs = (const char **)realloc(*dirs, *sdir*sizeof(char*));
+      if (!*dirs) panic("Out of memory");
     }
-    printf("\n");
-    //if sub file is directory : recursive call
-    if(files[i].d_type == DT_DIR){
-       processDir(sub_file_name, nstr, stats, flags);
+    (*dirs)[(*ndir)++] = p;
+  }
+
+  return buf;
+}
+
+
+/// @brief --watch: the roots and options of the report
+struct watchctx {
+  const char **paths;         ///< paths of the roots
+  unsigned int flags;         ///< output control flags (F_*)
+  struct watch *w;            ///< watched trees
+};
+
+
+/// @brief watch_fn: print the refreshed totals @a t of the @a n roots of @a ctx (struct watchctx*)
+///        to standard output, with a grand total for several roots
+static void printWatch(void *ctx, const struct watch_totals *t, int n)
+{
+  struct watchctx *c = (struct watchctx*)ctx;
+  struct dt_summary sum, tsum;
+  time_t now = time(NULL);
+  char stamp[32];
+
+  memset(&tsum, 0, sizeof(tsum));
+  strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+  printSection();
+  ob_puts(&out, stamp);
+  ob_putc(&out, '\n');
+
+  for (int i = 0; i < n; i++) {
+    sum.files = t[i].files;
+    sum.dirs = t[i].dirs;
+    sum.links = t[i].links;
+    sum.fifos = t[i].fifos;
+    sum.socks = t[i].socks;
+    sum.size = t[i].size;
+    sum.blocks = t[i].blocks;
+    dt_summary_add(&tsum, &sum);
+
+    ob_puts(&out, c->paths[i]);
+    ob_putc(&out, '\n');
+    printSummary(&sum, F_VERBOSE);
+    ob_putc(&out, '\n');
+  }
+  if (n > 1) {
+    ob_puts(&out, "total\n");
+    printSummary(&tsum, F_VERBOSE);
+    ob_putc(&out, '\n');
+  }
+  ob_flush(&out);
+
+  if (c->flags & F_STATS) {
+    struct watch_stats ws;
+    watch_stats(c->w, &ws);
+    fprintf(stderr, "watch: %lu directories (%lu watched by %d inotify instances), %llu events, "
+            "%lu overflows, %llu directory reads\n", ws.dirs, ws.watched, ws.instances, ws.events,
+            ws.overflows, ws.rescans);
+  }
+}
+
+
+/// @brief --watch: walk the @a n roots at @a paths once, then keep their totals current and print
+///        them every @a interval seconds and on SIGUSR1 until SIGINT or SIGTERM
+///
+/// @retval EXIT_SUCCESS or EXIT_FAILURE
+static int watchRoots(const char **paths, int n, unsigned int flags, unsigned int interval)
+{
+  struct watchctx c = { paths, flags, NULL };
+  int res = EXIT_SUCCESS;
+
+  c.w = watch_create(paths, n);
+  if (!c.w) {
+    fprintf(stderr, "Cannot watch directories: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+  if (watch_run(c.w, interval, printWatch, &c) < 0) {
+    fprintf(stderr, "Cannot watch directories: %s\n", strerror(errno));
+    res = EXIT_FAILURE;
+  }
+  watch_free(c.w);
+
+  return res;
+}
+
+
+/// @brief --estimate: directories still to be read, as null-terminated paths
+struct estqueue {
+  char *paths;                ///< path buffer
+  size_t plen, psize;         ///< used and allocated size of paths
+  struct estdir {
+    size_t path;              ///< offset of the path in paths
+    unsigned int depth;       ///< depth of the directory
+  } *dirs;                    ///< directories
+  size_t n, size;             ///< number and allocated number of dirs
+};
+
+
+/// @brief --estimate: a walk of one directory level or of a sampled subtree
+struct estwalk {
+  struct estqueue *q;         ///< level: queue the subdirectories are appended to (or NULL)
+  unsigned int depth;         ///< depth of the directory walked
+  struct dt_summary s;        ///< totals of the walk
+  unsigned long dirs;         ///< number of directories read
+};
+
+
+/// @brief append directory @a dir (@a dlen bytes) followed by @a name (if not NULL) at @a depth
+///        to @a q
+static void estPush(struct estqueue *q, const char *dir, size_t dlen, const char *name,
+                    unsigned int depth)
+{
+  size_t nlen = name ? strlen(name) : 0;
+
+  reserve(&q->paths, &q->psize, q->plen + dlen + nlen + 1);
+  memcpy(q->paths + q->plen, dir, dlen);
+  memcpy(q->paths + q->plen + dlen, name, nlen);
+  q->paths[q->plen + dlen + nlen] = '\0';
+
+  if (q->n == q->size) {
+    q->size = q->size ? q->size*2 : 1024;
+    q->dirs = (struct estdir *)realloc(q->dirs, q->size*sizeof(struct estdir));
+    if (!q->dirs) panic("Out of memory");
+  }
+  q->dirs[q->n].path = q->plen;
+  q->dirs[q->n].depth = depth;
+  q->n++;
+  q->plen += dlen + nlen + 1;
+}
+
+
+/// @brief dt_visitor enter(): count the directories read
+static int estEnter(void *ctx, const struct dt_dir *d)
+{
+  struct estwalk *c = (struct estwalk*)ctx;
+
+  c->dirs++;
+  if (d->err && (d->depth == 0)) fprintf(stderr, "Cannot read '%s': %s\n", d->name, strerror(d->err));
+
+  return DTW_CONTINUE;
+}
+
+
+/// @brief dt_visitor entry(): one level only; subdirectories are queued instead of walked
+static int estEntry(void *ctx, const struct dt_dir *d, const struct dt_entry *e)
+{
+  struct estwalk *c = (struct estwalk*)ctx;
+
+  if (e->type != DT_DIR) return DTW_CONTINUE;
+  if (d->depth+1 < filter.depth_max) estPush(c->q, d->path, d->len, e->name, d->depth+1);
+
+  return DTW_PRUNE;
+}
+
+
+/// @brief dt_visitor leave(): keep the totals of the directory walked
+static int estLeave(void *ctx, const struct dt_dir *d, const struct dt_summary *s)
+{
+  struct estwalk *c = (struct estwalk*)ctx;
+
+  if (d->depth == c->depth) c->s = *s;
+
+  return DTW_CONTINUE;
+}
+
+
+/// @brief the EST_* quantities of summary @a s
+static void estMetrics(const struct dt_summary *s, double *y)
+{
+  y[EST_FILES] = s->files;
+  y[EST_DIRS] = s->dirs;
+  y[EST_LINKS] = s->links;
+  y[EST_SIZE] = s->size;
+  y[EST_BLOCKS] = s->blocks;
+}
+
+
+/// @brief --estimate: estimate the totals of root @a path. The top levels are read in full,
+///        breadth first, until EST_FRONTIER subtrees are left; those subtrees are then read in
+///        full in random order until the totals are within @a target relative error or the time
+///        budget of @a budget ns (0: none) is used up. The budget is checked between subtrees.
+///
+/// @param path root
+/// @param target relative error (0: none)
+/// @param budget time budget in ns (0: none)
+/// @param e estimator
+/// @param ndirs incremented by the number of directories read
+static void estimateRoot(const char *path, double target, unsigned long long budget,
+                         struct estimator *e, unsigned long *ndirs)
+{
+  static const struct dt_visitor level = { estEnter, estEntry, estLeave };
+  static const struct dt_visitor subtree = { estEnter, NULL, estLeave };
+  struct estqueue q = { 0 };
+  struct estwalk c = { &q };
+  struct dt_summary top;
+  unsigned long long t0 = nsec();
+  char *dir = NULL;
+  size_t dsize = 0, head = 0;
+  double y[EST_METRICS];
+
+  memset(&top, 0, sizeof(top));
+  estPush(&q, path, strlen(path), NULL, 0);
+
+  // top levels: breadth first; the directories left in the queue are the sampling units
+  while ((head < q.n) && (q.n - head < EST_FRONTIER)) {
+    struct estdir d = q.dirs[head++];
+    reserve(&dir, &dsize, strlen(q.paths + d.path) + 1);
+    strcpy(dir, q.paths + d.path);
+    memset(&c.s, 0, sizeof(c.s));
+    c.depth = d.depth;
+    walk(dir, d.depth, &level, &c);
+    dt_summary_add(&top, &c.s);
+  }
+
+  estMetrics(&top, y);
+  est_init(e, y, q.n - head, t0 ^ ((uint64_t)getpid() << 32));
+
+  // samples: one subtree at a time, read in full
+  while ((e->n < e->population) && !(target > 0 && est_converged(e, target)) &&
+         !(budget && (nsec() - t0 >= budget))) {
+    unsigned long k = est_next(e);
+    struct estdir d = q.dirs[head + k];
+    q.dirs[head + k] = q.dirs[head + e->n];
+    q.dirs[head + e->n] = d;
+
+    memset(&c.s, 0, sizeof(c.s));
+    c.depth = d.depth;
+    walk(q.paths + d.path, d.depth, &subtree, &c);
+    estMetrics(&c.s, y);
+    est_sample(e, y);
+  }
+  *ndirs += c.dirs;
+
+  free(dir);
+  free(q.paths);
+  free(q.dirs);
+}
+
+
+/// @brief print estimated total @a m of @a e labeled @a label
+static void printEstimate(const struct estimator *e, int m, const char *label)
+{
+  char buf[128];
+  double total, err;
+
+  est_total(e, m, &total, &err);
+  if (isinf(err)) snprintf(buf, sizeof(buf), "  %-12s %20.0f  (no interval: too few samples)\n", label, total);
+  else snprintf(buf, sizeof(buf), "  %-12s %20.0f  +- %.0f (%.2f%%)\n", label, total, err,
+                total > 0 ? 100*err/total : 0.0);
+  ob_puts(&out, buf);
+}
+
+
+/// @brief --estimate: estimate and print the totals of the @a n roots at @a paths
+///
+/// @param paths roots
+/// @param n number of roots
+/// @param flags output control flags (F_*)
+/// @param target relative error (0: none)
+/// @param budget time budget in seconds for all roots (0: none)
+static void estimateRoots(const char **paths, int n, unsigned int flags, double target,
+                          double budget)
+{
+  unsigned long long t0 = nsec(), left;
+  unsigned long ndirs = 0, nsamples = 0;
+
+  for (int i = 0; i < n; i++) {
+    struct estimator e;
+    unsigned long long t1 = nsec();
+    char buf[256];
+
+    // the time left is shared evenly by the roots still to be estimated
+    left = budget > 0 ? (unsigned long long)(budget*1e9) - (t1 - t0) : 0;
+    if (budget > 0 && (t1 - t0 >= (unsigned long long)(budget*1e9))) left = 1;
+    estimateRoot(paths[i], target, left/(n - i), &e, &ndirs);
+    nsamples += e.n;
+
+    ob_puts(&out, paths[i]);
+    if (e.n == e.population) snprintf(buf, sizeof(buf), ": exact (read in full) in %.2f s\n",
+                                      (nsec() - t1)/1e9);
+    else snprintf(buf, sizeof(buf), ": %lu of %lu subtrees sampled (%.1f%%) in %.2f s, 95%% confidence\n",
+                  e.n, e.population, 100.0*e.n/e.population, (nsec() - t1)/1e9);
+    ob_puts(&out, buf);
+    printEstimate(&e, EST_FILES, "files:");
+    printEstimate(&e, EST_DIRS, "directories:");
+    printEstimate(&e, EST_LINKS, "links:");
+    printEstimate(&e, EST_SIZE, "total size:");
+    printEstimate(&e, EST_BLOCKS, "blocks:");
+    ob_flush(&out);
+  }
+
+  if (flags & F_STATS) {
+    fprintf(stderr, "Statistics:\n");
+    fprintf(stderr, "  estimate:           %10lu directories read, %lu subtrees sampled\n", ndirs, nsamples);
+  }
+}
+
+
+/// @brief parse the --estimate specification @a spec: a relative error 'N%%', a time budget 'Ns'
+///        (or 'm', 'h'), or both separated by a comma
+///
+/// @retval 0 on success
+/// @retval -1 if @a spec is invalid
+static int parseEstimate(const char *spec, double *target, double *budget)
+{
+  const char *s = spec;
+
+  *target = *budget = 0;
+  while (*s) {
+    char *end;
+    double v = strtod(s, &end);
+
+    if ((end == s) || !(v > 0)) return -1;
+    switch (*end) {
+      case '%': *target = v/100; break;
+      case 's': *budget = v; break;
+      case 'm': *budget = v*60; break;
+      case 'h': *budget = v*3600; break;
+      default: return -1;
     }
-     
-    free(sub_file_name);
-    free(nstr);
-    sub_file_name = NULL;
-    nstr = NULL;
-  }
-  free(files);
-  files=NULL;
-  closedir(sub_dir);
+    s = end + 1;
+    if (*s == ',') s++;
+    else if (*s) return -1;
+  }
+
+  return (*target > 0) || (*budget > 0) ? 0 : -1;
 }
 
 
@@ -263,12 +931,18 @@ void syntax(const char *argv0, const char *error, ...)
     vfprintf(stderr, error, ap);
     va_end(ap);
 
-    printf("\n\n");
+    ob_puts(&out, "\n\n");
+    ob_flush(&out);
   }
 
   assert(argv0 != NULL);
 
-  fprintf(stderr, "Usage %s [-t] [-s] [-v] [-h] [path...]\n"
+  fprintf(stderr, "Usage %s [-t] [-s] [-v] [-j N] [--uring] [--preload-ids] [--format=F]\n"
+                  "       [--snapshot FILE] [--spill N] [--stat-order=O] [--timing] [--stats]\n"
+                  "       [--profile[=F]] [--dedup-links] [--link-mem MB] [--top K] [--dupes] [--watch SEC]\n"
+                  "       [--estimate SPEC] [--roots N]\n"
+                  "       [--paths FILE] [--name GLOB] [--exclude GLOB] [--type T] [--size RANGE]\n"
+                  "       [--mtime RANGE] [--depth RANGE] [-h] [path...]\n"
                   "Gather information about directory trees. If no path is given, the current directory\n"
                   "is analyzed.\n"
                   "\n"
@@ -276,9 +950,62 @@ void syntax(const char *argv0, const char *error, ...)
                   " -t        print the directory tree (default if no other option specified)\n"
                   " -s        print summary of directories (total number of files, total file size, etc)\n"
                   " -v        print detailed information for each file. Turns on tree view.\n"
+                  " -j N      scan directories in parallel using N worker threads\n"
+                  " --uring   stat entries in batches through io_uring (if supported by the kernel)\n"
+                  " --preload-ids  load user and group names from /etc/passwd and /etc/group up front\n"
+                  " --format=F  output format: 'text' (default), or one record per entry with path,\n"
+                  "           type, uid, gid, size, blocks and depth: 'ndjson' (JSON lines) or 'bin'\n"
+                  "           (length-prefixed binary records, see record.h). Ignores -t, -s, -v.\n"
+                  "           ndjson is always valid UTF-8: in a path that is not, each invalid\n"
+                  "           byte is written as U+FFFD and the exact path follows base64-encoded\n"
+                  "           in an additional field 'path_b64'\n"
+                  " --snapshot FILE  reuse the entry lists of directories that have not changed since\n"
+                  "           the snapshot in FILE was taken; FILE is updated at the end of the run\n"
+                  " --spill N keep at most N entries of a directory in memory; wider directories are\n"
+                  "           sorted in runs of N entries that are spilled to a file in $TMPDIR\n"
+                  " --stat-order=O  order of the metadata lookups of a directory: 'inode' (default,\n"
+                  "           sequential inode table access) or 'dir' (directory order)\n"
+                  " --timing  print the time spent in metadata lookups to stderr\n"
+                  " --stats   print run statistics (e.g., name cache hits/misses) to stderr\n"
+                  " --profile[=F]  print the time spent in each phase (reading directories, stat,\n"
+                  "           sorting, name lookups, output, ...), the bytes written and the largest\n"
+                  "           directory to stderr at exit, as a 'table' (default) or as 'json'\n"
+                  " --dedup-links  count the size of files with several hard links once (at the\n"
+                  "           first link in the output); records still show the size of each\n"
+                  "           link. Several paths are then processed one at a time (--roots 1)\n"
+                  " --link-mem MB  memory for the set of hard-linked inodes (default %d); larger\n"
+                  "           sets are kept in sorted runs in $TMPDIR\n"
+                  " --top K   report the K largest directories (by the total size of the entries below\n"
+                  "           them) and files at the end (on stderr with --format=ndjson|bin)\n"
+                  " --dupes   report groups of identical regular files at the end (on stderr with\n"
+                  "           --format=ndjson|bin). Files are compared by size, then by a hash of\n"
+                  "           their first and last 4 KiB, and only then read in full (-j N threads,\n"
+                  "           default one per CPU)\n"
+                  " --watch SEC  walk the paths once, then keep their totals current through inotify\n"
+                  "           and print them every SEC seconds (0: only on SIGUSR1) and on SIGUSR1,\n"
+                  "           until interrupted. The tree is not printed; filters do not apply.\n"
+                  " --estimate SPEC  estimate the totals: read the top levels in full and then a\n"
+                  "           random sample of the subtrees below them, until the 95%% confidence\n"
+                  "           intervals are within a relative error ('5%%'), a time budget ('30s',\n"
+                  "           '2m') is used up, or both ('5%%,30s'). The tree is not printed.\n"
+                  " --roots N process up to N paths at the same time (default %d); the output is\n"
+                  "           still printed in the order of the paths\n"
+                  " --paths FILE  read additional paths from FILE, one per line ('-': standard input)\n"
                   " -h        print this help\n"
-                  " path...   list of space-separated paths (max %d). Default is the current directory.\n",
-                  basename(argv0), MAX_DIR);
+                  " path...   list of space-separated paths. Default is the current directory.\n"
+                  "\n"
+                  "Filters (all given conditions must hold; only matching entries are counted, and\n"
+                  "in records only matching entries are printed):\n"
+                  " --name GLOB     name matches GLOB (repeatable: any of the patterns)\n"
+                  " --exclude GLOB  skip entries whose name matches GLOB; such directories are not\n"
+                  "           opened (repeatable)\n"
+                  " --type T  file type is one of the letters in T: f, d, l, p, s, c, b\n"
+                  " --size RANGE    size in MIN..MAX (suffixes k, M, G, T; either bound optional)\n"
+                  " --mtime RANGE   time since the last modification in MIN..MAX (suffixes s, m, h,\n"
+                  "           d, w; default days), e.g. '..1d' for the last day\n"
+                  " --depth RANGE   depth in MIN..MAX; entries of a path are at depth 1\n"
+                  "With filters, --snapshot reuses but does not update the snapshot.\n",
+                  basename(argv0), LINK_MEM, MAX_ROOTS);
 
   exit(EXIT_FAILURE);
 }
@@ -290,19 +1017,32 @@ int main(int argc, char *argv[])
   //
   // default directory is the current directory (".")
   //
-  const char CURDIR[] = ".";
-  const char *directories[MAX_DIR];
-  int ndir = 0;
+  static const char *CURDIR = ".";
+  const char **directories = NULL;
+  int ndir = 0, sdir = 0;
+  char **pathbufs = NULL;
+  int npathbufs = 0;
 
-  struct summary tstat, dstat;
+  struct dt_summary tstat;
   
   unsigned int flags = 0;
+  int jobs = 0;
+  int uring = 0;
+  int preload = 0;
+  int nroots = MAX_ROOTS;
+  long watch_interval = -1;
+  int estimate = 0;
+  double est_target = 0, est_budget = 0;
+  time_t start = time(NULL);
+  unsigned long long t_phase = nsec();
+  int profile = 0;
+  struct pool *pool = NULL;
+  struct root *roots;
+  unsigned long long written = 0;
 
-  char section[101]; // ----------------------
-  for(int i=0;i<100;i++){
-    section[i]='-';
-  }
-  section[100]='\0';
+  // all output to stdout goes through out and is written in large blocks
+  ob_init(&out, STDOUT_FILENO, OUTBUF_SIZE);
+  filter_init(&filter);
  
   //
   // parse arguments
@@ -315,21 +1055,133 @@ int main(int argc, char *argv[])
       if      (!strcmp(argv[i], "-t")) flags |= F_TREE;
       else if (!strcmp(argv[i], "-s")) flags |= F_SUMMARY;
       else if (!strcmp(argv[i], "-v")) flags |= F_VERBOSE;
+      else if (!strcmp(argv[i], "-j")) {
+        char *end;
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '-j'.");
+        jobs = (int)strtol(argv[i], &end, 10);
+        if ((*end != '\0') || (jobs < 1)) syntax(argv[0], "Invalid number of jobs '%s'.", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--uring")) uring = 1;
+      else if (!strcmp(argv[i], "--preload-ids")) preload = 1;
+      else if (!strncmp(argv[i], "--format=", 9)) {
+        const char *fmt = argv[i] + 9;
+        if (!strcmp(fmt, "text")) flags &= ~F_RECORDS;
+        else if (!strcmp(fmt, "ndjson")) { flags |= F_RECORDS; recfmt = REC_NDJSON; }
+        else if (!strcmp(fmt, "bin")) { flags |= F_RECORDS; recfmt = REC_BIN; }
+        else syntax(argv[0], "Invalid output format '%s'.", fmt);
+      }
+      else if (!strcmp(argv[i], "--spill")) {
+        char *end;
+        long n;
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--spill'.");
+        n = strtol(argv[i], &end, 10);
+        if ((*end != '\0') || (n < 1) || (n > 0x7fffffff)) syntax(argv[0], "Invalid number of entries '%s'.", argv[i]);
+        spill_limit = n;
+      }
+      else if (!strcmp(argv[i], "--snapshot")) {
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--snapshot'.");
+        snapfile = argv[i];
+      }
+      else if (!strncmp(argv[i], "--stat-order=", 13)) {
+        const char *order = argv[i] + 13;
+        if (!strcmp(order, "inode")) inode_order = 1;
+        else if (!strcmp(order, "dir")) inode_order = 0;
+        else syntax(argv[0], "Invalid stat order '%s'.", order);
+      }
+      else if (!strcmp(argv[i], "--timing")) timing = 1;
+      else if (!strcmp(argv[i], "--stats")) flags |= F_STATS;
+      else if (!strcmp(argv[i], "--profile") || !strcmp(argv[i], "--profile=table")) profile = 1;
+      else if (!strcmp(argv[i], "--profile=json")) profile = 2;
+      else if (!strncmp(argv[i], "--profile=", 10)) syntax(argv[0], "Invalid profile format '%s'.", argv[i] + 10);
+      else if (!strcmp(argv[i], "--roots")) {
+        char *end;
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--roots'.");
+        nroots = (int)strtol(argv[i], &end, 10);
+        if ((*end != '\0') || (nroots < 1)) syntax(argv[0], "Invalid number of roots '%s'.", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--dedup-links")) dedup_links = 1;
+      else if (!strcmp(argv[i], "--link-mem")) {
+        char *end;
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--link-mem'.");
+        link_mem = strtoul(argv[i], &end, 10);
+        if ((*end != '\0') || (link_mem < 1) || (link_mem > (1ul << 20))) syntax(argv[0], "Invalid memory size '%s'.", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--top")) {
+        char *end;
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--top'.");
+        top_k = (int)strtol(argv[i], &end, 10);
+        if ((*end != '\0') || (top_k < 1) || (top_k > 1000000)) syntax(argv[0], "Invalid number of items '%s'.", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--dupes")) find_dupes = 1;
+      else if (!strcmp(argv[i], "--estimate")) {
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--estimate'.");
+        if (parseEstimate(argv[i], &est_target, &est_budget) < 0) syntax(argv[0], "Invalid estimate '%s'.", argv[i]);
+        estimate = 1;
+      }
+      else if (!strcmp(argv[i], "--watch")) {
+        char *end;
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--watch'.");
+        watch_interval = strtol(argv[i], &end, 10);
+        if ((*end != '\0') || (watch_interval < 0) || (watch_interval > 86400)) syntax(argv[0], "Invalid interval '%s'.", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--paths")) {
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--paths'.");
+        pathbufs = (char **)realloc(pathbufs, (npathbufs+1)*sizeof(char*));
+        if (!pathbufs) panic("Out of memory");
+        pathbufs[npathbufs] = readPaths(argv[i], &directories, &ndir, &sdir);
+        if (!pathbufs[npathbufs]) {
+          fprintf(stderr, "Cannot read paths from '%s': %s\n", argv[i], strerror(errno));
+          return EXIT_FAILURE;
+        }
+        npathbufs++;
+      }
+      else if (!strcmp(argv[i], "--name") || !strcmp(argv[i], "--exclude")) {
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '%s'.", argv[i-1]);
+        int res = argv[i-1][2] == 'n' ? filter_name(&filter, argv[i]) : filter_exclude(&filter, argv[i]);
+        if (res < 0) panic("Out of memory");
+      }
+      else if (!strcmp(argv[i], "--type")) {
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--type'.");
+        if (filter_types(&filter, argv[i]) < 0) syntax(argv[0], "Invalid file types '%s'.", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--size")) {
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--size'.");
+        if (filter_size(&filter, argv[i]) < 0) syntax(argv[0], "Invalid size range '%s'.", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--mtime")) {
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--mtime'.");
+        if (filter_mtime(&filter, argv[i], start) < 0) syntax(argv[0], "Invalid age range '%s'.", argv[i]);
+      }
+      else if (!strcmp(argv[i], "--depth")) {
+        if (++i >= argc) syntax(argv[0], "Missing argument for option '--depth'.");
+        if (filter_depth(&filter, argv[i]) < 0) syntax(argv[0], "Invalid depth range '%s'.", argv[i]);
+      }
       else if (!strcmp(argv[i], "-h")) syntax(argv[0], NULL);
       else syntax(argv[0], "Unrecognized option '%s'.", argv[i]);
     } else {
       // anything else is recognized as a directory
-      if (ndir < MAX_DIR) {
-        directories[ndir++] = argv[i];
-      } else {
-        printf("Warning: maximum number of directories exceeded, ignoring '%s'.\n", argv[i]);
+      if (ndir == sdir) {
+        sdir = sdir ? sdir*2 : 64;
+        directories = (const char **)realloc(directories, sdir*sizeof(char*));
+        if (!directories) panic("Out of memory");
       }
+      directories[ndir++] = argv[i];
     }
   } 
-  // if no directory was specified, use the current directory
-  if (ndir == 0) directories[ndir++] = CURDIR;
+  // if no directory was specified, use the current directory. An empty list read with --paths
+  // is not replaced.
+  if ((ndir == 0) && (npathbufs == 0)) {
+    directories = &CURDIR;
+    ndir = 1;
+  }
 
 
+  // records are self-describing; the tree and summary views do not apply
+  if (flags & F_RECORDS) {
+    flags &= ~(F_TREE | F_SUMMARY | F_VERBOSE);
+    rec_begin(&out, recfmt);
+  }
+
   //
   // process each directory
   //
@@ -343,85 +1195,284 @@ int main(int argc, char *argv[])
   tstat.size=0;
   tstat.socks=0;
 
-  for (int i = 0; i < ndir ; i++){
-    //initalize dstat
-    dstat.blocks=0;
-    dstat.dirs=0;
-    dstat.fifos=0;
-    dstat.files=0;
-    dstat.links=0;
-    dstat.size=0;
-    dstat.socks=0;
-
-    //-s : title
-    if(flags & F_SUMMARY){
-      printf("%-60s", "Name");
-      //-v : additional title
-      if(flags & F_VERBOSE){
-        printf("%-21s%-8s%-7s%s", "User:Group", "Size", "Blocks", "Type");
-      }
-      printf("\n%s\n", section);
+  // directories stay open while their subdirectories are traversed; allow as many open files as
+  // the hard limit permits
+  struct rlimit rl;
+  if ((getrlimit(RLIMIT_NOFILE, &rl) == 0) && (rl.rlim_cur < rl.rlim_max)) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  // with --watch, the trees are walked once and their totals are then kept current through inotify;
+  // the tree is not printed
+  if (watch_interval >= 0) {
+    int res = watchRoots(directories, ndir, flags, (unsigned int)watch_interval);
+    if (sdir) free(directories);
+    for (int i = 0; i < npathbufs; i++) free(pathbufs[i]);
+    free(pathbufs);
+    filter_free(&filter);
+    ob_free(&out);
+    return res;
+  }
+
+  // with --profile, the phases of the traversal and of the output are timed
+  if (profile) {
+    prof = prof_create();
+    if (!prof) panic("Out of memory");
+    out.prof = prof;
+  }
+
+  // with -j, directories are read ahead by a pool of worker threads; the printing threads visit
+  // them in tree order as they complete
+  if (jobs > 0) {
+    pool = pool_create(jobs);
+    if (!pool) panic("Cannot create thread pool");
+  }
+  if (nroots > ndir) nroots = ndir > 0 ? ndir : 1;
+
+  // --estimate reads each directory on its own (with sizes); neither spills, snapshots nor link
+  // deduplication apply
+  demand = planMetadata(flags);
+  if (estimate) {
+    demand |= MD_SIZE;
+    spill_limit = 0;
+    snapfile = NULL;
+    dedup_links = 0;
+  }
+  if (preload && (demand & MD_OWNER)) idcache_preload();
+
+  // with --dedup-links, inodes with several links are remembered so that their size is counted
+  // once; without sizes in the output, there is nothing to deduplicate. The link counted is the
+  // first one in the output, so the roots are walked one after another (each by all workers).
+  if (dedup_links && (demand & MD_SIZE)) {
+    linkset = inoset_create(link_mem << 20);
+    if (!linkset) panic("Out of memory");
+    nroots = 1;
+  }
+
+  // with --snapshot, the previous snapshot (if any) is mapped and a new one is built during the
+  // walk: one per root, merged into the main thread's writer in order. Filtered runs do not see
+  // all entries and only read the snapshot.
+  if (snapfile) {
+    snap = snap_load(snapfile);
+    if (!filter.active) snapw = snapw_create((demand & MD_SIZE) ? SNAP_SIZES : 0);
+  }
+
+  // the traversal: with --uring, each worker and printing thread gets its own ring
+  struct dt_options opt = {
+    .pool = pool, .walkers = nroots, .stat = (demand & ~MD_TYPE) != 0, .dirstat = snapfile != NULL,
+    .uring = uring, .dir_order = !inode_order, .timing = timing, .spill = spill_limit,
+    .filter = &filter, .snap = snap, .links = linkset, .profile = prof
+  };
+  dt = dt_create(&opt);
+  if (!dt) panic("Out of memory");
+  prof_add(prof, PROF_SETUP, nsec() - t_phase);
+  t_phase = nsec();
+
+  // with --estimate, the top levels are read in full and the totals of the rest are estimated from
+  // a random sample of subtrees; the tree is not printed
+  if (estimate) {
+    estimateRoots(directories, ndir, flags, est_target, est_budget);
+    dt_free(dt);
+    pool_destroy(pool);
+    if (sdir) free(directories);
+    for (int i = 0; i < npathbufs; i++) free(pathbufs[i]);
+    free(pathbufs);
+    filter_free(&filter);
+    ob_free(&out);
+    if (prof) {
+      prof_add(prof, PROF_TRAVERSE, nsec() - t_phase);
+      prof_print(prof, stderr, profile == 2);
+      prof_free(prof);
     }
-    printf("%s\n", directories[i]);
-    processDir(directories[i], "", &dstat, flags); // statistic data of this directory is in dstat
-
-    //summary
-    if(flags & F_SUMMARY){
-      printf("%s\n", section);
-      char *str;
-      //summary data by directory and grammarly correct
-      int combine_err = asprintf(&str, "%d %s, %d %s, %d %s, %d %s, and %d %s", 
-          dstat.files, dstat.files==1?"file":"files", 
-          dstat.dirs,dstat.dirs==1?"directory":"directories", 
-          dstat.links, dstat.links==1?"link":"links",
-          dstat.fifos,dstat.fifos==1?"pipe":"pipes", 
-          dstat.socks, dstat.socks==1?"socket":"sockets");
-      if(combine_err==-1){
-        panic("Out of memory");
-      }
-      printf("%-67s", str);
-      free(str);
-      str = NULL;
+    return EXIT_SUCCESS;
+  }
 
-      //additional verbose summary
-      if(flags & F_VERBOSE){
-        printf("   %15lld %9llu", dstat.size, dstat.blocks);//current directory's size, blocks
-      }
-      printf("\n\n");
-
-      //accumulate dstat's data to tstat
-      tstat.blocks += dstat.blocks;
-      tstat.dirs += dstat.dirs;
-      tstat.fifos += dstat.fifos;
-      tstat.files += dstat.files;
-      tstat.links += dstat.links;
-      tstat.size += dstat.size;
-      tstat.socks += dstat.socks;
+  // with --top, the largest subtrees and files of all roots are merged into the main thread's sets
+  if (top_k) {
+    topdirs = topk_create(top_k);
+    topfiles = topk_create(top_k);
+  }
+  // with --dupes, the regular files of all roots are collected in the main thread's set
+  if (find_dupes) dupset = dupes_create();
+
+  // the roots are printed by up to nroots threads at a time. The first root still to be emitted
+  // writes to standard output directly; the ones started ahead of it write to a temporary file
+  // that is appended to the output once all earlier roots have been emitted. Roots for which no
+  // temporary file can be created are started once they are the next to be emitted.
+  roots = (struct root *)calloc(ndir ? ndir : 1, sizeof(struct root));
+  if (!roots) panic("Out of memory");
+
+  for (int i = 0, next = 0; i < ndir; i++){
+    while ((next < ndir) && (next < i + nroots)) {
+      struct root *r = &roots[next];
+      int fd = STDOUT_FILENO;
+
+      if ((next > i) && ((fd = spill_tmpfile()) < 0)) break;
+      if (next == i) ob_flush(&out);
+
+      r->path = directories[next];
+      r->flags = flags;
+      startRoot(r, fd);
+      next++;
     }
+
+    finishRoot(&roots[i]);
+    written += roots[i].written;
+
+    //accumulate dstat's data to tstat
+    if (flags & F_SUMMARY) dt_summary_add(&tstat, &roots[i].dstat);
   }
+  free(roots);
+  if (sdir) free(directories);
+  for (int i = 0; i < npathbufs; i++) free(pathbufs[i]);
+  free(pathbufs);
 
   //
   // print grand total
   //
   if ((flags & F_SUMMARY) && (ndir > 1)) {
-    printf("Analyzed %d directories:\n"
-           "  total # of files:        %16d\n"
-           "  total # of directories:  %16d\n"
-           "  total # of links:        %16d\n"
-           "  total # of pipes:        %16d\n"
-           "  total # of socksets:     %16d\n",
-           ndir, tstat.files, tstat.dirs, tstat.links, tstat.fifos, tstat.socks);
+    // like the reference, the grand total does not include pipes and sockets
+    ob_puts(&out, "Analyzed ");
+    ob_uint(&out, ndir, 0);
+    ob_puts(&out, " directories:\n  total # of files:        ");
+    ob_uint(&out, tstat.files, 16);
+    ob_puts(&out, "\n  total # of directories:  ");
+    ob_uint(&out, tstat.dirs, 16);
+    ob_puts(&out, "\n  total # of links:        ");
+    ob_uint(&out, tstat.links, 16);
+    ob_puts(&out, "\n  total # of pipes:        ");
+    ob_uint(&out, 0, 16);
+    ob_puts(&out, "\n  total # of socksets:     ");
+    ob_uint(&out, 0, 16);
+    ob_putc(&out, '\n');
 
     if (flags & F_VERBOSE) {
-      printf("  total file size:         %16llu\n"
-             "  total # of blocks:       %16llu\n",
-             tstat.size, tstat.blocks);
+      ob_puts(&out, "  total file size:         ");
+      ob_uint(&out, tstat.size, 16);
+      ob_puts(&out, "\n  total # of blocks:       ");
+      ob_uint(&out, tstat.blocks, 16);
+      ob_putc(&out, '\n');
+    }
+
+  }
+  prof_add(prof, PROF_TRAVERSE, nsec() - t_phase);
+  t_phase = nsec();
+
+  //
+  // largest subtrees and files; on stderr if stdout carries records
+  //
+  if (top_k) {
+    struct outbuf report;
+
+    if (flags & F_RECORDS) ob_init(&report, STDERR_FILENO, OUTBUF_SIZE);
+    printTop((flags & F_RECORDS) ? &report : &out, "Largest directories:", topdirs);
+    printTop((flags & F_RECORDS) ? &report : &out, "Largest files:", topfiles);
+    if (flags & F_RECORDS) ob_free(&report);
+    topk_free(topdirs);
+    topk_free(topfiles);
+  }
+
+  //
+  // groups of identical files, streamed as they are found; on stderr if stdout carries records.
+  // The files are read by the workers of the pool, or by one worker per CPU without -j.
+  //
+  struct dupes_stats dst;
+  struct dt_stats ds;
+  if (find_dupes) {
+    struct outbuf report, *o = &out;
+
+    if (flags & F_RECORDS) {
+      ob_init(&report, STDERR_FILENO, OUTBUF_SIZE);
+      o = &report;
+    }
+    if (!pool) {
+      long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+      pool = pool_create(ncpu > 0 ? (int)ncpu : 1);
     }
+    ob_puts(o, "\nDuplicate files:\n              size  files  path\n");
+    dupes_find(dupset, pool, printDupes, o, &dst);
+    if (flags & F_RECORDS) ob_free(&report);
+    dupes_free(dupset);
+  }
+  dt_stats(dt, &ds);
+  dt_free(dt);
+  filter_free(&filter);
+  pool_destroy(pool);
+  ob_free(&out);
+
+  //
+  // save the snapshot of this run
+  //
+  int res = EXIT_SUCCESS;
+  if (snapw) {
+    if (snapw_save(snapw, snapfile, start) < 0) {
+      fprintf(stderr, "Cannot write snapshot '%s': %s\n", snapfile, strerror(errno));
+      res = EXIT_FAILURE;
+    }
+    snapw_free(snapw);
+    snap_unload(snap);
+  }
+
+  //
+  // run statistics
+  //
+  if (flags & F_STATS) {
+    fprintf(stderr, "Statistics:\n");
+    idcache_stats(stderr);
+    fprintf(stderr, "  output:             %10llu bytes\n", out.written + written);
+    if (snapfile) fprintf(stderr, "  snapshot:           %10lu directories reused\n", ds.snap_reused);
+    if (spill_limit) fprintf(stderr, "  spill:              %10lu directories spilled in %lu runs\n",
+                             ds.spill_dirs, ds.spill_runs);
+    if (find_dupes) {
+      fprintf(stderr, "  dupes:              %10llu files, %llu of a shared size; %llu partially and %llu"
+              " fully read (%llu bytes)\n", dst.files - dst.links, dst.sized, dst.partial, dst.full,
+              dst.bytes);
+      fprintf(stderr, "                      %10llu groups with %llu duplicates (%llu bytes), %llu further"
+              " links, %llu errors\n", dst.groups, dst.dupes, dst.wasted, dst.links, dst.errors);
+    }
+    if (linkset) {
+      struct inoset_stats ls;
+      inoset_stats(linkset, &ls);
+      fprintf(stderr, "  hard links:         %10llu lookups, %llu duplicates (%llu bytes not counted)\n",
+              ls.lookups, ls.found, ds.link_bytes);
+      fprintf(stderr, "  inode set:          %10llu inodes, %zu KiB in memory, %llu KiB in %u runs on disk"
+              " (%lu spills, %lu merges)\n", ls.keys, ls.mem >> 10, ls.disk >> 10, ls.runs, ls.spills,
+              ls.merges);
+    }
+  }
+
+  //
+  // timing of the metadata lookups; compare runs with --stat-order=inode and --stat-order=dir to
+  // see what the inode order saves on a given file system
+  //
+  if (timing) {
+    fprintf(stderr, "Timing:\n");
+    fprintf(stderr, "  metadata lookups:   %10llu in %.3f s (%.2f us per lookup, %s order)\n",
+            ds.lookups, ds.t_lookup/1e9, ds.lookups ? ds.t_lookup/1e3/ds.lookups : 0.0,
+            inode_order ? "inode" : "directory");
+    fprintf(stderr, "  inode ordering:                   %.3f s\n", ds.t_order/1e9);
+    if (linkset) {
+      struct inoset_stats ls;
+      inoset_stats(linkset, &ls);
+      fprintf(stderr, "  hard link set:                    %.3f s (%.3f s writing runs)\n",
+              ds.t_links/1e9, ls.spill_ns/1e9);
+    }
+  }
+
+  inoset_free(linkset);
 
+  //
+  // time spent in each phase; the output has been flushed
+  //
+  if (prof) {
+    prof_add(prof, PROF_REPORT, nsec() - t_phase);
+    prof_print(prof, stderr, profile == 2);
+    prof_free(prof);
   }
 
   //
   // that's all, folks
   //
-  return EXIT_SUCCESS;
+  return res;
 }
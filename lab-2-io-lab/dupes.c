@@ -0,0 +1,579 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief duplicate file finder (--dupes)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "dupes.h"
+#include "util.h"
+
+#define PART_SIZE     4096    ///< bytes hashed at the start and at the end of a file
+#define READ_SIZE     (1024*1024) ///< read size when hashing a file in full
+#define WINDOW        4096    ///< number of files being hashed ahead of the group being reported
+
+/// @brief states of a file
+#define DF_NEW        0       ///< not read yet
+#define DF_HASHED     1       ///< full is the hash of the entire content
+#define DF_FULL       2       ///< shares its partial hash with another file: to be read in full
+#define DF_UNIQUE     3       ///< no other file has the same partial hash
+#define DF_ERROR      4       ///< cannot be read
+
+/// @brief a candidate file
+struct dfile {
+  uint64_t size;              ///< size in bytes
+  uint64_t dev;               ///< device number
+  uint64_t ino;               ///< inode number
+  union {
+    size_t off;               ///< offset of the path in dupes.paths (while files are added)
+    const char *ptr;          ///< path (in dupes_find())
+  } path;
+  uint64_t part;              ///< hash of the first and last PART_SIZE bytes
+  uint64_t full;              ///< hash of the content
+  size_t group;               ///< index of the size group
+  int state;                  ///< DF_* state
+};
+
+/// @brief files of the same size, dupes.files[lo..hi)
+struct dgroup {
+  size_t lo, hi;              ///< range of the files
+  int pending;                ///< number of files being read (atomic)
+  int done;                   ///< all files are read (protected by dupes.lock)
+};
+
+/// @brief a read task: file @a i of @a d
+struct djob {
+  struct dupes *d;            ///< set
+  size_t i;                   ///< index of the file
+};
+
+struct dupes {
+  struct dfile *files;        ///< files
+  size_t n, cap;              ///< number and capacity of files
+  char *paths;                ///< null-terminated paths of the files
+  size_t plen, psize;         ///< used and allocated size of paths
+
+  // state of dupes_find()
+  struct pool *pool;          ///< thread pool or NULL
+  struct dgroup *groups;      ///< size groups
+  struct djob *jobs;          ///< one job per file
+  pthread_mutex_t lock;       ///< protects dgroup.done
+  pthread_cond_t cond;        ///< signaled when a group is done
+  struct dupes_stats st;      ///< statistics (counters updated by the tasks are atomic)
+};
+
+
+//--------------------------------------------------------------------------------------------------
+// 64-bit content hash (XXH64)
+//
+
+#define P1 0x9e3779b185ebca87ull
+#define P2 0xc2b2ae3d27d4eb4full
+#define P3 0x165667b19e3779f9ull
+#define P4 0x85ebca77c2b2ae63ull
+#define P5 0x27d4eb2f165667c5ull
+
+static uint64_t rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t in)
+{
+  return rotl(acc + in*P2, 31)*P1;
+}
+
+static uint64_t merge64(uint64_t acc, uint64_t v)
+{
+  return (acc ^ round64(0, v))*P1 + P4;
+}
+
+
+/// @brief hash of the @a len bytes at @a buf. Longer inputs are hashed in pieces by passing the
+///        hash of the previous piece as @a seed.
+static uint64_t hash64(const void *buf, size_t len, uint64_t seed)
+{
+  const unsigned char *p = (const unsigned char *)buf, *end = p + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+    do {
+      v1 = round64(v1, read64(p));
+      v2 = round64(v2, read64(p + 8));
+      v3 = round64(v3, read64(p + 16));
+      v4 = round64(v4, read64(p + 24));
+      p += 32;
+    } while (p + 32 <= end);
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge64(merge64(merge64(merge64(h, v1), v2), v3), v4);
+  }
+  else h = seed + P5;
+
+  h += len;
+  for (; p + 8 <= end; p += 8) h = rotl(h ^ round64(0, read64(p)), 27)*P1 + P4;
+  if (p + 4 <= end) {
+    h = rotl(h ^ (uint64_t)read32(p)*P1, 23)*P2 + P3;
+    p += 4;
+  }
+  for (; p < end; p++) h = rotl(h ^ *p*P5, 11)*P1;
+
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// reading files
+//
+
+/// @brief read @a len bytes at offset @a off of @a fd into @a buf
+///
+/// @retval number of bytes read (less than @a len at the end of the file)
+/// @retval -1 on error (errno is set)
+static ssize_t readAt(int fd, char *buf, size_t len, off_t off)
+{
+  size_t done = 0;
+
+  while (done < len) {
+    ssize_t got = pread(fd, buf + done, len - done, off + done);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (got == 0) break;
+    done += got;
+  }
+
+  return done;
+}
+
+
+/// @brief open file @a f for reading without updating its access time where permitted
+static int openFile(const struct dfile *f)
+{
+  int fd = open(f->path.ptr, O_RDONLY | O_CLOEXEC | O_NOATIME);
+
+  if ((fd < 0) && (errno == EPERM)) fd = open(f->path.ptr, O_RDONLY | O_CLOEXEC);
+
+  return fd;
+}
+
+
+/// @brief mark file @a f of @a d as unreadable; @a err is 0 if the file changed its size
+static void failFile(struct dupes *d, struct dfile *f, int err)
+{
+  f->state = DF_ERROR;
+  __atomic_add_fetch(&d->st.errors, 1, __ATOMIC_RELAXED);
+  fprintf(stderr, "Cannot read '%s': %s\n", f->path.ptr, err ? strerror(err) : "file changed during the run");
+}
+
+
+/// @brief hash the first and last PART_SIZE bytes of file @a f. For files of up to 2*PART_SIZE
+///        bytes, this is the hash of the entire content.
+static void hashPart(struct dupes *d, struct dfile *f)
+{
+  char buf[2*PART_SIZE];
+  size_t len = f->size <= 2*PART_SIZE ? f->size : PART_SIZE;
+  ssize_t got, tail = 0;
+  int fd = openFile(f);
+
+  if (fd < 0) {
+    failFile(d, f, errno);
+    return;
+  }
+
+  got = readAt(fd, buf, len, 0);
+  if ((got == (ssize_t)len) && (f->size > 2*PART_SIZE)) {
+    tail = readAt(fd, buf + len, PART_SIZE, f->size - PART_SIZE);
+    if (tail < 0) got = -1;
+    else if (tail != PART_SIZE) got = 0;
+  }
+  if (got < 0) failFile(d, f, errno);
+  close(fd);
+  if (got < 0) return;
+  if (got != (ssize_t)len) {
+    failFile(d, f, 0);
+    return;
+  }
+
+  f->part = hash64(buf, len + tail, f->size);
+  if (f->size <= 2*PART_SIZE) {
+    f->full = f->part;
+    f->state = DF_HASHED;
+  }
+  __atomic_add_fetch(&d->st.partial, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&d->st.bytes, len + tail, __ATOMIC_RELAXED);
+}
+
+
+/// @brief hash the entire content of file @a f in READ_SIZE pieces
+static void hashFull(struct dupes *d, struct dfile *f)
+{
+  size_t bsize = f->size < READ_SIZE ? f->size : READ_SIZE;
+  uint64_t h = f->size, off = 0;
+  ssize_t got = 0;
+  char *buf;
+  int fd = openFile(f);
+
+  if (fd < 0) {
+    failFile(d, f, errno);
+    return;
+  }
+
+  // the file is read once, front to back; its pages are not needed afterwards
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  buf = (char *)malloc(bsize);
+  if (!buf) oom();
+
+  while (off < f->size) {
+    size_t len = f->size - off < bsize ? f->size - off : bsize;
+    got = readAt(fd, buf, len, off);
+    if (got != (ssize_t)len) break;
+    h = hash64(buf, len, h);
+    off += len;
+  }
+  if (got < 0) failFile(d, f, errno);
+  else if (off < f->size) failFile(d, f, 0);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+  free(buf);
+  if (off < f->size) return;
+
+  f->full = h;
+  f->state = DF_HASHED;
+  __atomic_add_fetch(&d->st.full, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&d->st.bytes, f->size, __ATOMIC_RELAXED);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// stages
+//
+
+/// @brief run @a fn(@a arg) on the pool of @a d, or right away without a pool (or if it cannot be
+///        queued)
+static void submit(struct dupes *d, task_fn fn, void *arg)
+{
+  if (!d->pool || (pool_submit(d->pool, fn, arg) < 0)) fn(arg);
+}
+
+
+/// @brief order of files for dropping further links: decreasing size, then by inode and path
+static int compareFiles(const void *a, const void *b)
+{
+  const struct dfile *x = (const struct dfile*)a, *y = (const struct dfile*)b;
+
+  if (x->size != y->size) return x->size < y->size ? 1 : -1;
+  if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+  if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+
+  return strcmp(x->path.ptr, y->path.ptr);
+}
+
+
+/// @brief order of files within a group after the partial hashes: readable first, by partial hash
+static int comparePart(const void *a, const void *b)
+{
+  const struct dfile *x = (const struct dfile*)a, *y = (const struct dfile*)b;
+
+  if ((x->state == DF_ERROR) != (y->state == DF_ERROR)) return x->state == DF_ERROR ? 1 : -1;
+  if (x->part != y->part) return x->part < y->part ? -1 : 1;
+
+  return 0;
+}
+
+
+/// @brief order of files within a group for the report: hashed first, by hash, then by path
+static int compareFull(const void *a, const void *b)
+{
+  const struct dfile *x = (const struct dfile*)a, *y = (const struct dfile*)b;
+
+  if ((x->state == DF_HASHED) != (y->state == DF_HASHED)) return x->state == DF_HASHED ? -1 : 1;
+  if (x->full != y->full) return x->full < y->full ? -1 : 1;
+
+  return strcmp(x->path.ptr, y->path.ptr);
+}
+
+
+/// @brief mark group @a g of @a d as done
+static void groupDone(struct dupes *d, struct dgroup *g)
+{
+  pthread_mutex_lock(&d->lock);
+  g->done = 1;
+  pthread_cond_broadcast(&d->cond);
+  pthread_mutex_unlock(&d->lock);
+}
+
+
+/// @brief task: hash file @a arg (struct djob*) in full; the last file of a group completes it
+static void fullTask(void *arg)
+{
+  struct djob *j = (struct djob*)arg;
+  struct dfile *f = &j->d->files[j->i];
+  struct dgroup *g = &j->d->groups[f->group];
+
+  hashFull(j->d, f);
+  if (__atomic_sub_fetch(&g->pending, 1, __ATOMIC_ACQ_REL) == 0) groupDone(j->d, g);
+}
+
+
+/// @brief continue group @a g of @a d once all partial hashes are known: files whose partial hash
+///        is shared with another file are read in full
+static void endPart(struct dupes *d, struct dgroup *g)
+{
+  struct dfile *f = d->files;
+  int n = 0;
+
+  qsort(f + g->lo, g->hi - g->lo, sizeof(struct dfile), comparePart);
+
+  for (size_t i = g->lo, k; i < g->hi; i = k) {
+    for (k = i + 1; (k < g->hi) && (f[k].state != DF_ERROR) && (f[k].part == f[i].part); k++);
+    if (f[i].state == DF_ERROR) break;
+    for (size_t m = i; m < k; m++) {
+      if (k - i == 1) f[m].state = DF_UNIQUE;
+      else if (f[m].state == DF_NEW) {
+        f[m].state = DF_FULL;
+        n++;
+      }
+    }
+  }
+
+  if (n == 0) {
+    groupDone(d, g);
+    return;
+  }
+
+  // the counter is set before the first task can decrement it
+  g->pending = n;
+  for (size_t i = g->lo; i < g->hi; i++) {
+    if (f[i].state == DF_FULL) submit(d, fullTask, &d->jobs[i]);
+  }
+}
+
+
+/// @brief task: hash the first and last bytes of file @a arg (struct djob*); the last file of a
+///        group continues it
+static void partTask(void *arg)
+{
+  struct djob *j = (struct djob*)arg;
+  struct dfile *f = &j->d->files[j->i];
+  struct dgroup *g = &j->d->groups[f->group];
+
+  hashPart(j->d, f);
+  if (__atomic_sub_fetch(&g->pending, 1, __ATOMIC_ACQ_REL) == 0) endPart(j->d, g);
+}
+
+
+/// @brief report the identical files of group @a g
+static void reportGroup(struct dupes *d, struct dgroup *g, dupes_fn report, void *ctx,
+                        const char **paths)
+{
+  struct dfile *f = d->files;
+
+  qsort(f + g->lo, g->hi - g->lo, sizeof(struct dfile), compareFull);
+
+  for (size_t i = g->lo, k; (i < g->hi) && (f[i].state == DF_HASHED); i = k) {
+    int n = 0;
+    for (k = i; (k < g->hi) && (f[k].state == DF_HASHED) && (f[k].full == f[i].full); k++) {
+      paths[n++] = f[k].path.ptr;
+    }
+    if (n < 2) continue;
+
+    d->st.groups++;
+    d->st.dupes += n - 1;
+    d->st.wasted += (n - 1)*f[i].size;
+    report(ctx, f[i].size, paths, n);
+  }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// interface
+//
+
+struct dupes *dupes_create(void)
+{
+  struct dupes *d = (struct dupes *)calloc(1, sizeof(struct dupes));
+  if (!d) oom();
+
+  return d;
+}
+
+
+void dupes_add(struct dupes *d, uint64_t dev, uint64_t ino, unsigned long long size,
+               const char *dir, size_t dlen, const char *name)
+{
+  size_t nlen = strlen(name);
+  struct dfile *f;
+
+  if (size == 0) return;
+
+  if (d->n == d->cap) {
+    d->cap = d->cap ? d->cap*2 : 1024;
+    d->files = (struct dfile *)realloc(d->files, d->cap*sizeof(struct dfile));
+    if (!d->files) oom();
+  }
+  if (d->plen + dlen + nlen + 1 > d->psize) {
+    while (d->plen + dlen + nlen + 1 > d->psize) d->psize = d->psize ? d->psize*2 : 65536;
+    d->paths = (char *)realloc(d->paths, d->psize);
+    if (!d->paths) oom();
+  }
+
+  f = &d->files[d->n++];
+  memset(f, 0, sizeof(struct dfile));
+  f->size = size;
+  f->dev = dev;
+  f->ino = ino;
+  f->path.off = d->plen;
+  memcpy(d->paths + d->plen, dir, dlen);
+  memcpy(d->paths + d->plen + dlen, name, nlen + 1);
+  d->plen += dlen + nlen + 1;
+}
+
+
+void dupes_merge(struct dupes *d, struct dupes *src)
+{
+  for (size_t i = 0; i < src->n; i++) {
+    const struct dfile *f = &src->files[i];
+    const char *p = src->paths + f->path.off;
+    dupes_add(d, f->dev, f->ino, f->size, p, strlen(p), "");
+  }
+
+  free(src->files);
+  free(src->paths);
+  src->files = NULL;
+  src->paths = NULL;
+  src->n = src->cap = src->plen = src->psize = 0;
+}
+
+
+void dupes_find(struct dupes *d, struct pool *pool, dupes_fn report, void *ctx,
+                struct dupes_stats *st)
+{
+  size_t n = 0, ngroups = 0, maxn = 0;
+  const char **paths;
+
+  memset(&d->st, 0, sizeof(d->st));
+  d->st.files = d->n;
+  for (size_t i = 0; i < d->n; i++) d->files[i].path.ptr = d->paths + d->files[i].path.off;
+
+  // largest files first; further links of an inode are dropped
+  qsort(d->files, d->n, sizeof(struct dfile), compareFiles);
+  for (size_t i = 0; i < d->n; i++) {
+    struct dfile *f = &d->files[i];
+    if ((n > 0) && (f->size == d->files[n-1].size) && (f->dev == d->files[n-1].dev) &&
+        (f->ino == d->files[n-1].ino)) {
+      d->st.links++;
+      continue;
+    }
+    d->files[n++] = *f;
+  }
+  d->n = n;
+
+  // groups of files of the same size; a file with a unique size has no duplicate and is never read
+  d->groups = (struct dgroup *)malloc((n/2 + 1)*sizeof(struct dgroup));
+  d->jobs = (struct djob *)malloc((n ? n : 1)*sizeof(struct djob));
+  if (!d->groups || !d->jobs) oom();
+  for (size_t i = 0, k; i < n; i = k) {
+    for (k = i + 1; (k < n) && (d->files[k].size == d->files[i].size); k++);
+    if (k - i < 2) continue;
+
+    struct dgroup *g = &d->groups[ngroups];
+    g->lo = i;
+    g->hi = k;
+    g->pending = g->done = 0;
+    for (size_t m = i; m < k; m++) {
+      d->files[m].group = ngroups;
+      d->jobs[m].d = d;
+      d->jobs[m].i = m;
+    }
+    d->st.sized += k - i;
+    if (k - i > maxn) maxn = k - i;
+    ngroups++;
+  }
+
+  paths = (const char **)malloc((maxn ? maxn : 1)*sizeof(char*));
+  if (!paths) oom();
+  d->pool = pool;
+  pthread_mutex_init(&d->lock, NULL);
+  pthread_cond_init(&d->cond, NULL);
+
+  // groups are read up to WINDOW files ahead of the one being reported and reported in order
+  for (size_t g = 0, next = 0, inflight = 0; g < ngroups; g++) {
+    struct dgroup *cur = &d->groups[g];
+
+    while ((next < ngroups) && ((next == g) || (inflight < WINDOW))) {
+      struct dgroup *ng = &d->groups[next++];
+      inflight += ng->hi - ng->lo;
+      ng->pending = ng->hi - ng->lo;
+      for (size_t i = ng->lo; i < ng->hi; i++) submit(d, partTask, &d->jobs[i]);
+    }
+
+    pthread_mutex_lock(&d->lock);
+    if (!cur->done) {
+      pthread_mutex_unlock(&d->lock);
+      report(ctx, 0, NULL, 0);
+      pthread_mutex_lock(&d->lock);
+      while (!cur->done) pthread_cond_wait(&d->cond, &d->lock);
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    inflight -= cur->hi - cur->lo;
+    reportGroup(d, cur, report, ctx, paths);
+  }
+
+  pthread_cond_destroy(&d->cond);
+  pthread_mutex_destroy(&d->lock);
+  free(paths);
+  free(d->groups);
+  free(d->jobs);
+  free(d->files);
+  free(d->paths);
+  d->groups = NULL;
+  d->jobs = NULL;
+  d->files = NULL;
+  d->paths = NULL;
+  d->n = d->cap = d->plen = d->psize = 0;
+
+  if (st) *st = d->st;
+}
+
+
+void dupes_free(struct dupes *d)
+{
+  if (!d) return;
+
+  free(d->files);
+  free(d->paths);
+  free(d);
+}
@@ -0,0 +1,84 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief duplicate file finder (--dupes)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __DUPES_H__
+#define __DUPES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pool.h"
+
+/// @brief set of candidate files. Files are added during the walk (one set per printing thread)
+///        and compared in stages by dupes_find(): files of a size that occurs once are dropped
+///        without reading them, then files are grouped by a hash of their first and last 4 KiB,
+///        and only files that still share a group are read in full.
+struct dupes;
+
+/// @brief statistics of dupes_find()
+struct dupes_stats {
+  unsigned long long files;   ///< number of files added
+  unsigned long long links;   ///< files that are further links of an inode already added
+  unsigned long long sized;   ///< files that share their size with another file
+  unsigned long long partial; ///< files of which the first and last 4 KiB were hashed
+  unsigned long long full;    ///< files that were read in full
+  unsigned long long bytes;   ///< number of bytes read
+  unsigned long long errors;  ///< files that could not be read or changed during the run
+  unsigned long long groups;  ///< number of groups of duplicates
+  unsigned long long dupes;   ///< number of files in these groups beyond the first of each
+  unsigned long long wasted;  ///< size of these files (bytes)
+};
+
+/// @brief report of a group of @a n identical files of @a size bytes each. The paths are sorted;
+///        they are valid during the call only. dupes_find() also calls it with @a n == 0 before it
+///        waits for hashing to complete, so that the caller can flush its output.
+typedef void (*dupes_fn)(void *ctx, unsigned long long size, const char **paths, int n);
+
+/// @brief create an empty set
+///
+/// @retval set
+struct dupes *dupes_create(void);
+
+/// @brief add a regular file whose path is the concatenation of @a dir (@a dlen bytes) and
+///        @a name. Empty files are ignored.
+///
+/// @param d set
+/// @param dev device number
+/// @param ino inode number
+/// @param size size in bytes
+/// @param dir first part of the path
+/// @param dlen length of @a dir
+/// @param name second part of the path (null-terminated)
+void dupes_add(struct dupes *d, uint64_t dev, uint64_t ino, unsigned long long size,
+               const char *dir, size_t dlen, const char *name);
+
+/// @brief move all files of @a src to @a d; @a src is left empty
+///
+/// @param d set
+/// @param src set
+void dupes_merge(struct dupes *d, struct dupes *src);
+
+/// @brief find the groups of identical files in @a d and report each through @a report, largest
+///        files first. The files are read by the tasks of @a pool; the groups are reported by the
+///        calling thread as soon as they are complete. Several links to the same inode count as
+///        one file (the first path in sort order).
+///
+/// @param d set (sorted and emptied)
+/// @param pool thread pool or NULL to read the files in the calling thread
+/// @param report report function
+/// @param ctx context passed to @a report
+/// @param st statistics or NULL
+void dupes_find(struct dupes *d, struct pool *pool, dupes_fn report, void *ctx,
+                struct dupes_stats *st);
+
+/// @brief release set @a d
+///
+/// @param d set or NULL
+void dupes_free(struct dupes *d);
+
+#endif // __DUPES_H__
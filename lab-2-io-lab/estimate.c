@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief totals estimated from a random sample of subtrees (--estimate)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#include <string.h>
+#include <math.h>
+#include "estimate.h"
+
+#define Z95           1.959964 ///< two-sided 95% quantile of the normal distribution
+
+
+void est_init(struct estimator *e, const double *base, unsigned long population, uint64_t seed)
+{
+  memset(e, 0, sizeof(struct estimator));
+  memcpy(e->base, base, sizeof(e->base));
+  e->population = population;
+  e->rng = seed ? seed : 0x9e3779b97f4a7c15ull;
+}
+
+
+unsigned long est_next(struct estimator *e)
+{
+  // xorshift64*; the modulo bias is negligible for populations far below 2^64
+  e->rng ^= e->rng >> 12;
+  e->rng ^= e->rng << 25;
+  e->rng ^= e->rng >> 27;
+
+  return e->n + (unsigned long)((e->rng * 0x2545f4914f6cdd1dull) % (e->population - e->n));
+}
+
+
+void est_sample(struct estimator *e, const double *y)
+{
+  e->n++;
+  for (int m = 0; m < EST_METRICS; m++) {
+    double d = y[m] - e->mean[m];
+    e->mean[m] += d/e->n;
+    e->m2[m] += d*(y[m] - e->mean[m]);
+  }
+}
+
+
+void est_total(const struct estimator *e, int m, double *total, double *err)
+{
+  double N = e->population, n = e->n;
+
+  *total = e->base[m] + (e->n ? N*e->mean[m] : 0);
+  *err = 0;
+
+  // standard error of N*mean: N*sqrt((1 - n/N) s^2/n); unknown with fewer than two samples
+  if (e->n < e->population) {
+    if (e->n < 2) *err = INFINITY;
+    else *err = Z95*N*sqrt((1 - n/N)*(e->m2[m]/(n - 1))/n);
+  }
+}
+
+
+int est_converged(const struct estimator *e, double target)
+{
+  static const int checked[] = { EST_FILES, EST_DIRS, EST_SIZE };
+
+  if (e->n == e->population) return 1;
+  if (e->n < EST_MIN_SAMPLES) return 0;
+
+  for (unsigned int i = 0; i < sizeof(checked)/sizeof(checked[0]); i++) {
+    double total, err;
+    est_total(e, checked[i], &total, &err);
+    if (err > target*total) return 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief totals estimated from a random sample of subtrees (--estimate)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __ESTIMATE_H__
+#define __ESTIMATE_H__
+
+#include <stdint.h>
+
+/// @brief estimated quantities
+#define EST_FILES     0       ///< number of files
+#define EST_DIRS      1       ///< number of directories
+#define EST_LINKS     2       ///< number of symbolic links
+#define EST_SIZE      3       ///< total size
+#define EST_BLOCKS    4       ///< total number of blocks
+#define EST_METRICS   5       ///< number of quantities
+
+#define EST_MIN_SAMPLES 30    ///< samples before a confidence interval is trusted
+
+/// @brief estimator of totals of the form base + sum of y over a population of N units, of which
+///        a simple random sample (without replacement) is measured. The total of each quantity
+///        is estimated as base + N*mean(y); its 95% confidence interval follows from the sample
+///        variance with the finite population correction, and is zero once all units are
+///        measured.
+struct estimator {
+  double base[EST_METRICS];   ///< exactly known part of the totals
+  unsigned long population;   ///< number of units N
+  unsigned long n;            ///< number of units sampled
+  double mean[EST_METRICS];   ///< running mean of y (Welford)
+  double m2[EST_METRICS];     ///< running sum of squared deviations of y
+  uint64_t rng;               ///< state of the random number generator
+};
+
+/// @brief start an estimate of @a population units on top of @a base
+///
+/// @param e estimator
+/// @param base exactly known part of the totals (EST_METRICS values)
+/// @param population number of units
+/// @param seed random seed
+void est_init(struct estimator *e, const double *base, unsigned long population, uint64_t seed);
+
+/// @brief random index of the next unit to sample. Callers keep the units in an array and swap
+///        the returned unit to position e->n, which makes the order a random permutation.
+///
+/// @param e estimator (e->n < e->population)
+/// @retval index in [e->n, e->population)
+unsigned long est_next(struct estimator *e);
+
+/// @brief add the measurement @a y of a sampled unit
+///
+/// @param e estimator
+/// @param y measured quantities (EST_METRICS values)
+void est_sample(struct estimator *e, const double *y);
+
+/// @brief estimated total of quantity @a m and the half width of its 95% confidence interval
+///
+/// @param e estimator
+/// @param m quantity (EST_*)
+/// @param total estimated total
+/// @param err half width of the confidence interval
+void est_total(const struct estimator *e, int m, double *total, double *err);
+
+/// @brief non-zero if all units are measured, or if at least EST_MIN_SAMPLES are and the
+///        confidence intervals of the numbers of files and directories and of the total size are
+///        within @a target times their totals
+///
+/// @param e estimator
+/// @param target relative error (e.g. 0.05)
+int est_converged(const struct estimator *e, double target);
+
+#endif // __ESTIMATE_H__
@@ -0,0 +1,229 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief entry filters (name globs, type, size/mtime/depth ranges, exclude patterns)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include "filter.h"
+
+
+/// @brief append @a glob to pattern list @a *list of @a *n elements
+///
+/// @retval 0 on success
+/// @retval -1 if out of memory (the list is unchanged)
+static int addPattern(const char ***list, int *n, const char *glob)
+{
+  const char **l = realloc(*list, (*n + 1)*sizeof(char*));
+
+  if (!l) return -1;
+  l[(*n)++] = glob;
+  *list = l;
+
+  return 0;
+}
+
+
+/// @brief non-zero if @a name matches one of the @a n patterns in @a list
+static int matchAny(const char **list, int n, const char *name)
+{
+  for (int i = 0; i < n; i++) {
+    if (fnmatch(list[i], name, 0) == 0) return 1;
+  }
+
+  return 0;
+}
+
+
+/// @brief units of a range: suffix characters, the factor of each suffix and the factor of
+///        numbers without a suffix
+struct units {
+  const char *suffix;         ///< suffix characters
+  unsigned long long scale[8];///< factor of each suffix
+  unsigned long long none;    ///< factor of numbers without a suffix
+};
+
+
+/// @brief parse the number at @a s with an optional unit suffix
+///
+/// @param s string
+/// @param end set to the first character after the number and suffix
+/// @param u units
+/// @param v value
+/// @retval 0 on success
+/// @retval -1 if there is no number or it overflows
+static int parseNum(const char *s, const char **end, const struct units *u, unsigned long long *v)
+{
+  unsigned long long k = u->none;
+  const char *p;
+  char *e;
+
+  if ((*s < '0') || (*s > '9')) return -1;
+  errno = 0;
+  *v = strtoull(s, &e, 10);
+  if (errno) return -1;
+
+  if (*e && (p = strchr(u->suffix, *e))) {
+    k = u->scale[p - u->suffix];
+    e++;
+  }
+  if (*v > ULLONG_MAX/k) return -1;
+  *v *= k;
+  *end = e;
+
+  return 0;
+}
+
+
+/// @brief parse range "MIN..MAX"; omitted bounds leave @a min and @a max unchanged
+static int parseRange(const char *range, const struct units *u, unsigned long long *min,
+                      unsigned long long *max)
+{
+  const char *s = range;
+
+  if (strncmp(s, "..", 2) != 0) {
+    if (parseNum(s, &s, u, min) < 0) return -1;
+  }
+  if (strncmp(s, "..", 2) != 0) return -1;
+  s += 2;
+  if (*s && (parseNum(s, &s, u, max) < 0)) return -1;
+
+  return (*s || (*min > *max)) ? -1 : 0;
+}
+
+
+void filter_init(struct filter *f)
+{
+  memset(f, 0, sizeof(struct filter));
+  f->size_max = ULLONG_MAX;
+  f->mtime_min = sizeof(time_t) == 8 ? (time_t)LLONG_MIN : (time_t)INT_MIN;
+  f->mtime_max = sizeof(time_t) == 8 ? (time_t)LLONG_MAX : (time_t)INT_MAX;
+  f->depth_max = UINT_MAX;
+}
+
+
+void filter_free(struct filter *f)
+{
+  free(f->names);
+  free(f->excludes);
+  f->names = f->excludes = NULL;
+  f->nnames = f->nexcludes = 0;
+}
+
+
+int filter_name(struct filter *f, const char *glob)
+{
+  if (addPattern(&f->names, &f->nnames, glob) < 0) return -1;
+  f->active |= FILTER_NAME;
+
+  return 0;
+}
+
+
+int filter_exclude(struct filter *f, const char *glob)
+{
+  if (addPattern(&f->excludes, &f->nexcludes, glob) < 0) return -1;
+  f->active |= FILTER_NAME;
+
+  return 0;
+}
+
+
+int filter_types(struct filter *f, const char *spec)
+{
+  static const char letters[] = "fdlpscb";
+  static const unsigned char types[] = { DT_REG, DT_DIR, DT_LNK, DT_FIFO, DT_SOCK, DT_CHR, DT_BLK };
+  unsigned int mask = 0;
+
+  for (const char *s = spec; *s; s++) {
+    const char *p = strchr(letters, *s);
+    if (*s == ',') continue;
+    if (!p) return -1;
+    mask |= 1u << types[p - letters];
+  }
+  if (!mask) return -1;
+
+  f->types |= mask;
+  f->active |= FILTER_NAME;
+
+  return 0;
+}
+
+
+int filter_size(struct filter *f, const char *range)
+{
+  static const struct units u = { "kMGT", { 1ull<<10, 1ull<<20, 1ull<<30, 1ull<<40 }, 1 };
+  unsigned long long min = 0, max = ULLONG_MAX;
+
+  if (parseRange(range, &u, &min, &max) < 0) return -1;
+
+  f->size_min = min;
+  f->size_max = max;
+  f->active |= FILTER_STAT;
+
+  return 0;
+}
+
+
+int filter_mtime(struct filter *f, const char *range, time_t now)
+{
+  static const struct units u = { "smhdw", { 1, 60, 3600, 86400, 7*86400 }, 86400 };
+  unsigned long long min = 0, max = ULLONG_MAX;
+
+  if (parseRange(range, &u, &min, &max) < 0) return -1;
+
+  // a larger age is an earlier time; ages reaching back beyond the epoch are clamped to it
+  if (min > (unsigned long long)now) min = now;
+  if (max < (unsigned long long)now) f->mtime_min = now - (time_t)max;
+  f->mtime_max = now - (time_t)min;
+  f->active |= FILTER_STAT;
+
+  return 0;
+}
+
+
+int filter_depth(struct filter *f, const char *range)
+{
+  static const struct units u = { "", { 0 }, 1 };
+  unsigned long long min = 0, max = UINT_MAX;
+
+  if ((parseRange(range, &u, &min, &max) < 0) || (max > UINT_MAX)) return -1;
+
+  f->depth_min = (unsigned int)min;
+  f->depth_max = (unsigned int)max;
+  f->active |= FILTER_NAME;
+
+  return 0;
+}
+
+
+int filter_pre(const struct filter *f, const char *name, unsigned char type, unsigned int depth)
+{
+  if ((depth > f->depth_max) || matchAny(f->excludes, f->nexcludes, name)) return FILTER_EXCLUDE;
+
+  if (depth < f->depth_min) return FILTER_NOMATCH;
+  if (f->types && (type != DT_UNKNOWN) && !(f->types & (1u << type))) return FILTER_NOMATCH;
+  if (f->nnames && !matchAny(f->names, f->nnames, name)) return FILTER_NOMATCH;
+
+  return FILTER_MATCH;
+}
+
+
+int filter_post(const struct filter *f, const struct stat *st)
+{
+  if (f->types && !(f->types & (1u << IFTODT(st->st_mode)))) return 0;
+  if (((unsigned long long)st->st_size < f->size_min) || ((unsigned long long)st->st_size > f->size_max)) return 0;
+  if ((st->st_mtime < f->mtime_min) || (st->st_mtime > f->mtime_max)) return 0;
+
+  return 1;
+}
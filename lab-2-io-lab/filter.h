@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief entry filters (name globs, type, size/mtime/depth ranges, exclude patterns)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <time.h>
+#include <sys/stat.h>
+
+/// @brief filter stages in use (filter.active)
+#define FILTER_NAME   0x1     ///< conditions on name, type or depth (checked before stat)
+#define FILTER_STAT   0x2     ///< conditions on size or mtime (need the entry's metadata)
+
+/// @brief result of filter_pre()
+#define FILTER_EXCLUDE 0      ///< entry is excluded: not shown, directories are never opened
+#define FILTER_NOMATCH 1      ///< entry does not match: not shown and not counted, but directories
+                              ///< are still traversed
+#define FILTER_MATCH   2      ///< entry matches (subject to filter_post())
+
+/// @brief a set of conditions that all have to be met. Within one condition, alternatives (several
+///        name patterns or types) are or'ed.
+struct filter {
+  const char **names;         ///< name patterns (fnmatch() globs); an entry must match one
+  int nnames;                 ///< number of name patterns
+  const char **excludes;      ///< exclude patterns; matching entries are excluded
+  int nexcludes;              ///< number of exclude patterns
+  unsigned int types;         ///< accepted file types as a mask of (1 << DT_*), 0 = any type
+  unsigned long long size_min, size_max; ///< size range in bytes (inclusive)
+  time_t mtime_min, mtime_max; ///< modification time range (inclusive)
+  unsigned int depth_min, depth_max;     ///< depth range (inclusive); entries of a root are at
+                                         ///< depth 1
+  unsigned int active;        ///< stages in use (FILTER_NAME, FILTER_STAT)
+};
+
+/// @brief initialize filter @a f to accept every entry
+///
+/// @param f filter
+void filter_init(struct filter *f);
+
+/// @brief release the pattern lists of filter @a f
+///
+/// @param f filter
+void filter_free(struct filter *f);
+
+/// @brief add name pattern @a glob; entries must match one of the name patterns
+///
+/// @param f filter
+/// @param glob shell pattern (fnmatch()) matched against the entry name
+/// @retval 0 on success
+/// @retval -1 if out of memory
+int filter_name(struct filter *f, const char *glob);
+
+/// @brief add exclude pattern @a glob; matching entries (and the subtrees of matching
+///        directories) are skipped
+///
+/// @param f filter
+/// @param glob shell pattern (fnmatch()) matched against the entry name
+/// @retval 0 on success
+/// @retval -1 if out of memory
+int filter_exclude(struct filter *f, const char *glob);
+
+/// @brief accept the file types in @a spec, a list of type letters as in find(1): 'f' (regular
+///        file), 'd' (directory), 'l' (symbolic link), 'p' (pipe), 's' (socket), 'c' (character
+///        device), 'b' (block device). Commas are ignored.
+///
+/// @param f filter
+/// @param spec type letters
+/// @retval 0 on success
+/// @retval -1 if @a spec is invalid
+int filter_types(struct filter *f, const char *spec);
+
+/// @brief set the size range to @a range, "MIN..MAX" where either bound may be omitted. Sizes take
+///        an optional suffix k, M, G or T (powers of 1024).
+///
+/// @param f filter
+/// @param range size range
+/// @retval 0 on success
+/// @retval -1 if @a range is invalid
+int filter_size(struct filter *f, const char *range);
+
+/// @brief set the modification age range to @a range, "MIN..MAX" where either bound may be
+///        omitted. Ages take an optional suffix s, m, h, d or w (default: days) and are relative
+///        to @a now: "..1d" matches entries modified within the last day, "30d.." those that have
+///        not been modified for 30 days.
+///
+/// @param f filter
+/// @param range age range
+/// @param now reference time
+/// @retval 0 on success
+/// @retval -1 if @a range is invalid
+int filter_mtime(struct filter *f, const char *range, time_t now);
+
+/// @brief set the depth range to @a range, "MIN..MAX" where either bound may be omitted. Entries
+///        of a root are at depth 1; directories at the maximum depth are not opened.
+///
+/// @param f filter
+/// @param range depth range
+/// @retval 0 on success
+/// @retval -1 if @a range is invalid
+int filter_depth(struct filter *f, const char *range);
+
+/// @brief check the conditions that need only the name, the type reported by getdents64() and
+///        the depth of an entry. Entries of type DT_UNKNOWN pass the type condition; it is checked
+///        again by filter_post().
+///
+/// @param f filter
+/// @param name entry name
+/// @param type file type (DT_*)
+/// @param depth depth of the entry
+/// @retval FILTER_EXCLUDE, FILTER_NOMATCH or FILTER_MATCH
+int filter_pre(const struct filter *f, const char *name, unsigned char type, unsigned int depth);
+
+/// @brief check the conditions that need the metadata of an entry (type, size, mtime)
+///
+/// @param f filter
+/// @param st metadata of the entry
+/// @retval non-zero if the entry matches
+int filter_post(const struct filter *f, const struct stat *st);
+
+#endif // __FILTER_H__
@@ -0,0 +1,244 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief cache for user and group name lookups
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <grp.h>
+#include "idcache.h"
+#include "util.h"
+
+#define TABLE_INITIAL 64      ///< initial number of slots (power of two)
+
+/// @brief hash table slot
+struct slot {
+  unsigned int id;            ///< user or group id
+  char *name;                 ///< name, NULL if the slot is empty
+};
+
+/// @brief open-addressing (linear probing) hash table mapping ids to names
+struct idtable {
+  struct slot *slots;         ///< slots
+  size_t size;                ///< number of slots (power of two)
+  size_t count;               ///< number of used slots
+  unsigned long hits;         ///< lookups served from the table
+  unsigned long misses;       ///< lookups that had to query NSS
+  unsigned long preloaded;    ///< entries loaded by idcache_preload()
+};
+
+static struct idtable users;  ///< uid -> user name
+static struct idtable groups; ///< gid -> group name
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; ///< protects users and groups
+
+
+/// @brief slot of @a id in table @a t: either the slot holding @a id or the empty slot where it
+///        would be inserted
+static struct slot *find(struct idtable *t, unsigned int id)
+{
+  size_t i = (id * 2654435761u) & (t->size - 1);
+
+  while (t->slots[i].name && (t->slots[i].id != id)) i = (i + 1) & (t->size - 1);
+
+  return &t->slots[i];
+}
+
+
+/// @brief insert @a id -> @a name into table @a t unless @a id is already present
+///
+/// @retval cached name of @a id
+static const char *insert(struct idtable *t, unsigned int id, const char *name)
+{
+  struct slot *s;
+
+  // keep the load factor below 1/2
+  if ((t->count + 1)*2 > t->size) {
+    struct slot *old = t->slots;
+    size_t osize = t->size;
+
+    t->size = osize ? osize*2 : TABLE_INITIAL;
+    t->slots = calloc(t->size, sizeof(struct slot));
+    if (!t->slots) oom();
+    for (size_t i = 0; i < osize; i++) {
+      if (old[i].name) *find(t, old[i].id) = old[i];
+    }
+    free(old);
+  }
+
+  s = find(t, id);
+  if (!s->name) {
+    s->id = id;
+    s->name = strdup(name);
+    if (!s->name) oom();
+    t->count++;
+  }
+
+  return s->name;
+}
+
+
+/// @brief look up @a id in table @a t, resolving misses with @a resolve
+static const char *lookup(struct idtable *t, unsigned int id,
+                          int (*resolve)(unsigned int id, char *buf, size_t len))
+{
+  const char *name = NULL;
+  char buf[64];
+
+  pthread_mutex_lock(&lock);
+  if (t->size > 0) {
+    struct slot *s = find(t, id);
+    if (s->name) {
+      t->hits++;
+      name = s->name;
+    }
+  }
+  pthread_mutex_unlock(&lock);
+  if (name) return name;
+
+  // resolve without holding the lock; NSS lookups can take a long time
+  if (!resolve(id, buf, sizeof(buf))) snprintf(buf, sizeof(buf), "%u", id);
+
+  pthread_mutex_lock(&lock);
+  t->misses++;
+  name = insert(t, id, buf);
+  pthread_mutex_unlock(&lock);
+
+  return name;
+}
+
+
+/// @brief scratch buffer size for getpwuid_r()/getgrgid_r()
+static size_t scratch_size(int name)
+{
+  long size = sysconf(name);
+  return size > 0 ? (size_t)size : 16384;
+}
+
+
+/// @brief resolve the user name of @a uid into @a buf
+///
+/// @retval 1 on success
+/// @retval 0 if there is no such user
+static int resolve_user(unsigned int uid, char *buf, size_t len)
+{
+  size_t size = scratch_size(_SC_GETPW_R_SIZE_MAX);
+  struct passwd pw, *res = NULL;
+  char *scratch;
+
+  for (;;) {
+    scratch = malloc(size);
+    if (!scratch) oom();
+    if (getpwuid_r(uid, &pw, scratch, size, &res) != ERANGE) break;
+    free(scratch);
+    size *= 2;
+  }
+  if (res) snprintf(buf, len, "%s", res->pw_name);
+  free(scratch);
+
+  return res != NULL;
+}
+
+
+/// @brief resolve the group name of @a gid into @a buf
+///
+/// @retval 1 on success
+/// @retval 0 if there is no such group
+static int resolve_group(unsigned int gid, char *buf, size_t len)
+{
+  size_t size = scratch_size(_SC_GETGR_R_SIZE_MAX);
+  struct group gr, *res = NULL;
+  char *scratch;
+
+  for (;;) {
+    scratch = malloc(size);
+    if (!scratch) oom();
+    if (getgrgid_r(gid, &gr, scratch, size, &res) != ERANGE) break;
+    free(scratch);
+    size *= 2;
+  }
+  if (res) snprintf(buf, len, "%s", res->gr_name);
+  free(scratch);
+
+  return res != NULL;
+}
+
+
+const char *idcache_user(uid_t uid)
+{
+  return lookup(&users, uid, resolve_user);
+}
+
+
+const char *idcache_group(gid_t gid)
+{
+  return lookup(&groups, gid, resolve_group);
+}
+
+
+/// @brief load "name:passwd:id:..." lines of file @a fn into table @a t
+///
+/// @retval number of ids loaded
+static int preload_file(struct idtable *t, const char *fn)
+{
+  FILE *f = fopen(fn, "r");
+  char *line = NULL;
+  size_t len = 0;
+  int n = 0;
+
+  if (!f) return 0;
+
+  while (getline(&line, &len, f) != -1) {
+    char *name = line, *id, *end;
+    char *sep = strchr(line, ':');
+    if (!sep) continue;
+    *sep = '\0';
+    sep = strchr(sep+1, ':');
+    if (!sep) continue;
+    id = sep+1;
+
+    unsigned long v = strtoul(id, &end, 10);
+    if ((end == id) || (*end != ':') || (name[0] == '\0')) continue;
+
+    pthread_mutex_lock(&lock);
+    // the first entry for an id wins, as with getpwuid()/getgrgid()
+    size_t before = t->count;
+    insert(t, (unsigned int)v, name);
+    if (t->count > before) {
+      t->preloaded++;
+      n++;
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  free(line);
+  fclose(f);
+
+  return n;
+}
+
+
+int idcache_preload(void)
+{
+  return preload_file(&users, "/etc/passwd") + preload_file(&groups, "/etc/group");
+}
+
+
+void idcache_stats(FILE *f)
+{
+  pthread_mutex_lock(&lock);
+  fprintf(f, "  user name cache:    %10lu hits %10lu misses %8lu preloaded %8lu entries\n",
+          users.hits, users.misses, users.preloaded, (unsigned long)users.count);
+  fprintf(f, "  group name cache:   %10lu hits %10lu misses %8lu preloaded %8lu entries\n",
+          groups.hits, groups.misses, groups.preloaded, (unsigned long)groups.count);
+  pthread_mutex_unlock(&lock);
+}
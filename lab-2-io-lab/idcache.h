@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief cache for user and group name lookups
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __IDCACHE_H__
+#define __IDCACHE_H__
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/// @brief name of user @a uid. The first lookup of an id goes through getpwuid_r() (and thus
+///        NSS); all further lookups are served from an open-addressing hash table. Ids without a
+///        user name are cached as their decimal representation.
+///
+/// @param uid user id
+/// @retval user name (valid until the end of the program)
+const char *idcache_user(uid_t uid);
+
+/// @brief name of group @a gid. See idcache_user().
+///
+/// @param gid group id
+/// @retval group name (valid until the end of the program)
+const char *idcache_group(gid_t gid);
+
+/// @brief fill the cache from /etc/passwd and /etc/group. Ids that are not found there are still
+///        resolved through NSS on their first lookup.
+///
+/// @retval number of ids loaded
+int idcache_preload(void);
+
+/// @brief print hit/miss statistics of the cache to @a f
+///
+/// @param f output stream
+void idcache_stats(FILE *f);
+
+#endif // __IDCACHE_H__
@@ -0,0 +1,397 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief set of (device, inode) pairs with bounded memory (--dedup-links)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "spill.h"
+#include "inoset.h"
+#include "util.h"
+
+#define NSHARDS       64      ///< number of shards (power of two)
+#define SHARD_BITS    6       ///< log2(NSHARDS)
+#define MIN_SLOTS     1024    ///< initial number of slots of a shard's table
+#define MAX_RUNS      4       ///< runs of a shard before they are merged into one
+#define MERGE_BUF     1024    ///< keys buffered while merging runs (16 KiB)
+
+/// @brief a key; ino == 0 marks an empty slot (inode 0 does not exist)
+struct key {
+  uint64_t dev;               ///< device number
+  uint64_t ino;               ///< inode number
+};
+
+/// @brief sorted keys in a mapped temporary file
+struct run {
+  const struct key *keys;     ///< mapped keys, sorted by (dev, ino)
+  size_t n;                   ///< number of keys
+  int fd;                     ///< temporary file
+};
+
+/// @brief one shard of the set
+struct shard {
+  pthread_mutex_t lock;       ///< protects this shard
+  struct key *tab;            ///< open-addressing table (linear probing)
+  size_t cap;                 ///< number of slots (power of two)
+  size_t n;                   ///< number of keys in tab
+  int unplaced;               ///< a failed spill left the keys of tab sorted at its start instead
+                              ///< of at their slots; the table must be rebuilt before it is used
+  struct run runs[MAX_RUNS];  ///< runs on disk
+  int nruns;                  ///< number of runs
+  unsigned long long lookups; ///< statistics, see struct inoset_stats
+  unsigned long long found;
+  unsigned long long spilled;
+  unsigned long spills, merges;
+  unsigned long long spill_ns;
+};
+
+struct inoset {
+  size_t maxslots;            ///< maximum number of slots of a shard's table
+  int nodisk;                 ///< runs cannot be written: tables grow beyond the budget (atomic)
+  struct shard shard[NSHARDS];///< shards
+};
+
+
+/// @brief hash of a key (the upper SHARD_BITS bits select the shard)
+static uint64_t hash(uint64_t dev, uint64_t ino)
+{
+  uint64_t h = ino ^ (dev * 0x9e3779b97f4a7c15ull);
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+
+  return h;
+}
+
+
+/// @brief order of keys in runs
+static int compareKeys(const void *a, const void *b)
+{
+  const struct key *x = (const struct key*)a, *y = (const struct key*)b;
+
+  if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+  if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+
+  return 0;
+}
+
+
+/// @brief non-zero if @a k is in run @a r (binary search)
+static int inRun(const struct run *r, const struct key *k)
+{
+  size_t lo = 0, hi = r->n;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo)/2;
+    int c = compareKeys(&r->keys[mid], k);
+    if (c == 0) return 1;
+    if (c < 0) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return 0;
+}
+
+
+/// @brief write the @a len bytes at @a p to @a fd
+///
+/// @retval 0 on success
+/// @retval -1 on error (errno is set)
+static int writeAll(int fd, const void *p, size_t len)
+{
+  size_t done = 0;
+
+  while (done < len) {
+    ssize_t res = write(fd, (const char *)p + done, len - done);
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    done += res;
+  }
+
+  return 0;
+}
+
+
+/// @brief map the @a n keys written to temporary file @a fd as run @a r. @a fd is closed on error.
+///
+/// @retval 0 on success
+/// @retval -1 on error (errno is set)
+static int mapRun(struct run *r, int fd, size_t n)
+{
+  size_t len = n*sizeof(struct key);
+
+  r->keys = len ? mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0) : NULL;
+  if (r->keys == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  if (len) madvise((void *)r->keys, len, MADV_RANDOM);
+  r->n = n;
+  r->fd = fd;
+
+  return 0;
+}
+
+
+/// @brief unmap and close run @a r
+static void freeRun(struct run *r)
+{
+  if (r->n) munmap((void *)r->keys, r->n*sizeof(struct key));
+  close(r->fd);
+  r->keys = NULL;
+  r->n = 0;
+  r->fd = -1;
+}
+
+
+/// @brief merge all runs of shard @a sh into one. The merged keys are written to the new run
+///        through a buffer of MERGE_BUF keys.
+///
+/// @retval 0 on success
+/// @retval -1 on error (the runs are left unchanged)
+static int mergeRuns(struct shard *sh)
+{
+  struct key buf[MERGE_BUF];
+  size_t n = 0, len = 0, pos[MAX_RUNS] = { 0 };
+  struct run r;
+  int fd = spill_tmpfile();
+
+  if (fd < 0) return -1;
+
+  // the runs are disjoint: a plain k-way merge yields the sorted union
+  for (;;) {
+    int m = -1;
+    for (int i = 0; i < sh->nruns; i++) {
+      if ((pos[i] < sh->runs[i].n) &&
+          ((m < 0) || (compareKeys(&sh->runs[i].keys[pos[i]], &sh->runs[m].keys[pos[m]]) < 0))) m = i;
+    }
+    if ((len == MERGE_BUF) || ((m < 0) && len)) {
+      if (writeAll(fd, buf, len*sizeof(struct key)) < 0) {
+        close(fd);
+        return -1;
+      }
+      len = 0;
+    }
+    if (m < 0) break;
+    buf[len++] = sh->runs[m].keys[pos[m]++];
+    n++;
+  }
+
+  if (mapRun(&r, fd, n) < 0) return -1;
+
+  for (int i = 0; i < sh->nruns; i++) freeRun(&sh->runs[i]);
+  sh->runs[0] = r;
+  sh->nruns = 1;
+  sh->merges++;
+
+  return 0;
+}
+
+
+/// @brief write the table of shard @a sh as a sorted run and empty the table. The keys are sorted
+///        in place at the start of the table.
+///
+/// @retval 0 on success
+/// @retval -1 on error (the keys are left in the table, but not at their slots: the table must be
+///         rebuilt with growShard(), see shard.unplaced)
+static int spillShard(struct shard *sh)
+{
+  size_t n = 0;
+  int fd;
+
+  if ((sh->nruns == MAX_RUNS) && (mergeRuns(sh) < 0)) return -1;
+
+  fd = spill_tmpfile();
+  if (fd < 0) return -1;
+
+  for (size_t i = 0; i < sh->cap; i++) {
+    if (sh->tab[i].ino) {
+      struct key k = sh->tab[i];
+      sh->tab[i].ino = 0;
+      sh->tab[n++] = k;
+    }
+  }
+  qsort(sh->tab, n, sizeof(struct key), compareKeys);
+
+  if (writeAll(fd, sh->tab, n*sizeof(struct key)) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (mapRun(&sh->runs[sh->nruns], fd, n) < 0) return -1;
+
+  sh->nruns++;
+  sh->spilled += n;
+  sh->spills++;
+  memset(sh->tab, 0, n*sizeof(struct key));
+  sh->n = 0;
+
+  return 0;
+}
+
+
+/// @brief double the table of shard @a sh (or rebuild it at twice the size if its keys are not at
+///        their slots)
+///
+/// @retval 0 on success
+/// @retval -1 if out of memory (the table is unchanged)
+static int growShard(struct shard *sh)
+{
+  size_t ncap = sh->cap*2;
+  struct key *ntab = calloc(ncap, sizeof(struct key));
+  if (!ntab) return -1;
+
+  for (size_t i = 0; i < sh->cap; i++) {
+    if (sh->tab[i].ino) {
+      size_t j = hash(sh->tab[i].dev, sh->tab[i].ino) & (ncap - 1);
+      while (ntab[j].ino) j = (j + 1) & (ncap - 1);
+      ntab[j] = sh->tab[i];
+    }
+  }
+
+  free(sh->tab);
+  sh->tab = ntab;
+  sh->cap = ncap;
+  sh->unplaced = 0;
+
+  return 0;
+}
+
+
+struct inoset *inoset_create(size_t maxmem)
+{
+  struct inoset *s = calloc(1, sizeof(struct inoset));
+  if (!s) return NULL;
+
+  s->maxslots = MIN_SLOTS;
+  while (s->maxslots*2*sizeof(struct key)*NSHARDS <= maxmem) s->maxslots *= 2;
+
+  for (int i = 0; i < NSHARDS; i++) {
+    struct shard *sh = &s->shard[i];
+    pthread_mutex_init(&sh->lock, NULL);
+    sh->cap = MIN_SLOTS;
+    sh->tab = calloc(sh->cap, sizeof(struct key));
+  }
+  for (int i = 0; i < NSHARDS; i++) {
+    if (!s->shard[i].tab) {
+      inoset_free(s);
+      return NULL;
+    }
+  }
+
+  return s;
+}
+
+
+int inoset_insert(struct inoset *s, uint64_t dev, uint64_t ino)
+{
+  uint64_t h = hash(dev, ino);
+  struct shard *sh = &s->shard[h >> (64 - SHARD_BITS)];
+  struct key k = { dev, ino };
+  size_t i;
+
+  if (ino == 0) return 1;
+
+  pthread_mutex_lock(&sh->lock);
+  sh->lookups++;
+
+  if (sh->unplaced && (growShard(sh) < 0)) goto nomem;
+
+  for (i = h & (sh->cap - 1); sh->tab[i].ino; i = (i + 1) & (sh->cap - 1)) {
+    if ((sh->tab[i].ino == ino) && (sh->tab[i].dev == dev)) goto found;
+  }
+  for (int r = 0; r < sh->nruns; r++) {
+    if (inRun(&sh->runs[r], &k)) goto found;
+  }
+
+  // keep the load factor at most 1/2: grow the table up to the budget, then spill it. If the
+  // spill fails, growing the table also puts its keys back at their slots. A table that cannot
+  // grow takes keys as long as it has a free slot.
+  if (2*(sh->n + 1) > sh->cap) {
+    int res = 0;
+
+    if ((sh->cap < s->maxslots) || __atomic_load_n(&s->nodisk, __ATOMIC_RELAXED)) res = growShard(sh);
+    else {
+      unsigned long long t0 = nsec();
+      if (spillShard(sh) < 0) {
+        if (!__atomic_exchange_n(&s->nodisk, 1, __ATOMIC_RELAXED)) {
+          perror("Cannot write inode set run; exceeding the memory budget");
+        }
+        sh->unplaced = 1;
+        res = growShard(sh);
+      }
+      sh->spill_ns += nsec() - t0;
+    }
+    if ((res < 0) && (sh->unplaced || (sh->n + 2 > sh->cap))) goto nomem;
+    if (res == 0) {
+      for (i = h & (sh->cap - 1); sh->tab[i].ino; i = (i + 1) & (sh->cap - 1));
+    }
+  }
+
+  sh->tab[i] = k;
+  sh->n++;
+
+  pthread_mutex_unlock(&sh->lock);
+  return 1;
+
+found:
+  sh->found++;
+  pthread_mutex_unlock(&sh->lock);
+  return 0;
+
+nomem:
+  pthread_mutex_unlock(&sh->lock);
+  errno = ENOMEM;
+  return -1;
+}
+
+
+void inoset_stats(struct inoset *s, struct inoset_stats *st)
+{
+  memset(st, 0, sizeof(struct inoset_stats));
+
+  for (int i = 0; i < NSHARDS; i++) {
+    struct shard *sh = &s->shard[i];
+
+    pthread_mutex_lock(&sh->lock);
+    st->lookups += sh->lookups;
+    st->found += sh->found;
+    st->keys += sh->n + sh->spilled;
+    st->mem += sh->cap*sizeof(struct key);
+    for (int r = 0; r < sh->nruns; r++) st->disk += sh->runs[r].n*sizeof(struct key);
+    st->spills += sh->spills;
+    st->merges += sh->merges;
+    st->runs += sh->nruns;
+    st->spill_ns += sh->spill_ns;
+    pthread_mutex_unlock(&sh->lock);
+  }
+}
+
+
+void inoset_free(struct inoset *s)
+{
+  if (!s) return;
+
+  for (int i = 0; i < NSHARDS; i++) {
+    struct shard *sh = &s->shard[i];
+    for (int r = 0; r < sh->nruns; r++) freeRun(&sh->runs[r]);
+    free(sh->tab);
+    pthread_mutex_destroy(&sh->lock);
+  }
+  free(s);
+}
@@ -0,0 +1,65 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief set of (device, inode) pairs with bounded memory (--dedup-links)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __INOSET_H__
+#define __INOSET_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief set of (device, inode) pairs. The set is split into shards by hash, each with its own
+///        lock and open-addressing table, so that it can be used from several threads. A shard
+///        whose table reaches its share of the memory budget writes its keys as a sorted run to
+///        a temporary file and starts over; lookups then also binary-search the (mapped) runs of
+///        the shard. Runs are merged when a shard has too many of them. Tables are sorted in
+///        place and merges go through a small fixed buffer, so only the tables take memory.
+struct inoset;
+
+/// @brief statistics of a set
+struct inoset_stats {
+  unsigned long long lookups; ///< number of calls to inoset_insert()
+  unsigned long long found;   ///< number of keys that were already in the set
+  unsigned long long keys;    ///< number of keys in the set
+  size_t mem;                 ///< memory used by the tables (bytes)
+  unsigned long long disk;    ///< size of the runs on disk (bytes)
+  unsigned long spills;       ///< number of tables written to runs
+  unsigned long merges;       ///< number of run merges
+  unsigned int runs;          ///< number of runs on disk
+  unsigned long long spill_ns;///< time spent writing and merging runs (ns)
+};
+
+/// @brief create a set whose tables use at most @a maxmem bytes
+///
+/// @param maxmem memory budget in bytes
+/// @retval set
+/// @retval NULL if out of memory
+struct inoset *inoset_create(size_t maxmem);
+
+/// @brief add (@a dev, @a ino) to set @a s (thread-safe)
+///
+/// @param s set
+/// @param dev device number
+/// @param ino inode number
+/// @retval 1 if the pair was not in the set before
+/// @retval 0 if it was
+/// @retval -1 if out of memory (errno is set); the pair is not added
+int inoset_insert(struct inoset *s, uint64_t dev, uint64_t ino);
+
+/// @brief get the statistics of set @a s
+///
+/// @param s set
+/// @param st statistics
+void inoset_stats(struct inoset *s, struct inoset_stats *st);
+
+/// @brief release set @a s and its runs
+///
+/// @param s set or NULL
+void inoset_free(struct inoset *s);
+
+#endif // __INOSET_H__
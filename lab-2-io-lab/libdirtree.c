@@ -0,0 +1,1438 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief directory tree traversal with a visitor interface (libdirtree)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include "arena.h"
+#include "filter.h"
+#include "inoset.h"
+#include "libdirtree.h"
+#include "pool.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "sort.h"
+#include "spill.h"
+#include "uring.h"
+#include "util.h"
+
+#define DENTS_BUFSIZE 32768   ///< size of the getdents64() buffer (per thread)
+#define URING_ENTRIES 256     ///< number of statx requests in flight per io_uring batch
+#define READAHEAD     16      ///< default number of directories read ahead per pool worker
+#define ENT_LINKED    0x40    ///< entry flag (internal): matching non-directory with several links,
+                              ///< deduplicated when the walk visits it
+
+/// @brief directory entry as returned by the getdents64() system call
+struct linux_dirent64 {
+  ino64_t d_ino;              ///< inode number
+  off64_t d_off;              ///< offset to next entry
+  unsigned short d_reclen;    ///< size of this record
+  unsigned char d_type;       ///< file type (DT_*)
+  char d_name[];              ///< null-terminated file name
+};
+
+/// @brief directory stream reading entries in bulk into a caller-provided buffer
+struct dirstream {
+  int fd;                     ///< open directory file descriptor
+  char *buf;                  ///< getdents64() buffer
+  size_t size;                ///< size of buf
+  long len;                   ///< number of valid bytes in buf
+  long pos;                   ///< offset of the next entry in buf
+  int err;                    ///< errno if getdents64() failed, 0 otherwise
+};
+
+/// @brief compact directory entry record
+struct entry {
+  ino64_t ino;                ///< inode number
+  unsigned int name;          ///< offset of the name in the listing's name buffer
+  unsigned short len;         ///< length of the name
+  unsigned char type;         ///< file type (DT_*)
+  unsigned char flags;        ///< DTF_MATCH, DTF_DUPLINK, ENT_LINKED
+};
+
+/// @brief memory backing one directory listing. Recycled through a free list: in sequential mode
+///        at most one dirmem per tree level is in use, so every level keeps reusing the arenas of
+///        its previous directory.
+struct dirmem {
+  struct arena ents;          ///< entry records and per-entry arrays
+  struct arena names;         ///< entry names
+  struct dirmem *next;        ///< next dirmem in the free list
+};
+
+/// @brief contents of one directory
+struct listing {
+  int err;                    ///< errno if the directory could not be read, 0 otherwise (ENOMEM
+                              ///< also ends the walk)
+  int len;                    ///< number of entries
+  struct entry *ents;         ///< entries in directory order
+  char *names;                ///< name buffer holding the null-terminated entry names
+  struct stat *info;          ///< metadata of each entry (NULL if the run only needs types)
+  int *order;                 ///< indices into ents/info in display order (directories first,
+                              ///< then by name)
+  struct dirmem *mem;         ///< memory backing this listing
+  struct stat st;             ///< metadata of the directory itself (dirstat or snapshot only)
+  struct spill *spill;        ///< spilled directory: sorted runs of the entries (ents, names,
+                              ///< info and order are unused), NULL otherwise
+  int leaf;                   ///< subdirectories are not traversed (maximum depth of the filter)
+};
+
+/// @brief reference-counted directory file descriptor. A directory stays open as long as it is
+///        being scanned or one of its subdirectories still has to be opened relative to it.
+struct fdref {
+  int fd;                     ///< open directory file descriptor
+  int refs;                   ///< number of references (atomic)
+};
+
+/// @brief a directory to be scanned (and later visited)
+///
+/// With a pool, each directory is a task that is scanned by a worker thread: the worker reads,
+/// sorts and stats the entries and then submits one task per subdirectory. The walking thread
+/// visits the tasks in tree order as they complete (ordered reassembly). The number of tasks
+/// submitted but not yet visited is bounded by the window of the walk; subdirectories that do
+/// not fit are submitted by the walking thread later, nearest first, or scanned by it when it
+/// reaches them. Without a pool, tasks are scanned on demand by the walking thread itself.
+struct dirtask {
+  const char *name;           ///< root path or name of the directory relative to parent
+  struct fdref *parent;       ///< parent directory (NULL for a root) until this one is opened
+  struct fdref dir;           ///< this directory
+  struct listing l;           ///< contents of the directory (valid once scanned)
+  struct dirtask **sub;       ///< parallel mode: task of each subdirectory entry, NULL otherwise
+  struct walk *w;             ///< walk this directory belongs to
+  struct pool *pool;          ///< thread pool or NULL if the walking thread scans the directory
+  unsigned int depth;         ///< depth of the directory (0 for a root)
+  int done;                   ///< parallel mode: set once the task has been scanned
+  int claimed;                ///< parallel mode: the task has been submitted or is being scanned
+                              ///< by the walking thread (atomic)
+  int cancel;                 ///< parallel mode: the directory was pruned and need not be read
+                              ///< (atomic)
+};
+
+/// @brief walker stack frame: a directory being visited and the position of its next entry
+struct frame {
+  struct dirtask *t;          ///< directory task
+  struct dirtask local;       ///< storage of t for directories scanned by the walking thread
+  struct dt_dir d;            ///< the directory as passed to the visitor
+  int next;                   ///< display index of the next entry, -1 before the directory is entered
+  int skip;                   ///< the entries are not visited (pruned); subdirectories that have
+                              ///< been read ahead are still waited for and released
+  int quiet;                  ///< the directory itself is not visited (pruned or stopped)
+  int ahead;                  ///< display index of the next subdirectory to read ahead
+  struct frame *pending;      ///< next frame down the stack with subdirectories to read ahead
+  struct dt_summary sum;      ///< totals of the subtree visited so far
+  struct frame *up;           ///< parent directory's frame
+};
+
+/// @brief a traversal configuration
+struct dirtree {
+  struct dt_options opt;      ///< options
+  const struct filter *filter;///< entry filter (nofilter if none is given)
+  struct filter nofilter;     ///< filter accepting every entry
+  int stat;                   ///< stat every entry
+  int nslots;                 ///< number of io_uring slots: one per pool worker, followed by one
+                              ///< per concurrent walk
+  struct uring **rings;       ///< io_uring of each slot (or NULL if unavailable)
+  int *busy;                  ///< walk slots in use (protected by lock)
+  pthread_mutex_t lock;       ///< protects busy and free_mem
+  struct dirmem *free_mem;    ///< free list of listing memory
+  pthread_mutex_t task_lock;  ///< protects dirtask.done
+  pthread_cond_t task_done;   ///< signalled when a task completes
+  unsigned long long t_lookup;///< time spent in metadata lookups (ns, atomic)
+  unsigned long long t_order; ///< time spent ordering lookups by inode (ns, atomic)
+  unsigned long long n_lookup;///< number of metadata lookups (atomic)
+  unsigned long long t_links; ///< time spent in link deduplication (ns, atomic)
+  unsigned long long link_bytes; ///< size of the links not counted (atomic)
+  unsigned long snap_reused;  ///< number of directories taken from the snapshot (atomic)
+  unsigned long spill_dirs;   ///< number of spilled directories (atomic)
+  unsigned long spill_runs;   ///< number of runs of all spilled directories (atomic)
+};
+
+/// @brief state of one dt_walk() call
+struct walk {
+  struct dirtree *dt;         ///< configuration
+  const struct dt_visitor *v; ///< visitor
+  void *ctx;                  ///< visitor context
+  int slot;                   ///< io_uring slot of the walking thread (-1: none)
+  int stop;                   ///< the walk is ending: pending tasks are not read (atomic)
+  int err;                    ///< errno of the error that ended the walk, 0 if none (atomic)
+  char *path;                 ///< path of the directory being visited, with a trailing '/'
+  size_t psize;               ///< allocated size of path
+  struct frame *free_frames;  ///< free list of frames
+  int ahead;                  ///< tasks submitted to the pool and not yet visited (atomic)
+  int window;                 ///< maximum number of tasks read ahead
+  struct frame *pending;      ///< topmost frame with subdirectories that have not been submitted
+};
+
+
+/// @brief read next directory entry from open directory stream @a ds. Ignores '.' and '..'
+///        entries. Entries are fetched in bulk with getdents64() into the stream's buffer.
+///
+/// @param ds open directory stream
+/// @retval entry on success
+/// @retval NULL on error (ds->err is set) or if there are no more entries
+static struct linux_dirent64 *getNext(struct dirstream *ds)
+{
+  struct linux_dirent64 *next;
+  int ignore;
+
+  do {
+    if (ds->pos >= ds->len) {
+      ds->len = syscall(SYS_getdents64, ds->fd, ds->buf, ds->size);
+      ds->pos = 0;
+      if (ds->len < 0) ds->err = errno;
+      if (ds->len <= 0) return NULL;
+    }
+    next = (struct linux_dirent64*)(ds->buf + ds->pos);
+    ds->pos += next->d_reclen;
+    ignore = (strcmp(next->d_name, ".") == 0) || (strcmp(next->d_name, "..") == 0);
+  } while (ignore);
+
+  return next;
+}
+
+
+/// @brief sort_keys() callback returning the name of entry @a idx. Entries are sorted by name,
+///        directories first.
+///
+/// @param listing struct listing* the indices refer to
+/// @param idx index of the entry
+/// @retval name of the entry
+static const char *entryName(void *listing, uint32_t idx)
+{
+  const struct listing *l = (const struct listing*)listing;
+
+  return l->names + l->ents[idx].name;
+}
+
+
+/// @brief get memory for a new listing from the free list of @a dt
+///
+/// @retval listing memory
+/// @retval NULL if out of memory
+static struct dirmem *getMem(struct dirtree *dt)
+{
+  struct dirmem *m;
+
+  pthread_mutex_lock(&dt->lock);
+  m = dt->free_mem;
+  if (m) dt->free_mem = m->next;
+  pthread_mutex_unlock(&dt->lock);
+
+  if (!m) {
+    m = malloc(sizeof(struct dirmem));
+    if (!m) return NULL;
+    arena_init(&m->ents);
+    arena_init(&m->names);
+  }
+
+  return m;
+}
+
+
+/// @brief return listing memory @a m to the free list of @a dt
+static void putMem(struct dirtree *dt, struct dirmem *m)
+{
+  arena_reset(&m->ents);
+  arena_reset(&m->names);
+
+  pthread_mutex_lock(&dt->lock);
+  m->next = dt->free_mem;
+  dt->free_mem = m;
+  pthread_mutex_unlock(&dt->lock);
+}
+
+
+/// @brief acquire an additional reference to @a r
+static void fdRetain(struct fdref *r)
+{
+  __atomic_add_fetch(&r->refs, 1, __ATOMIC_SEQ_CST);
+}
+
+
+/// @brief drop a reference to @a r; closes the directory when the last reference is gone
+static void fdRelease(struct fdref *r)
+{
+  if (r && (__atomic_sub_fetch(&r->refs, 1, __ATOMIC_SEQ_CST) == 0)) {
+    close(r->fd);
+    r->fd = -1;
+  }
+}
+
+
+/// @brief initialize a directory task. Takes over a reference to @a parent.
+///
+/// @param t task to initialize
+/// @param parent parent directory or NULL for a root
+/// @param name root path or name of the directory relative to @a parent
+/// @param depth depth of the directory (0 for a root)
+/// @param w walk
+/// @param pool thread pool or NULL
+static void initTask(struct dirtask *t, struct fdref *parent, const char *name, unsigned int depth,
+                     struct walk *w, struct pool *pool)
+{
+  memset(t, 0, sizeof(struct dirtask));
+  t->name = name;
+  t->parent = parent;
+  t->depth = depth;
+  t->dir.fd = -1;
+  t->w = w;
+  t->pool = pool;
+}
+
+
+/// @brief release the listing of a task. Subdirectory tasks allocated from the listing become
+///        invalid.
+static void releaseTask(struct dirtask *t)
+{
+  if (t->l.mem) putMem(t->w->dt, t->l.mem);
+  t->l.mem = NULL;
+  spill_free(t->l.spill);
+  t->l.spill = NULL;
+}
+
+
+/// @brief collect the metadata of all entries of listing @a l relative to the open directory @a fd.
+///        Entries are only stat'ed if the walk needs their metadata or if the file system did not
+///        report the type (DT_UNKNOWN); for type-only walks on file systems with d_type the inodes
+///        are never touched. With io_uring, the stat requests of the directory are submitted as
+///        batches; if io_uring is unavailable or fails, every entry is stat'ed with a synchronous
+///        fstatat(). Resolves DT_UNKNOWN entries.
+///
+///        The lookups are issued in inode number order (d_ino) rather than in directory order:
+///        on file systems with inode tables (ext4, XFS), this reads the tables sequentially
+///        instead of seeking back and forth. The listing is sorted into display order later.
+///
+/// @param dt configuration
+/// @param slot io_uring slot of the calling thread (-1: none)
+/// @param fd open directory
+/// @param l listing whose info[] array is filled in
+/// @retval 0 on success
+/// @retval -1 if out of memory (errno is set)
+static int statEntries(struct dirtree *dt, int slot, int fd, struct listing *l)
+{
+  struct arena *a = &l->mem->ents;
+  int *idx, n = 0, done = 0, ordered = 0;
+  unsigned long long t0 = 0, t1 = 0;
+  const char **names;
+  struct stat *st;
+
+  idx = (int *)arena_alloc(a, l->len*sizeof(int));
+  if (!idx) goto nomem;
+  for (int i = 0; i < l->len; i++) {
+    if (l->info || (l->ents[i].type == DT_UNKNOWN)) idx[n++] = i;
+  }
+  if (n == 0) return 0;
+
+  prof_enter(dt->opt.profile, PROF_STAT);
+  prof_count(dt->opt.profile, PROF_STAT, n);
+  if (dt->opt.timing) t0 = nsec();
+
+  // issue the lookups in inode order
+  if (!dt->opt.dir_order && (n > 1)) {
+    struct sortkey *keys = (struct sortkey *)arena_alloc(a, 2*n*sizeof(struct sortkey));
+    if (!keys) goto nomem_prof;
+    for (int k = 0; k < n; k++) {
+      keys[k].key = l->ents[idx[k]].ino;
+      keys[k].idx = idx[k];
+    }
+    sort_by_key(keys, keys + n, n);
+    for (int k = 0; k < n; k++) {
+      ordered |= (idx[k] != (int)keys[k].idx);
+      idx[k] = keys[k].idx;
+    }
+  }
+
+  if (dt->opt.timing) t1 = nsec();
+
+  // if idx is the identity (full metadata in directory order), the results go to info[] directly
+  st = l->info && !ordered ? l->info : (struct stat *)arena_calloc(a, n*sizeof(struct stat));
+  names = (const char **)arena_alloc(a, n*sizeof(char*));
+  if (!st || !names) goto nomem_prof;
+  for (int k = 0; k < n; k++) names[k] = l->names + l->ents[idx[k]].name;
+
+  if (dt->rings && (slot >= 0) && (slot < dt->nslots) && dt->rings[slot] && (n > 1)) {
+    int *err = (int *)arena_alloc(a, n*sizeof(int));
+
+    if (!err) goto nomem_prof;
+    if (uring_stat(dt->rings[slot], fd, names, n, st, err) == 0) {
+      done = 1;
+    } else {
+      // the ring is unusable: fall back to synchronous stat for this slot from now on
+      uring_destroy(dt->rings[slot]);
+      dt->rings[slot] = NULL;
+    }
+  }
+
+  if (!done) {
+    for (int k = 0; k < n; k++) fstatat(fd, names[k], &st[k], AT_SYMLINK_NOFOLLOW);
+  }
+
+  if (dt->opt.timing) {
+    unsigned long long t2 = nsec();
+    __atomic_add_fetch(&dt->t_order, t1 - t0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dt->t_lookup, t2 - t1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&dt->n_lookup, n, __ATOMIC_RELAXED);
+  }
+
+  if (st != l->info && l->info) {
+    for (int k = 0; k < n; k++) l->info[idx[k]] = st[k];
+  }
+
+  // entries without d_type are sorted and descended into based on the stat result
+  for (int k = 0; k < n; k++) {
+    struct entry *e = &l->ents[idx[k]];
+    if ((e->type == DT_UNKNOWN) && (st[k].st_mode != 0)) e->type = IFTODT(st[k].st_mode);
+  }
+  prof_leave(dt->opt.profile);
+
+  return 0;
+
+nomem_prof:
+  prof_leave(dt->opt.profile);
+nomem:
+  errno = ENOMEM;
+  return -1;
+}
+
+
+/// @brief take the entries of directory @a l->st from the snapshot of a previous run. Only
+///        directories whose mtime and ctime have not changed are taken; since any change to the
+///        entries of a directory updates its mtime, the stored entry list is still accurate. The
+///        entries are stored in display order.
+///
+/// @param dt configuration
+/// @param l listing to fill in
+/// @retval 1 if the entries were taken from the snapshot
+/// @retval 0 if the directory has to be read
+/// @retval -1 if out of memory (errno is set)
+static int reuseDir(struct dirtree *dt, struct listing *l)
+{
+  const struct snapshot *snap = dt->opt.snap;
+  const struct snapdir *d = snap_find(snap, &l->st);
+  const struct snapent *se = d ? snap_entries(snap, d) : NULL;
+  size_t nlen = 0;
+
+  if (!se || (dt->opt.spill && (d->count > dt->opt.spill))) return 0;
+  for (uint32_t i = 0; i < d->count; i++) {
+    if (!snap_name(snap, &se[i])) return 0;
+    nlen += se[i].len + 1;
+  }
+
+  l->ents = (struct entry *)arena_alloc(&l->mem->ents, d->count*sizeof(struct entry));
+  l->names = (char *)arena_alloc(&l->mem->names, nlen);
+  if (!l->ents || !l->names) {
+    errno = ENOMEM;
+    return -1;
+  }
+  nlen = 0;
+  for (uint32_t i = 0; i < d->count; i++) {
+    struct entry *e = &l->ents[i];
+    e->ino = se[i].ino;
+    e->name = nlen;
+    e->len = se[i].len;
+    e->type = se[i].type;
+    e->flags = DTF_MATCH;
+    memcpy(l->names + nlen, snap_name(snap, &se[i]), e->len+1);
+    nlen += e->len+1;
+  }
+  l->len = d->count;
+  __atomic_add_fetch(&dt->snap_reused, 1, __ATOMIC_RELAXED);
+
+  return 1;
+}
+
+
+/// @brief read the entries of directory stream @a ds into listing @a l
+///
+/// @param ds open directory stream
+/// @param l listing to append to
+/// @param cap allocated number of entries in l->ents (updated)
+/// @param nsize allocated size of l->names (updated)
+/// @param nlen used size of l->names (updated)
+/// @param limit stop after @a limit entries in @a l (0 = no limit)
+/// @retval 1 if the limit was reached and there are more entries
+/// @retval 0 if all entries have been read
+/// @retval -1 on a read error or if out of memory (errno is set)
+static int readEntries(struct dirstream *ds, struct listing *l, size_t *cap, size_t *nsize,
+                       size_t *nlen, size_t limit)
+{
+  struct linux_dirent64 *dep;
+
+  while(!limit || ((size_t)l->len < limit)){
+    if((dep = getNext(ds)) == NULL) goto end;
+    size_t len = strlen(dep->d_name);
+
+    if((size_t)l->len==*cap){//if the entry array is full -> grow (in place if possible)
+      size_t nsz = *cap ? *cap*2 : 64;
+      void *p = arena_grow(&l->mem->ents, l->ents, *cap*sizeof(struct entry), nsz*sizeof(struct entry));
+      if(!p) goto nomem;
+      l->ents = (struct entry *)p;
+      *cap = nsz;
+    }
+    if(*nlen+len+1 > *nsize){
+      size_t nsz = *nsize ? *nsize*2 : 4096;
+      while (nsz < *nlen+len+1) nsz *= 2;
+      void *p = arena_grow(&l->mem->names, l->names, *nlen, nsz);
+      if(!p) goto nomem;
+      l->names = (char *)p;
+      *nsize = nsz;
+    }
+
+    struct entry *e = &l->ents[l->len++];
+    e->ino = dep->d_ino;
+    e->name = *nlen;
+    e->len = len;
+    e->type = dep->d_type;
+    e->flags = DTF_MATCH;
+    memcpy(l->names + *nlen, dep->d_name, len+1);
+    *nlen += len+1;
+  }
+
+  //limit reached: check whether there are more entries and push the next one back
+  if((dep = getNext(ds)) != NULL){
+    ds->pos -= dep->d_reclen;
+    return 1;
+  }
+
+end:
+  if(ds->err){
+    errno = ds->err;
+    return -1;
+  }
+
+  return 0;
+
+nomem:
+  errno = ENOMEM;
+  return -1;
+}
+
+
+/// @brief apply the conditions of filter @a f that need only names, types and the depth to the
+///        entries of listing @a l (before any entry is stat'ed). Excluded entries and entries
+///        that are known not to be directories and do not match are removed; the relative order
+///        of the remaining entries is kept.
+///
+/// @param f filter
+/// @param l listing
+/// @param depth depth of the entries
+static void filterNames(const struct filter *f, struct listing *l, unsigned int depth)
+{
+  int n = 0;
+
+  for(int i=0; i<l->len; i++){
+    struct entry *e = &l->ents[i];
+    int res = filter_pre(f, l->names + e->name, e->type, depth);
+
+    if(res == FILTER_EXCLUDE) continue;
+    if(res == FILTER_NOMATCH) e->flags &= ~DTF_MATCH;
+    //entries without d_type may still turn out to be directories
+    if(!(e->flags & DTF_MATCH) && (e->type != DT_DIR) && (e->type != DT_UNKNOWN)) continue;
+    l->ents[n++] = *e;
+  }
+  l->len = n;
+}
+
+
+/// @brief apply the conditions of filter @a f that need metadata to the stat'ed entries of
+///        listing @a l and remove the entries that are not directories and do not match
+///
+/// @param f filter
+/// @param l listing
+static void filterMeta(const struct filter *f, struct listing *l)
+{
+  int n = 0;
+
+  for(int i=0; i<l->len; i++){
+    struct entry *e = &l->ents[i];
+
+    if(e->flags & DTF_MATCH){
+      int match = l->info ? filter_post(f, &l->info[i])
+                          : !f->types || (f->types & (1u << e->type));
+      if(!match) e->flags &= ~DTF_MATCH;
+    }
+    if(!(e->flags & DTF_MATCH) && (e->type != DT_DIR)) continue;
+    if(l->info) l->info[n] = l->info[i];
+    l->ents[n++] = *e;
+  }
+  l->len = n;
+}
+
+
+/// @brief stat and sort the entries of listing @a l. With a link set, entries with several links
+///        are marked ENT_LINKED; they are looked up in the set when the walk visits them, so that
+///        the first link in display order is counted no matter which thread read the directory.
+///
+/// @param dt configuration
+/// @param slot io_uring slot of the calling thread
+/// @param fd open directory
+/// @param l listing
+/// @param sorted non-zero if the entries are already in display order
+/// @retval 0 on success
+/// @retval -1 if out of memory (errno is set)
+static int sortEntries(struct dirtree *dt, int slot, int fd, struct listing *l, int sorted)
+{
+  struct arena *a = &l->mem->ents;
+  struct inoset *links = dt->opt.links;
+
+  if (dt->stat && !(l->info = (struct stat *)arena_calloc(a, l->len*sizeof(struct stat)))) goto nomem;
+  if (!(l->order = (int *)arena_alloc(a, l->len*sizeof(int)))) goto nomem;
+
+  if(statEntries(dt, slot, fd, l) < 0) return -1;//get information of subfiles
+  if(dt->filter->active) filterMeta(dt->filter, l);
+
+  //sort by filetype, filename: (key prefix, index) pairs are sorted instead of the entries
+  if(!sorted && (l->len > 1)){
+    struct sortkey *keys = (struct sortkey *)arena_alloc(a, 2*l->len*sizeof(struct sortkey));
+    if(!keys) goto nomem;
+    for(int i=0; i<l->len; i++){
+      keys[i].key = sort_key(l->names + l->ents[i].name, l->ents[i].type == DT_DIR);
+      keys[i].idx = i;
+    }
+    sort_keys(keys, keys + l->len, l->len, entryName, l);
+    for(int i=0; i<l->len; i++) l->order[i] = keys[i].idx;
+  }
+  else{
+    for(int i=0; i<l->len; i++) l->order[i] = i;
+  }
+
+  if(!links || !l->info) return 0;
+
+  for(int i=0; i<l->len; i++){
+    const struct stat *st = &l->info[i];
+
+    if((l->ents[i].flags & DTF_MATCH) && (st->st_nlink > 1) && !S_ISDIR(st->st_mode)){
+      l->ents[i].flags |= ENT_LINKED;
+    }
+  }
+
+  return 0;
+
+nomem:
+  errno = ENOMEM;
+  return -1;
+}
+
+
+/// @brief write the sorted entries of listing @a l as a run to its spill file and empty the
+///        listing
+///
+/// @param l listing
+/// @retval 0 on success
+/// @retval -1 if the run could not be written (errno is set)
+static int spillEntries(struct listing *l)
+{
+  int res;
+
+
+  for(int i=0; i<l->len; i++){
+    int k = l->order[i];
+    struct spillent e = { l->ents[k].ino, l->names + l->ents[k].name, l->ents[k].len,
+                          l->ents[k].type, l->ents[k].flags, l->info ? &l->info[k] : NULL };
+    spill_add(l->spill, &e);
+  }
+  res = spill_endrun(l->spill);
+
+  l->len = 0;
+  l->ents = NULL;
+  l->names = NULL;
+  l->info = NULL;
+  l->order = NULL;
+  arena_reset(&l->mem->ents);
+  arena_reset(&l->mem->names);
+
+  return res;
+}
+
+
+/// @brief read, sort and stat all entries of directory @a name. The directory is opened relative
+///        to @a dfd and all entries are stat'ed relative to the open directory, so the kernel
+///        never has to resolve a full path. Entry records and names are stored in arenas that
+///        are recycled from directory to directory.
+///
+///        With a spill limit of N, a directory with more than N entries is not kept in memory:
+///        its entries are read, stat'ed and sorted N at a time and each sorted run is written to
+///        a temporary spill file. The walk merges the runs while visiting the entries.
+///
+///        Filter conditions on names and types are applied as soon as the entries have been
+///        read, so entries that cannot match are never stat'ed and excluded directories are
+///        never opened.
+///
+/// @param dt configuration
+/// @param slot io_uring slot of the calling thread
+/// @param dfd directory file descriptor @a name is relative to, or AT_FDCWD
+/// @param name absolute or relative path string
+/// @param depth depth of the directory (0 for a root)
+/// @param l listing to fill in
+/// @retval file descriptor of the open directory on success
+/// @retval -1 on error (the error code is stored in @a l->err; ENOMEM if out of memory)
+static int loadDir(struct dirtree *dt, int slot, int dfd, const char *name, unsigned int depth,
+                   struct listing *l)
+{
+  static __thread char dents[DENTS_BUFSIZE] __attribute__((aligned(8)));
+  struct dirstream ds = { .buf = dents, .size = sizeof(dents) };
+  size_t cap = 0, nlen = 0, nsize = 0, limit = dt->opt.spill;
+  struct profile *prof = dt->opt.profile;
+  int sorted = 0, total = 0, res;
+
+  memset(l, 0, sizeof(struct listing));
+  l->leaf = depth+1 >= dt->filter->depth_max;
+
+  prof_enter(prof, PROF_OPEN);
+  ds.fd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (dfd == AT_FDCWD ? 0 : O_NOFOLLOW));
+  if (ds.fd < 0) {
+    l->err = errno;
+    prof_leave(prof);
+    return -1;
+  }
+
+  l->mem = getMem(dt);
+  if (!l->mem) {
+    errno = ENOMEM;
+    prof_leave(prof);
+    goto error;
+  }
+
+  //snapshot: unchanged directories are not read again
+  if (dt->opt.snap || dt->opt.dirstat) fstat(ds.fd, &l->st);
+  prof_leave(prof);
+  if (dt->opt.snap && ((sorted = reuseDir(dt, l)) < 0)) goto error;
+
+  //store files in directory; wide directories are spilled in sorted runs
+  for(;;){
+    int more = 0;
+
+    if(!sorted){
+      prof_enter(prof, PROF_READDIR);
+      more = readEntries(&ds, l, &cap, &nsize, &nlen, limit);
+      prof_count(prof, PROF_READDIR, l->len);
+      prof_leave(prof);
+      if(more < 0) goto error;
+    }
+
+    if(dt->filter->active & FILTER_NAME){
+      prof_enter(prof, PROF_SORT);
+      filterNames(dt->filter, l, depth+1);
+      prof_leave(prof);
+    }
+
+    if(more && !l->spill && !(l->spill = spill_create())){
+      perror("Cannot create spill file");
+      limit = 0;
+      continue;
+    }
+    if(!l->spill) break;
+
+    prof_enter(prof, PROF_SORT);
+    res = sortEntries(dt, slot, ds.fd, l, sorted);
+    prof_count(prof, PROF_SORT, l->len);
+    prof_leave(prof);
+    if(res < 0) goto error;
+    total += l->len;
+    prof_enter(prof, PROF_SPILL);
+    res = spillEntries(l);
+    if(!res && !more) res = spill_merge(l->spill);
+    prof_leave(prof);
+    if(res < 0) goto error;
+    cap = nlen = nsize = 0;
+    if(!more){
+      l->len = total;
+      __atomic_add_fetch(&dt->spill_dirs, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&dt->spill_runs, spill_runs(l->spill), __ATOMIC_RELAXED);
+      return ds.fd;
+    }
+  }
+
+  prof_enter(prof, PROF_SORT);
+  res = sortEntries(dt, slot, ds.fd, l, sorted);
+  prof_count(prof, PROF_SORT, l->len);
+  prof_leave(prof);
+  if(res < 0) goto error;
+
+  return ds.fd;
+
+error:
+  //the directory is reported with the error and without entries
+  l->err = errno;
+  l->len = 0;
+  spill_free(l->spill);
+  l->spill = NULL;
+  if (l->mem) putMem(dt, l->mem);
+  l->mem = NULL;
+  close(ds.fd);
+  return -1;
+}
+
+
+/// @brief end walk @a w with error @a err. Pending tasks are not read; the first error is the one
+///        dt_walk() reports.
+static void walkError(struct walk *w, int err)
+{
+  int none = 0;
+
+  __atomic_compare_exchange_n(&w->err, &none, err, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+}
+
+
+/// @brief scan the directory of task @a t. Opens the directory relative to its parent and
+///        releases the parent once this directory is open. Running out of memory ends the walk.
+///
+/// @param t directory task
+static void scanDir(struct dirtask *t)
+{
+  int slot = pool_worker_id() >= 0 ? pool_worker_id() : t->w->slot;
+  int fd = loadDir(t->w->dt, slot, t->parent ? t->parent->fd : AT_FDCWD, t->name, t->depth, &t->l);
+
+  if (fd >= 0) {
+    t->dir.fd = fd;
+    t->dir.refs = 1;
+  } else if (t->l.err == ENOMEM) {
+    walkError(t->w, ENOMEM);
+  }
+  fdRelease(t->parent);
+  t->parent = NULL;
+}
+
+
+/// @brief non-zero if task @a t need not be read: it was pruned or its walk is ending
+static int cancelled(struct dirtask *t)
+{
+  return __atomic_load_n(&t->cancel, __ATOMIC_ACQUIRE) || __atomic_load_n(&t->w->stop, __ATOMIC_ACQUIRE);
+}
+
+
+/// @brief claim task @a t for scanning. Exactly one thread claims every task.
+///
+/// @retval 1 if the task has been claimed by the calling thread
+/// @retval 0 if it had been claimed already
+static int claimTask(struct dirtask *t)
+{
+  int unclaimed = 0;
+
+  return __atomic_compare_exchange_n(&t->claimed, &unclaimed, 1, 0, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE);
+}
+
+
+static void scanTask(void *arg);
+
+/// @brief submit task @a t to the pool unless it has been claimed already. The task counts
+///        towards the window of its walk until the walking thread has waited for it. If the pool
+///        is out of memory, the calling thread scans the directory itself.
+static void submitTask(struct dirtask *t)
+{
+  if (!claimTask(t)) return;
+  __atomic_add_fetch(&t->w->ahead, 1, __ATOMIC_RELAXED);
+  if (pool_submit(t->pool, scanTask, t) < 0) scanTask(t);
+}
+
+
+/// @brief non-zero if the window of walk @a w has room for another task
+static int windowOpen(struct walk *w)
+{
+  return __atomic_load_n(&w->ahead, __ATOMIC_RELAXED) < w->window;
+}
+
+
+/// @brief pool task: scan a directory and submit its first subdirectories as far as the window
+///        of the walk has room; the walking thread submits the others later. Subdirectories
+///        without a task (out of memory) are scanned by the walking thread when it gets there.
+///
+/// @param arg struct dirtask* to scan
+static void scanTask(void *arg)
+{
+  struct dirtask *t = (struct dirtask*)arg;
+  struct dirtree *dt = t->w->dt;
+
+  if (cancelled(t)) {
+    fdRelease(t->parent);
+    t->parent = NULL;
+    t->l.err = ECANCELED;
+  }
+  else scanDir(t);
+
+  // the subdirectories of a spilled directory are only known while it is visited; they are
+  // scanned by the walking thread
+  if (!t->l.err && !t->l.spill) {
+    struct arena *a = &t->l.mem->ents;
+
+    // submit in reverse display order: this worker pops its newest task first and thus continues
+    // with the subdirectory that will be visited next
+    if (!cancelled(t)) {
+      int room = t->w->window - __atomic_load_n(&t->w->ahead, __ATOMIC_RELAXED), last = -1;
+
+      t->sub = (struct dirtask **)arena_calloc(a, t->l.len*sizeof(struct dirtask*));
+      for (int i = 0; t->sub && (i < t->l.len); i++) {
+        int k = t->l.order[i];
+        if ((t->l.ents[k].type == DT_DIR) && !t->l.leaf) {
+          if (!(t->sub[k] = (struct dirtask *)arena_alloc(a, sizeof(struct dirtask)))) continue;
+          fdRetain(&t->dir);
+          initTask(t->sub[k], &t->dir, t->l.names + t->l.ents[k].name, t->depth+1, t->w, t->pool);
+          if (room-- > 0) last = i;
+        }
+      }
+      for (int i = last; i >= 0; i--) {
+        int k = t->l.order[i];
+        if (t->sub[k]) submitTask(t->sub[k]);
+      }
+    }
+
+    // the directory stays open until all subdirectories have been opened
+    fdRelease(&t->dir);
+  }
+
+  pthread_mutex_lock(&dt->task_lock);
+  t->done = 1;
+  pthread_cond_broadcast(&dt->task_done);
+  pthread_mutex_unlock(&dt->task_lock);
+}
+
+
+/// @brief make sure task @a t has been scanned. In parallel mode, wait for the worker, or scan the
+///        directory now if it has not been submitted; otherwise scan the directory now.
+static void waitTask(struct dirtask *t)
+{
+  if (t->pool && claimTask(t)) {
+    scanTask(t);
+  } else if (t->pool) {
+    struct dirtree *dt = t->w->dt;
+    prof_enter(dt->opt.profile, PROF_WAIT);
+    pthread_mutex_lock(&dt->task_lock);
+    while (!t->done) pthread_cond_wait(&dt->task_done, &dt->task_lock);
+    pthread_mutex_unlock(&dt->task_lock);
+    prof_leave(dt->opt.profile);
+    __atomic_sub_fetch(&t->w->ahead, 1, __ATOMIC_RELAXED);
+  } else {
+    scanDir(t);
+  }
+}
+
+
+/// @brief push a new frame for task @a t on top of @a up. Frames never move, so subdirectory
+///        tasks can keep pointers to the fdref of the task stored in a frame.
+///
+/// @retval new frame
+/// @retval NULL if out of memory
+static struct frame *pushFrame(struct walk *w, struct frame *up, struct dirtask *t, size_t len,
+                               unsigned int depth)
+{
+  struct frame *f = w->free_frames;
+
+  if (f) w->free_frames = f->up;
+  else if (!(f = (struct frame *)malloc(sizeof(struct frame)))) return NULL;
+
+  memset(&f->d, 0, sizeof(f->d));
+  memset(&f->sum, 0, sizeof(f->sum));
+  f->t = t;
+  f->d.len = len;
+  f->d.depth = depth;
+  f->next = -1;
+  f->skip = f->quiet = 0;
+  f->ahead = 0;
+  f->pending = NULL;
+  f->up = up;
+
+  return f;
+}
+
+
+/// @brief pop frame @a f and return its parent frame
+static struct frame *popFrame(struct walk *w, struct frame *f)
+{
+  struct frame *up = f->up;
+
+  if (w->pending == f) w->pending = f->pending;
+  f->up = w->free_frames;
+  w->free_frames = f;
+
+  return up;
+}
+
+
+/// @brief skip the entries of the directory of frame @a f. The subdirectories that have been read
+///        ahead need not be read further.
+static void skipFrame(struct frame *f)
+{
+  struct dirtask *t = f->t;
+
+  f->skip = 1;
+  f->ahead = t->l.len;
+  for (int k = 0; t->sub && (k < t->l.len); k++) {
+    if (t->sub[k]) __atomic_store_n(&t->sub[k]->cancel, 1, __ATOMIC_RELEASE);
+  }
+}
+
+
+/// @brief submit the subdirectories nearest to the walk that have not been read ahead while the
+///        window of walk @a w has room: those of the topmost pending frame first, in display
+///        order, then those of the pending frames below it
+static void fillWindow(struct walk *w)
+{
+  while (w->pending && windowOpen(w)) {
+    struct frame *f = w->pending;
+    struct dirtask *t = f->t;
+
+    if (f->ahead >= t->l.len) {
+      w->pending = f->pending;
+      continue;
+    }
+    struct dirtask *sub = t->sub[t->l.order[f->ahead++]];
+    if (sub) submitTask(sub);
+  }
+}
+
+
+/// @brief end walk @a w: no further callbacks are made from any frame up from @a f
+static void stopWalk(struct walk *w, struct frame *f)
+{
+  __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+  for (; f; f = f->up) f->skip = f->quiet = 1;
+}
+
+
+/// @brief wait for task @a t that has been read ahead and release it together with the tasks read
+///        ahead below it, without visiting them. Used when the walk cannot push a frame for @a t.
+static void drainTask(struct walk *w, struct dirtask *t)
+{
+  struct listing *l = &t->l;
+
+  //directories scanned on demand have not been read
+  if (!t->pool) {
+    fdRelease(t->parent);
+    t->parent = NULL;
+    return;
+  }
+
+  __atomic_store_n(&t->cancel, 1, __ATOMIC_RELEASE);
+  waitTask(t);
+  for (int k = 0; t->sub && (k < l->len); k++) {
+    if (t->sub[k]) drainTask(w, t->sub[k]);
+  }
+  if (!l->err && l->spill) fdRelease(&t->dir);
+  releaseTask(t);
+}
+
+
+/// @brief end walk @a w with ENOMEM: no further callbacks are made from any frame up from @a f,
+///        and task @a t (or NULL) for which no frame could be pushed is drained
+static void outOfMemory(struct walk *w, struct frame *f, struct dirtask *t)
+{
+  walkError(w, ENOMEM);
+  stopWalk(w, f);
+  if (t) drainTask(w, t);
+}
+
+
+/// @brief make room for a path of @a size bytes in walk @a w
+///
+/// @retval 0 on success
+/// @retval -1 if out of memory (the path is unchanged)
+static int growPath(struct walk *w, size_t size)
+{
+  char *path = (char *)realloc(w->path, size);
+
+  if (!path) return -1;
+  w->path = path;
+  w->psize = size;
+
+  return 0;
+}
+
+
+/// @brief look up entry @a e (ENT_LINKED) in the link set: the size of an inode with several links
+///        is counted at its first link only, further links are marked DTF_DUPLINK. Called by the
+///        walk in display order, so the result does not depend on the order of the workers.
+///
+/// @retval 0 on success
+/// @retval -1 if out of memory
+static int dedupLink(struct dirtree *dt, struct spillent *e)
+{
+  unsigned long long t0 = dt->opt.timing ? nsec() : 0;
+  int res;
+
+  e->flags &= ~ENT_LINKED;
+  res = inoset_insert(dt->opt.links, e->st->st_dev, e->st->st_ino);
+  if(res < 0) return -1;
+  if(res == 0){
+    e->flags |= DTF_DUPLINK;
+    __atomic_add_fetch(&dt->link_bytes, e->st->st_size, __ATOMIC_RELAXED);
+  }
+
+  if(t0) __atomic_add_fetch(&dt->t_links, nsec() - t0, __ATOMIC_RELAXED);
+
+  return 0;
+}
+
+
+/// @brief count entry @a e in summary @a s unless it does not match the filter
+static void countEntry(struct dt_summary *s, const struct spillent *e)
+{
+  mode_t mode = e->st ? e->st->st_mode : DTTOIF(e->type);
+
+  if(!(e->flags & DTF_MATCH)) return;
+
+  //statistic sum according to types, accumulate size, blocks
+  if(S_ISDIR(mode)) s->dirs++;
+  else if(S_ISFIFO(mode)) s->fifos++;
+  else if(S_ISLNK(mode)) s->links++;
+  else if(S_ISSOCK(mode)) s->socks++;
+  else if(!S_ISCHR(mode) && !S_ISBLK(mode)) s->files++;
+  if(e->st && !(e->flags & DTF_DUPLINK)){
+    s->size+=e->st->st_size;
+    s->blocks+=e->st->st_blocks;
+  }
+}
+
+
+/// @brief visit the tree of directory task @a root and release all listings. The walk is
+///        iterative: each directory level is a frame on an explicit, heap-allocated stack that
+///        holds the directory's listing and the position of its next entry, so the depth of
+///        the tree is not limited by the size of the call stack.
+///
+///        The frames accumulate the totals of their subtree; a directory's totals are complete
+///        when it is left and are then added to its parent. Pruned directories that have been
+///        read ahead by the workers are waited for without callbacks, since their listings and
+///        open directories are still referenced.
+///
+///        If the walk runs out of memory, no further callbacks are made and w->err is set.
+///
+/// @param w walk
+/// @param root directory task of the root
+/// @retval DTW_STOP if a callback stopped the walk
+/// @retval DTW_CONTINUE otherwise
+static int walkTree(struct walk *w, struct dirtask *root)
+{
+  const struct dt_visitor *v = w->v;
+  struct profile *prof = w->dt->opt.profile;
+  size_t len = strlen(root->name);
+  struct frame *f;
+  int res;
+
+  //the path of the root, 'root/'
+  if((len + 2 > w->psize) && (growPath(w, len + 256) < 0)){
+    outOfMemory(w, NULL, root);
+    return DTW_STOP;
+  }
+  memcpy(w->path, root->name, len);
+  if((len == 0) || (w->path[len-1] != '/')) w->path[len++] = '/';
+  w->path[len] = '\0';
+  if(!(f = pushFrame(w, NULL, root, len, root->depth))) outOfMemory(w, NULL, root);
+
+  while(f){
+    struct dirtask *t = f->t;
+    struct listing *l = &t->l;
+
+    //enter the directory; directories scanned on demand are not read once the walk is ending
+    if(f->next < 0){
+      if(f->quiet && !t->pool){
+        fdRelease(t->parent);
+        f = popFrame(w, f);
+        continue;
+      }
+      waitTask(t);
+      f->next = 0;
+      if(__atomic_load_n(&w->err, __ATOMIC_ACQUIRE)) stopWalk(w, f);
+
+      if(f->quiet) skipFrame(f);
+      else{
+        f->d.name = t->name;
+        f->d.path = w->path;
+        w->path[f->d.len] = '\0';
+        f->d.err = l->err;
+        f->d.count = l->err ? 0 : l->len;
+        f->d.spilled = l->spill != NULL;
+        f->d.st = !l->err && (w->dt->opt.snap || w->dt->opt.dirstat) ? &l->st : NULL;
+        f->d.priv = l;
+        if(prof) prof_dir(prof, w->path, f->d.len, f->d.count);
+        prof_enter(prof, PROF_VISIT);
+        res = v->enter ? v->enter(w->ctx, &f->d) : DTW_CONTINUE;
+        prof_leave(prof);
+        if(res == DTW_STOP) stopWalk(w, f);
+        else if(res == DTW_PRUNE) skipFrame(f);
+      }
+
+      //the subdirectories that did not fit into the window are read ahead as it opens up
+      if(t->sub && !f->skip){
+        f->pending = w->pending;
+        w->pending = f;
+      }
+      if(t->pool) fillWindow(w);
+    }
+
+    //leave the directory after its last entry
+    if(l->err || (f->next == l->len)){
+      if(!f->quiet){
+        if(f->up) dt_summary_add(&f->up->sum, &f->sum);
+        f->d.path = w->path;
+        w->path[f->d.len] = '\0';
+        prof_enter(prof, PROF_VISIT);
+        res = v->leave ? v->leave(w->ctx, &f->d, &f->sum) : DTW_CONTINUE;
+        prof_leave(prof);
+        if(res == DTW_STOP) stopWalk(w, f);
+      }
+      if(!l->err && (!t->pool || l->spill)) fdRelease(&t->dir);
+      releaseTask(t);
+      f = popFrame(w, f);
+      continue;
+    }
+
+    //pruned: only wait for the subdirectories that have been read ahead
+    if(f->skip){
+      struct dirtask *sub = NULL;
+
+      while(!sub && (f->next < l->len)){
+        int k = l->spill ? -1 : l->order[f->next];
+        f->next++;
+        if((k >= 0) && t->sub) sub = t->sub[k];
+      }
+      if(sub){
+        struct frame *up = f;
+        if((f = pushFrame(w, up, sub, up->d.len, up->d.depth+1))) f->skip = f->quiet = 1;
+        else{
+          outOfMemory(w, up, sub);
+          f = up;
+        }
+      }
+      continue;
+    }
+
+    int i = f->next++;
+    int k = -1;
+    struct spillent e;
+
+    //next entry in display order: from the sorted listing or merged from the spilled runs
+    if(l->spill){
+      res = spill_next(l->spill, &e);
+      if(res <= 0){
+        //the rest of the directory cannot be read back: it is left with the error
+        f->d.err = res < 0 ? errno : EIO;
+        f->next = l->len;
+        continue;
+      }
+    }
+    else{
+      k = l->order[i];
+      e.ino = l->ents[k].ino;
+      e.name = l->names + l->ents[k].name;
+      e.len = l->ents[k].len;
+      e.type = l->ents[k].type;
+      e.flags = l->ents[k].flags;
+      e.st = l->info ? &l->info[k] : NULL;
+    }
+    if((e.flags & ENT_LINKED) && (dedupLink(w->dt, &e) < 0)){
+      outOfMemory(w, f, NULL);
+      continue;
+    }
+    countEntry(&f->sum, &e);
+
+    res = DTW_CONTINUE;
+    if(v->entry){
+      struct dt_entry de = { e.name, e.len, e.ino, e.type, e.flags, i == l->len-1, e.st };
+      f->d.path = w->path;
+      w->path[f->d.len] = '\0';
+      prof_enter(prof, PROF_VISIT);
+      res = v->entry(w->ctx, &f->d, &de);
+      prof_leave(prof);
+    }
+
+    //if sub file is directory : descend into it
+    if((e.type == DT_DIR) && !l->leaf){
+      struct dirtask *sub = (k >= 0) && t->sub ? t->sub[k] : NULL;
+      size_t len = f->d.len + e.len + 1;
+
+      if(res == DTW_CONTINUE){
+        struct frame *up = f;
+
+        //extend the path with 'name/'
+        if((len + 1 > w->psize) && (growPath(w, 2*len) < 0)) f = NULL;
+        else{
+          memcpy(w->path + up->d.len, e.name, e.len);
+          w->path[len-1] = '/';
+          f = pushFrame(w, up, sub, len, up->d.depth+1);
+        }
+        if(!f){
+          outOfMemory(w, up, sub);
+          f = up;
+          continue;
+        }
+
+        if(!sub){
+          f->t = &f->local;
+          fdRetain(&t->dir);
+          initTask(f->t, &t->dir, e.name, f->d.depth, w, NULL);
+        }
+      }
+      else if(sub){
+        //pruned or stopped, but read ahead already
+        struct frame *up = f;
+        __atomic_store_n(&sub->cancel, 1, __ATOMIC_RELEASE);
+        if((f = pushFrame(w, up, sub, up->d.len, up->d.depth+1))) f->skip = f->quiet = 1;
+        else{
+          outOfMemory(w, up, sub);
+          f = up;
+        }
+      }
+    }
+    if(res == DTW_STOP) stopWalk(w, f);
+  }
+
+  return __atomic_load_n(&w->stop, __ATOMIC_ACQUIRE) ? DTW_STOP : DTW_CONTINUE;
+}
+
+
+struct dirtree *dt_create(const struct dt_options *opt)
+{
+  struct dirtree *dt = (struct dirtree *)calloc(1, sizeof(struct dirtree));
+
+  if (!dt) return NULL;
+  dt->opt = *opt;
+  if (dt->opt.walkers < 1) dt->opt.walkers = 1;
+  filter_init(&dt->nofilter);
+  dt->filter = opt->filter ? opt->filter : &dt->nofilter;
+  dt->stat = opt->stat || (dt->filter->active & FILTER_STAT);
+  pthread_mutex_init(&dt->lock, NULL);
+  pthread_mutex_init(&dt->task_lock, NULL);
+  pthread_cond_init(&dt->task_done, NULL);
+
+  // each pool worker and each concurrent walk gets its own ring. Threads without a ring use
+  // synchronous stat.
+  if (opt->uring) {
+    dt->nslots = (opt->pool ? pool_size(opt->pool) : 0) + dt->opt.walkers;
+    dt->rings = (struct uring **)calloc(dt->nslots, sizeof(struct uring*));
+    dt->busy = (int *)calloc(dt->nslots, sizeof(int));
+    if (!dt->rings || !dt->busy) {
+      dt_free(dt);
+      return NULL;
+    }
+    for (int s = 0; s < dt->nslots; s++) dt->rings[s] = uring_create(URING_ENTRIES);
+  }
+
+  return dt;
+}
+
+
+int dt_walk(struct dirtree *dt, const char *path, unsigned int depth, const struct dt_visitor *v,
+            void *ctx)
+{
+  struct walk w = { .dt = dt, .v = v, .ctx = ctx, .slot = -1 };
+  struct pool *pool = dt->opt.pool;
+  struct dirtask t;
+  int res;
+
+  // the walking thread scans directories itself without a pool, and the subdirectories of
+  // spilled directories in any case; it takes a free ring slot after the workers' slots
+  if (dt->rings) {
+    pthread_mutex_lock(&dt->lock);
+    for (int s = dt->nslots - dt->opt.walkers; (w.slot < 0) && (s < dt->nslots); s++) {
+      if (!dt->busy[s]) {
+        dt->busy[s] = 1;
+        w.slot = s;
+      }
+    }
+    pthread_mutex_unlock(&dt->lock);
+  }
+
+  prof_enter(dt->opt.profile, PROF_WALK);
+  if (pool) w.window = dt->opt.readahead > 0 ? dt->opt.readahead : READAHEAD*pool_size(pool);
+  initTask(&t, NULL, path, depth, &w, pool);
+  if (pool) submitTask(&t);
+  res = walkTree(&w, &t);
+  prof_leave(dt->opt.profile);
+
+  if (w.slot >= 0) {
+    pthread_mutex_lock(&dt->lock);
+    dt->busy[w.slot] = 0;
+    pthread_mutex_unlock(&dt->lock);
+  }
+  while (w.free_frames) {
+    struct frame *f = w.free_frames;
+    w.free_frames = f->up;
+    free(f);
+  }
+  free(w.path);
+
+  if (w.err) {
+    errno = w.err;
+    return -1;
+  }
+
+  return res;
+}
+
+
+void dt_summary_add(struct dt_summary *dst, const struct dt_summary *src)
+{
+  dst->dirs += src->dirs;
+  dst->files += src->files;
+  dst->links += src->links;
+  dst->fifos += src->fifos;
+  dst->socks += src->socks;
+  dst->size += src->size;
+  dst->blocks += src->blocks;
+}
+
+
+void dt_list(const struct dt_dir *d, int i, struct dt_entry *e)
+{
+  const struct listing *l = (const struct listing*)d->priv;
+  int k = l->order[i];
+
+  e->name = l->names + l->ents[k].name;
+  e->len = l->ents[k].len;
+  e->ino = l->ents[k].ino;
+  e->type = l->ents[k].type;
+  e->flags = l->ents[k].flags & ~ENT_LINKED;
+  e->last = i == l->len-1;
+  e->st = l->info ? &l->info[k] : NULL;
+}
+
+
+void dt_stats(struct dirtree *dt, struct dt_stats *st)
+{
+  st->lookups = __atomic_load_n(&dt->n_lookup, __ATOMIC_RELAXED);
+  st->t_lookup = __atomic_load_n(&dt->t_lookup, __ATOMIC_RELAXED);
+  st->t_order = __atomic_load_n(&dt->t_order, __ATOMIC_RELAXED);
+  st->t_links = __atomic_load_n(&dt->t_links, __ATOMIC_RELAXED);
+  st->link_bytes = __atomic_load_n(&dt->link_bytes, __ATOMIC_RELAXED);
+  st->snap_reused = __atomic_load_n(&dt->snap_reused, __ATOMIC_RELAXED);
+  st->spill_dirs = __atomic_load_n(&dt->spill_dirs, __ATOMIC_RELAXED);
+  st->spill_runs = __atomic_load_n(&dt->spill_runs, __ATOMIC_RELAXED);
+}
+
+
+void dt_free(struct dirtree *dt)
+{
+  if (!dt) return;
+
+  while (dt->free_mem) {
+    struct dirmem *m = dt->free_mem;
+    dt->free_mem = m->next;
+    arena_free(&m->ents);
+    arena_free(&m->names);
+    free(m);
+  }
+  for (int s = 0; dt->rings && (s < dt->nslots); s++) uring_destroy(dt->rings[s]);
+  free(dt->rings);
+  free(dt->busy);
+  filter_free(&dt->nofilter);
+  pthread_mutex_destroy(&dt->lock);
+  pthread_mutex_destroy(&dt->task_lock);
+  pthread_cond_destroy(&dt->task_done);
+  free(dt);
+}
@@ -0,0 +1,184 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief directory tree traversal with a visitor interface (libdirtree)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __LIBDIRTREE_H__
+#define __LIBDIRTREE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/// @brief internal types of the options (filter.h, inoset.h, pool.h, profile.h, snapshot.h)
+struct filter;
+struct inoset;
+struct pool;
+struct profile;
+struct snapshot;
+
+/// @brief visitor return codes
+#define DTW_CONTINUE 0        ///< continue the walk
+#define DTW_PRUNE   1         ///< enter: skip the entries of the directory; entry: do not descend
+                              ///< into the directory
+#define DTW_STOP    2         ///< end the walk; no further callbacks are made. dt_walk() returns
+                              ///< DTW_STOP, or -1 with errno set if the walk failed (ENOMEM)
+
+/// @brief entry flags (dt_entry.flags)
+#define DTF_MATCH   0x1       ///< entry matches the filter and is counted; non-matching
+                              ///< directories are only traversed
+#define DTF_DUPLINK 0x2       ///< hard link to an inode that has been counted (with a link set);
+                              ///< its size is not counted. Set when the entry is visited, in
+                              ///< display order; dt_list() does not report it
+
+/// @brief totals of the entries below a directory (entries that match the filter only)
+struct dt_summary {
+  unsigned int dirs;          ///< number of directories encountered
+  unsigned int files;         ///< number of files
+  unsigned int links;         ///< number of links
+  unsigned int fifos;         ///< number of pipes
+  unsigned int socks;         ///< number of sockets
+
+  unsigned long long size;    ///< total size (in bytes), with metadata only
+  unsigned long long blocks;  ///< total number of blocks (512 byte blocks), with metadata only
+};
+
+/// @brief a directory of the walk
+struct dt_dir {
+  const char *name;           ///< path of the root as given, or name of the directory
+  const char *path;           ///< path of the directory with a trailing '/'; valid until the
+                              ///< directory is left
+  size_t len;                 ///< length of path
+  unsigned int depth;         ///< depth of the directory (0 for a root)
+  int err;                    ///< errno if the directory could not be read (it has no entries);
+                              ///< set at leave() with count > 0 if a spilled directory could not
+                              ///< be read back after the entries visited
+  int count;                  ///< number of entries
+  int spilled;                ///< the entries are merged from spilled runs and cannot be listed
+                              ///< with dt_list()
+  const struct stat *st;      ///< metadata of the directory itself (dt_options.dirstat or with a
+                              ///< snapshot), NULL otherwise
+  const void *priv;           ///< private
+};
+
+/// @brief an entry of a directory
+struct dt_entry {
+  const char *name;           ///< name of the entry
+  size_t len;                 ///< length of the name
+  uint64_t ino;               ///< inode number
+  unsigned char type;         ///< file type (DT_* of dirent.h)
+  unsigned char flags;        ///< DTF_MATCH, DTF_DUPLINK
+  int last;                   ///< non-zero for the last entry of the directory
+  const struct stat *st;      ///< metadata of the entry (dt_options.stat), NULL otherwise
+};
+
+/// @brief visitor callbacks; any of them may be NULL. @a ctx is the context passed to dt_walk().
+///
+///        enter() is called for every directory before its entries, entry() for each entry in
+///        display order (directories first, then by name), and leave() after the last entry with
+///        the totals of the subtree. A subdirectory is entered right after its entry() call.
+///        Unreadable directories (dt_dir.err) are entered and left without entries.
+///
+///        The library never terminates the process: I/O errors of a directory are reported in
+///        dt_dir.err, and running out of memory ends the walk with an error from dt_walk().
+struct dt_visitor {
+  int (*enter)(void *ctx, const struct dt_dir *d);
+  int (*entry)(void *ctx, const struct dt_dir *d, const struct dt_entry *e);
+  int (*leave)(void *ctx, const struct dt_dir *d, const struct dt_summary *s);
+};
+
+/// @brief options of a traversal. All pointers are borrowed and must remain valid.
+struct dt_options {
+  struct pool *pool;          ///< workers that read directories ahead of the walks (or NULL: the
+                              ///< walking thread reads them)
+  int readahead;              ///< maximum number of directories read ahead of each walk and not
+                              ///< yet visited (default: 16 per pool worker)
+  int walkers;                ///< maximum number of concurrent dt_walk() calls with their own
+                              ///< io_uring (default 1); further walks stat synchronously
+  int stat;                   ///< stat every entry (dt_entry.st); otherwise only entries without
+                              ///< d_type are stat'ed
+  int dirstat;                ///< stat every directory (dt_dir.st)
+  int uring;                  ///< stat through io_uring in batches, if the kernel supports it
+  int dir_order;              ///< stat in directory order instead of inode order
+  int timing;                 ///< measure the metadata lookups (dt_stats)
+  size_t spill;               ///< keep at most this many entries of a directory in memory; wider
+                              ///< directories are sorted in runs spilled to $TMPDIR (0: no limit)
+  const struct filter *filter;///< entry filter (or NULL)
+  const struct snapshot *snap;///< snapshot of a previous run to take unchanged directories from
+                              ///< (or NULL)
+  struct inoset *links;       ///< set of hard-linked inodes: the size of an inode with several
+                              ///< links is counted at its first link in display order only (or
+                              ///< NULL). Concurrent walks sharing the set count the first link
+                              ///< of whichever walk gets there first.
+  struct profile *profile;    ///< profile to count the phases of the traversal in (or NULL)
+};
+
+/// @brief statistics of a traversal
+struct dt_stats {
+  unsigned long long lookups; ///< number of metadata lookups (timing only)
+  unsigned long long t_lookup;///< time spent in metadata lookups (ns, timing only)
+  unsigned long long t_order; ///< time spent ordering lookups by inode (ns, timing only)
+  unsigned long long t_links; ///< time spent in hard link deduplication (ns, timing only)
+  unsigned long long link_bytes; ///< size of the hard links not counted
+  unsigned long snap_reused;  ///< number of directories taken from the snapshot
+  unsigned long spill_dirs;   ///< number of spilled directories
+  unsigned long spill_runs;   ///< number of runs of all spilled directories
+};
+
+/// @brief a traversal configuration shared by any number of (concurrent) walks. Directories are
+///        read with getdents64() and their entries stat'ed relative to the open directory, in
+///        inode order; with a pool, workers read the subdirectories ahead of the walk and the
+///        walk visits them in tree order as they complete.
+struct dirtree;
+
+/// @brief create a traversal configuration
+///
+/// @param opt options (copied)
+/// @retval configuration
+/// @retval NULL if out of memory
+struct dirtree *dt_create(const struct dt_options *opt);
+
+/// @brief walk the tree at @a path and call the visitor @a v. Several walks may run at the same
+///        time in different threads.
+///
+/// @param dt configuration
+/// @param path root of the walk
+/// @param depth depth of @a path for the depth filters (0 for a root; non-zero to walk a subtree
+///        found by an earlier walk)
+/// @param v visitor
+/// @param ctx context passed to the callbacks
+/// @retval DTW_STOP if a callback stopped the walk
+/// @retval DTW_CONTINUE otherwise
+/// @retval -1 if the walk failed (errno is set: ENOMEM)
+int dt_walk(struct dirtree *dt, const char *path, unsigned int depth, const struct dt_visitor *v,
+            void *ctx);
+
+/// @brief get entry @a i (in display order) of directory @a d during its enter() callback
+///
+/// @param d directory (not spilled)
+/// @param i index (0 .. d->count-1)
+/// @param e entry
+void dt_list(const struct dt_dir *d, int i, struct dt_entry *e);
+
+/// @brief add the totals in @a src to @a dst (e.g., to combine the summaries of several walks)
+///
+/// @param dst summary to update
+/// @param src summary to add
+void dt_summary_add(struct dt_summary *dst, const struct dt_summary *src);
+
+/// @brief get the statistics of all walks of @a dt so far
+///
+/// @param dt configuration
+/// @param st statistics
+void dt_stats(struct dirtree *dt, struct dt_stats *st);
+
+/// @brief release @a dt; no walk may be running
+///
+/// @param dt configuration or NULL
+void dt_free(struct dirtree *dt);
+
+#endif // __LIBDIRTREE_H__
@@ -0,0 +1,208 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief buffered output with hand-rolled formatting
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "outbuf.h"
+#include "profile.h"
+
+
+/// @brief abort the program on an unrecoverable error
+static void fail(const char *msg)
+{
+  if (msg) perror(msg);
+  else fprintf(stderr, "Out of memory\n");
+  exit(EXIT_FAILURE);
+}
+
+
+/// @brief write the @a cnt buffers in @a iov completely to the file descriptor of @a o
+static unsigned long long write_all(struct outbuf *o, struct iovec *iov, int cnt)
+{
+  unsigned long long total = 0;
+
+  if (o->err) return 0;
+
+  prof_enter(o->prof, PROF_WRITE);
+  while (cnt > 0) {
+    ssize_t res = writev(o->fd, iov, cnt);
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      if (!o->checked) fail("write");
+      o->err = errno;
+      break;
+    }
+    total += res;
+
+    // skip the buffers that have been written completely
+    while ((cnt > 0) && ((size_t)res >= iov->iov_len)) {
+      res -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov->iov_base = (char*)iov->iov_base + res;
+      iov->iov_len -= res;
+    }
+  }
+  prof_count(o->prof, PROF_WRITE, total);
+  prof_leave(o->prof);
+
+  return total;
+}
+
+
+void ob_init(struct outbuf *o, int fd, size_t size)
+{
+  o->fd = fd;
+  o->len = 0;
+  o->size = size;
+  o->written = 0;
+  o->prof = NULL;
+  o->checked = o->err = 0;
+  o->buf = malloc(size);
+  if (!o->buf) fail(NULL);
+}
+
+
+int ob_open(struct outbuf *o, int fd, size_t size)
+{
+  o->fd = fd;
+  o->len = 0;
+  o->size = size;
+  o->written = 0;
+  o->prof = NULL;
+  o->checked = 1;
+  o->err = 0;
+  o->buf = malloc(size);
+
+  return o->buf ? 0 : -1;
+}
+
+
+void ob_flush(struct outbuf *o)
+{
+  struct iovec iov = { o->buf, o->len };
+
+  if (o->len > 0) o->written += write_all(o, &iov, 1);
+  o->len = 0;
+}
+
+
+void ob_free(struct outbuf *o)
+{
+  ob_flush(o);
+  free(o->buf);
+  o->buf = NULL;
+  o->size = 0;
+}
+
+
+void ob_reserve(struct outbuf *o, size_t n)
+{
+  if (o->size - o->len >= n) return;
+
+  ob_flush(o);
+  if (o->size < n) {
+    free(o->buf);
+    o->size = n;
+    o->buf = malloc(n);
+    if (!o->buf) fail(NULL);
+  }
+}
+
+
+void ob_write(struct outbuf *o, const char *s, size_t n)
+{
+  if (n == 0) return;
+
+  if (o->size - o->len >= n) {
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+  } else if (n < o->size/2) {
+    ob_flush(o);
+    memcpy(o->buf, s, n);
+    o->len = n;
+  } else {
+    // large block: write buffer and block with a single writev() without copying
+    struct iovec iov[2] = { { o->buf, o->len }, { (void*)s, n } };
+    o->written += write_all(o, iov, 2);
+    o->len = 0;
+  }
+}
+
+
+void ob_fill(struct outbuf *o, char c, size_t n)
+{
+  while (n > 0) {
+    size_t chunk;
+
+    if (o->len == o->size) ob_flush(o);
+    chunk = o->size - o->len;
+    if (chunk > n) chunk = n;
+    memset(o->buf + o->len, c, chunk);
+    o->len += chunk;
+    n -= chunk;
+  }
+}
+
+
+void ob_left(struct outbuf *o, const char *s, size_t width)
+{
+  size_t n = strlen(s);
+
+  ob_write(o, s, n);
+  if (n < width) ob_fill(o, ' ', width - n);
+}
+
+
+void ob_right(struct outbuf *o, const char *s, size_t width)
+{
+  size_t n = strlen(s);
+
+  if (n < width) ob_fill(o, ' ', width - n);
+  ob_write(o, s, n);
+}
+
+
+/// @brief format @a v right-aligned into a field of @a width characters with optional minus sign
+static void put_number(struct outbuf *o, unsigned long long v, int neg, size_t width)
+{
+  char digits[24];
+  char *p = digits + sizeof(digits);
+  size_t n;
+
+  do {
+    *--p = '0' + (v % 10);
+    v /= 10;
+  } while (v > 0);
+  if (neg) *--p = '-';
+
+  n = digits + sizeof(digits) - p;
+  if (n < width) ob_fill(o, ' ', width - n);
+  ob_write(o, p, n);
+}
+
+
+void ob_uint(struct outbuf *o, unsigned long long v, size_t width)
+{
+  put_number(o, v, 0, width);
+}
+
+
+void ob_int(struct outbuf *o, long long v, size_t width)
+{
+  if (v < 0) put_number(o, -(unsigned long long)v, 1, width);
+  else put_number(o, (unsigned long long)v, 0, width);
+}
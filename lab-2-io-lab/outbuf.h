@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief buffered output with hand-rolled formatting
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __OUTBUF_H__
+#define __OUTBUF_H__
+
+#include <stddef.h>
+#include <string.h>
+
+struct profile;
+
+/// @brief output buffer. Output is collected in a large buffer and written to the file descriptor
+///        with write()/writev() when the buffer is full or flushed explicitly.
+struct outbuf {
+  int fd;                     ///< file descriptor to write to
+  char *buf;                  ///< buffer
+  size_t len;                 ///< number of bytes in buf
+  size_t size;                ///< allocated size of buf
+  unsigned long long written; ///< total number of bytes written to fd
+  struct profile *prof;       ///< profile the writes are counted in (or NULL)
+  int checked;                ///< write errors are stored in err instead of terminating the program
+  int err;                    ///< errno of the first failed write (checked only); later output is
+                              ///< discarded
+};
+
+/// @brief initialize output buffer @a o writing to @a fd. Terminates the program if out of memory
+///        or if a write fails.
+///
+/// @param o output buffer
+/// @param fd file descriptor
+/// @param size buffer size
+void ob_init(struct outbuf *o, int fd, size_t size);
+
+/// @brief initialize output buffer @a o writing to @a fd like ob_init(), but a failed write is
+///        stored in o->err instead of terminating the program
+///
+/// @param o output buffer
+/// @param fd file descriptor
+/// @param size buffer size
+/// @retval 0 on success
+/// @retval -1 if out of memory (errno is set)
+int ob_open(struct outbuf *o, int fd, size_t size);
+
+/// @brief write all buffered data to the file descriptor
+///
+/// @param o output buffer
+void ob_flush(struct outbuf *o);
+
+/// @brief flush and release the buffer
+///
+/// @param o output buffer
+void ob_free(struct outbuf *o);
+
+/// @brief make sure at least @a n bytes can be appended without flushing. Flushes the buffer or
+///        grows it if necessary.
+///
+/// @param o output buffer
+/// @param n number of bytes
+void ob_reserve(struct outbuf *o, size_t n);
+
+/// @brief append @a n bytes from @a s. Large blocks bypass the buffer (writev()).
+///
+/// @param o output buffer
+/// @param s data
+/// @param n number of bytes
+void ob_write(struct outbuf *o, const char *s, size_t n);
+
+/// @brief append character @a c @a n times
+///
+/// @param o output buffer
+/// @param c character
+/// @param n repeat count
+void ob_fill(struct outbuf *o, char c, size_t n);
+
+/// @brief append string @a s left-aligned in a field of @a width characters (like "%-*s")
+///
+/// @param o output buffer
+/// @param s string
+/// @param width minimum field width
+void ob_left(struct outbuf *o, const char *s, size_t width);
+
+/// @brief append string @a s right-aligned in a field of @a width characters (like "%*s")
+///
+/// @param o output buffer
+/// @param s string
+/// @param width minimum field width
+void ob_right(struct outbuf *o, const char *s, size_t width);
+
+/// @brief append unsigned integer @a v right-aligned in a field of @a width characters ("%*llu")
+///
+/// @param o output buffer
+/// @param v value
+/// @param width minimum field width
+void ob_uint(struct outbuf *o, unsigned long long v, size_t width);
+
+/// @brief append signed integer @a v right-aligned in a field of @a width characters ("%*lld")
+///
+/// @param o output buffer
+/// @param v value
+/// @param width minimum field width
+void ob_int(struct outbuf *o, long long v, size_t width);
+
+/// @brief append character @a c
+///
+/// @param o output buffer
+/// @param c character
+static inline void ob_putc(struct outbuf *o, char c)
+{
+  if (o->len == o->size) ob_flush(o);
+  o->buf[o->len++] = c;
+}
+
+/// @brief append string @a s
+///
+/// @param o output buffer
+/// @param s null-terminated string
+static inline void ob_puts(struct outbuf *o, const char *s)
+{
+  ob_write(o, s, strlen(s));
+}
+
+#endif // __OUTBUF_H__
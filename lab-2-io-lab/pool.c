@@ -0,0 +1,299 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief work-stealing thread pool
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include "pool.h"
+
+#define DQ_INITIAL  64        ///< initial capacity of a worker deque
+
+/// @brief a queued task
+struct task {
+  task_fn fn;                 ///< task function
+  void *arg;                  ///< argument to task function
+};
+
+/// @brief per-worker task deque. The owner pushes and pops at the bottom (LIFO, depth-first),
+///        thieves take from the top (FIFO, oldest and typically largest piece of work).
+struct deque {
+  pthread_mutex_t lock;       ///< protects all fields below
+  struct task *buf;           ///< circular task buffer
+  unsigned long cap;          ///< capacity of buf
+  unsigned long top;          ///< index of oldest task (steal end)
+  unsigned long bottom;       ///< index one past the newest task (owner end)
+};
+
+/// @brief worker thread argument
+struct worker {
+  struct pool *p;             ///< pool the worker belongs to
+  int id;                     ///< worker index
+};
+
+/// @brief thread pool
+struct pool {
+  int n;                      ///< number of workers
+  int running;                ///< number of worker threads started
+  pthread_t *threads;         ///< worker threads
+  struct worker *workers;     ///< worker thread arguments
+  struct deque *dq;           ///< one deque per worker
+
+  unsigned long queued;       ///< tasks currently sitting in a deque (atomic)
+  unsigned long active;       ///< submitted tasks that have not completed yet (atomic)
+  int sleepers;               ///< workers blocked on idle_cv (atomic)
+  unsigned int next;          ///< round-robin deque index for external submissions (atomic)
+  int stop;                   ///< set by pool_destroy() once all work is done
+
+  pthread_mutex_t idle_lock;  ///< protects stop and the two condition variables
+  pthread_cond_t idle_cv;     ///< signalled when work becomes available or on stop
+  pthread_cond_t done_cv;     ///< signalled when active drops to zero
+};
+
+static __thread int self = -1;            ///< worker index of the calling thread
+static __thread struct pool *self_pool;   ///< pool of the calling worker thread
+
+
+/// @brief push task @a t at the bottom of deque @a d. Grows the deque if it is full.
+///
+/// @retval 0 on success
+/// @retval -1 if the deque is full and out of memory
+static int dq_push(struct deque *d, struct task t)
+{
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom - d->top == d->cap) {
+    unsigned long ncap = d->cap*2;
+    struct task *nbuf = malloc(ncap*sizeof(struct task));
+    if (!nbuf) {
+      pthread_mutex_unlock(&d->lock);
+      return -1;
+    }
+    for (unsigned long i = d->top; i < d->bottom; i++) nbuf[i % ncap] = d->buf[i % d->cap];
+    free(d->buf);
+    d->buf = nbuf;
+    d->cap = ncap;
+  }
+  d->buf[d->bottom % d->cap] = t;
+  d->bottom++;
+  pthread_mutex_unlock(&d->lock);
+
+  return 0;
+}
+
+
+/// @brief pop the newest task from the bottom of deque @a d (owner side)
+///
+/// @retval 1 if a task was stored in @a t
+/// @retval 0 if the deque is empty
+static int dq_pop(struct deque *d, struct task *t)
+{
+  int res = 0;
+
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom > d->top) {
+    d->bottom--;
+    *t = d->buf[d->bottom % d->cap];
+    res = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return res;
+}
+
+
+/// @brief steal the oldest task from the top of deque @a d (thief side)
+///
+/// @retval 1 if a task was stored in @a t
+/// @retval 0 if the deque is empty
+static int dq_steal(struct deque *d, struct task *t)
+{
+  int res = 0;
+
+  if (pthread_mutex_trylock(&d->lock) != 0) return 0;
+  if (d->bottom > d->top) {
+    *t = d->buf[d->top % d->cap];
+    d->top++;
+    res = 1;
+  }
+  pthread_mutex_unlock(&d->lock);
+
+  return res;
+}
+
+
+/// @brief find work for worker @a id: own deque first, then the other workers' deques
+static int find_task(struct pool *p, int id, struct task *t)
+{
+  if (dq_pop(&p->dq[id], t)) return 1;
+
+  for (int i = 1; i < p->n; i++) {
+    if (dq_steal(&p->dq[(id + i) % p->n], t)) return 1;
+  }
+
+  return 0;
+}
+
+
+/// @brief worker thread main loop
+static void *worker_main(void *arg)
+{
+  struct worker *w = (struct worker*)arg;
+  struct pool *p = w->p;
+  struct task t;
+
+  self = w->id;
+  self_pool = p;
+
+  for (;;) {
+    if (find_task(p, self, &t)) {
+      __atomic_sub_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+      t.fn(t.arg);
+      if (__atomic_sub_fetch(&p->active, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&p->idle_lock);
+        pthread_cond_broadcast(&p->done_cv);
+        pthread_mutex_unlock(&p->idle_lock);
+      }
+      continue;
+    }
+
+    // nothing to run or steal: sleep until a task is submitted or the pool shuts down
+    int stop;
+    pthread_mutex_lock(&p->idle_lock);
+    __atomic_add_fetch(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+    while ((__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0) && !p->stop) {
+      pthread_cond_wait(&p->idle_cv, &p->idle_lock);
+    }
+    __atomic_sub_fetch(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+    stop = p->stop;
+    pthread_mutex_unlock(&p->idle_lock);
+
+    if (stop) break;
+  }
+
+  return NULL;
+}
+
+
+struct pool *pool_create(int nworkers)
+{
+  if (nworkers < 1) return NULL;
+
+  struct pool *p = calloc(1, sizeof(struct pool));
+  if (!p) return NULL;
+
+  p->n = nworkers;
+  p->threads = calloc(nworkers, sizeof(pthread_t));
+  p->workers = calloc(nworkers, sizeof(struct worker));
+  p->dq = calloc(nworkers, sizeof(struct deque));
+  if (!p->threads || !p->workers || !p->dq) {
+    free(p->dq);
+    free(p->workers);
+    free(p->threads);
+    free(p);
+    return NULL;
+  }
+
+  pthread_mutex_init(&p->idle_lock, NULL);
+  pthread_cond_init(&p->idle_cv, NULL);
+  pthread_cond_init(&p->done_cv, NULL);
+
+  for (int i = 0; i < nworkers; i++) {
+    pthread_mutex_init(&p->dq[i].lock, NULL);
+    p->dq[i].cap = DQ_INITIAL;
+    p->dq[i].buf = malloc(DQ_INITIAL*sizeof(struct task));
+  }
+  for (int i = 0; i < nworkers; i++) {
+    if (!p->dq[i].buf) {
+      pool_destroy(p);
+      return NULL;
+    }
+  }
+
+  // if a thread cannot be created, the workers started so far are stopped again
+  for (int i = 0; i < nworkers; i++) {
+    p->workers[i].p = p;
+    p->workers[i].id = i;
+    if (pthread_create(&p->threads[i], NULL, worker_main, &p->workers[i]) != 0) {
+      pool_destroy(p);
+      return NULL;
+    }
+    p->running++;
+  }
+
+  return p;
+}
+
+
+int pool_submit(struct pool *p, task_fn fn, void *arg)
+{
+  struct task t = { fn, arg };
+  int d;
+
+  if ((self_pool == p) && (self >= 0)) d = self;
+  else d = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED) % p->n;
+
+  __atomic_add_fetch(&p->active, 1, __ATOMIC_SEQ_CST);
+  if (dq_push(&p->dq[d], t) < 0) {
+    if (__atomic_sub_fetch(&p->active, 1, __ATOMIC_SEQ_CST) == 0) {
+      pthread_mutex_lock(&p->idle_lock);
+      pthread_cond_broadcast(&p->done_cv);
+      pthread_mutex_unlock(&p->idle_lock);
+    }
+    return -1;
+  }
+  __atomic_add_fetch(&p->queued, 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&p->sleepers, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&p->idle_lock);
+    pthread_cond_signal(&p->idle_cv);
+    pthread_mutex_unlock(&p->idle_lock);
+  }
+
+  return 0;
+}
+
+
+int pool_size(struct pool *p)
+{
+  return p->n;
+}
+
+
+int pool_worker_id(void)
+{
+  return self;
+}
+
+
+void pool_destroy(struct pool *p)
+{
+  if (!p) return;
+
+  pthread_mutex_lock(&p->idle_lock);
+  while (__atomic_load_n(&p->active, __ATOMIC_SEQ_CST) > 0) {
+    pthread_cond_wait(&p->done_cv, &p->idle_lock);
+  }
+  p->stop = 1;
+  pthread_cond_broadcast(&p->idle_cv);
+  pthread_mutex_unlock(&p->idle_lock);
+
+  for (int i = 0; i < p->running; i++) pthread_join(p->threads[i], NULL);
+
+  for (int i = 0; i < p->n; i++) {
+    pthread_mutex_destroy(&p->dq[i].lock);
+    free(p->dq[i].buf);
+  }
+  pthread_mutex_destroy(&p->idle_lock);
+  pthread_cond_destroy(&p->idle_cv);
+  pthread_cond_destroy(&p->done_cv);
+
+  free(p->dq);
+  free(p->workers);
+  free(p->threads);
+  free(p);
+}
@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief work-stealing thread pool
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+/// @brief task function executed by a worker thread
+typedef void (*task_fn)(void *arg);
+
+/// @brief opaque thread pool handle
+struct pool;
+
+/// @brief create a thread pool with @a nworkers worker threads. Each worker owns a deque of tasks;
+///        idle workers steal the oldest task from another worker's deque.
+///
+/// @param nworkers number of worker threads (>= 1)
+/// @retval pool handle on success
+/// @retval NULL if out of memory or if the threads cannot be created
+struct pool *pool_create(int nworkers);
+
+/// @brief submit a task to the pool. Called from a worker, the task is pushed onto the worker's own
+///        deque (and will be run next by that worker unless stolen). Called from any other thread,
+///        the task is distributed round-robin over the worker deques.
+///
+/// @param p pool
+/// @param fn task function
+/// @param arg argument passed to @a fn
+/// @retval 0 on success
+/// @retval -1 if out of memory; the task is not run
+int pool_submit(struct pool *p, task_fn fn, void *arg);
+
+/// @brief number of worker threads in the pool
+///
+/// @param p pool
+/// @retval number of workers
+int pool_size(struct pool *p);
+
+/// @brief index of the calling worker thread
+///
+/// @retval 0..pool_size()-1 if called from a worker thread
+/// @retval -1 if called from a thread that is not a pool worker
+int pool_worker_id(void);
+
+/// @brief wait until all submitted tasks have completed, then terminate the workers and release
+///        the pool
+///
+/// @param p pool
+void pool_destroy(struct pool *p);
+
+#endif // __POOL_H__
@@ -0,0 +1,244 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief per-phase profiling counters (--profile)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "profile.h"
+#include "util.h"
+
+#define PROF_DEPTH  16        ///< maximum nesting of phases per thread
+
+/// @brief counters of one thread. Only the owning thread updates them, so no atomics are needed
+///        on the hot path; they are summed up when the profile is printed.
+struct profthread {
+  struct profile *p;          ///< profile the counters belong to
+  unsigned long long ns[PROF_PHASES];    ///< time in each phase (ns)
+  unsigned long long calls[PROF_PHASES]; ///< number of times each phase was entered
+  unsigned long long items[PROF_PHASES]; ///< items processed in each phase
+  int stack[PROF_DEPTH];      ///< phases entered and not yet left
+  int depth;                  ///< number of phases entered and not yet left
+  unsigned long long since;   ///< time the current phase was (re)entered
+  struct profthread *next;    ///< next thread of the profile
+};
+
+/// @brief profile of a run
+struct profile {
+  pthread_mutex_t lock;       ///< protects threads, main and the largest directory
+  struct profthread *threads; ///< counters of all threads
+  unsigned long long main[PROF_PHASES]; ///< wall-clock time of the main phases (ns)
+  unsigned long max_count;    ///< number of entries of the largest directory (atomic)
+  char *max_dir;              ///< path of the largest directory (or NULL)
+};
+
+/// @brief names and item units of the phases
+static const struct {
+  const char *name;
+  const char *unit;
+} phases[PROF_PHASES] = {
+  [PROF_WALK] = { "walk", NULL },
+  [PROF_WAIT] = { "wait", NULL },
+  [PROF_OPEN] = { "open", NULL },
+  [PROF_READDIR] = { "readdir", "entries" },
+  [PROF_STAT] = { "stat", "lookups" },
+  [PROF_SORT] = { "sort", "entries" },
+  [PROF_SPILL] = { "spill", NULL },
+  [PROF_VISIT] = { "visit", NULL },
+  [PROF_IDS] = { "ids", NULL },
+  [PROF_WRITE] = { "write", "bytes" },
+  [PROF_SETUP] = { "setup", NULL },
+  [PROF_TRAVERSE] = { "traversal", NULL },
+  [PROF_REPORT] = { "report", NULL },
+};
+
+static __thread struct profthread *self; ///< counters of the calling thread
+static __thread struct profthread lost;  ///< counters of a thread that could not be registered;
+                                         ///< they are not reported
+
+
+/// @brief counters of the calling thread in profile @a p; registered on first use
+static struct profthread *thread(struct profile *p)
+{
+  struct profthread *t = self;
+
+  if (t && (t->p == p)) return t;
+
+  t = (struct profthread *)calloc(1, sizeof(struct profthread));
+  if (!t) return &lost;
+  t->p = p;
+  pthread_mutex_lock(&p->lock);
+  t->next = p->threads;
+  p->threads = t;
+  pthread_mutex_unlock(&p->lock);
+  self = t;
+
+  return t;
+}
+
+
+struct profile *prof_create(void)
+{
+  struct profile *p = (struct profile *)calloc(1, sizeof(struct profile));
+
+  if (!p) return NULL;
+  pthread_mutex_init(&p->lock, NULL);
+
+  return p;
+}
+
+
+void prof_push(struct profile *p, enum prof_phase ph)
+{
+  struct profthread *t = thread(p);
+  unsigned long long now = nsec();
+
+  // the enclosing phase is paused
+  if ((t->depth > 0) && (t->depth <= PROF_DEPTH)) t->ns[t->stack[t->depth-1]] += now - t->since;
+  if (t->depth < PROF_DEPTH) t->stack[t->depth] = ph;
+  t->depth++;
+  t->calls[ph]++;
+  t->since = now;
+}
+
+
+void prof_pop(struct profile *p)
+{
+  struct profthread *t = thread(p);
+  unsigned long long now = nsec();
+
+  if (t->depth == 0) return;
+  t->depth--;
+  if (t->depth < PROF_DEPTH) t->ns[t->stack[t->depth]] += now - t->since;
+  t->since = now;
+}
+
+
+void prof_items(struct profile *p, enum prof_phase ph, unsigned long long n)
+{
+  thread(p)->items[ph] += n;
+}
+
+
+void prof_add(struct profile *p, enum prof_phase ph, unsigned long long ns)
+{
+  if (!p) return;
+
+  pthread_mutex_lock(&p->lock);
+  p->main[ph] += ns;
+  pthread_mutex_unlock(&p->lock);
+}
+
+
+void prof_dir(struct profile *p, const char *path, size_t len, unsigned long count)
+{
+  if (count <= __atomic_load_n(&p->max_count, __ATOMIC_RELAXED)) return;
+
+  if ((len > 1) && (path[len-1] == '/')) len--;
+
+  pthread_mutex_lock(&p->lock);
+  if (count > p->max_count) {
+    // without memory, the directory reported stays the previous one
+    char *dir = (char *)realloc(p->max_dir, len+1);
+    if (dir) {
+      memcpy(dir, path, len);
+      dir[len] = '\0';
+      p->max_dir = dir;
+      __atomic_store_n(&p->max_count, count, __ATOMIC_RELAXED);
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+
+/// @brief print string @a s as a JSON string to @a f
+static void jsonString(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if ((c == '"') || (c == '\\')) fprintf(f, "\\%c", c);
+    else if (c < 0x20) fprintf(f, "\\u%04x", c);
+    else fputc(c, f);
+  }
+  fputc('"', f);
+}
+
+
+void prof_print(struct profile *p, FILE *f, int json)
+{
+  unsigned long long ns[PROF_PHASES] = { 0 }, calls[PROF_PHASES] = { 0 }, items[PROF_PHASES] = { 0 };
+  unsigned long long total = 0, wall = 0;
+
+  for (struct profthread *t = p->threads; t; t = t->next) {
+    for (int i = 0; i < PROF_MAIN; i++) {
+      ns[i] += t->ns[i];
+      calls[i] += t->calls[i];
+      items[i] += t->items[i];
+    }
+  }
+  for (int i = 0; i < PROF_MAIN; i++) total += ns[i];
+  for (int i = PROF_MAIN; i < PROF_PHASES; i++) wall += p->main[i];
+
+  if (json) {
+    fprintf(f, "{\"main\":{");
+    for (int i = PROF_MAIN; i < PROF_PHASES; i++) {
+      fprintf(f, "\"%s\":%.6f,", phases[i].name, p->main[i]/1e9);
+    }
+    fprintf(f, "\"total\":%.6f},\"phases\":{", wall/1e9);
+    for (int i = 0; i < PROF_MAIN; i++) {
+      fprintf(f, "%s\"%s\":{\"calls\":%llu,\"seconds\":%.6f", i ? "," : "", phases[i].name,
+              calls[i], ns[i]/1e9);
+      if (phases[i].unit) fprintf(f, ",\"%s\":%llu", phases[i].unit, items[i]);
+      fputc('}', f);
+    }
+    fprintf(f, "},\"bytes_written\":%llu,\"largest_dir\":", items[PROF_WRITE]);
+    if (p->max_dir) {
+      fprintf(f, "{\"path\":");
+      jsonString(f, p->max_dir);
+      fprintf(f, ",\"entries\":%lu}", p->max_count);
+    }
+    else fprintf(f, "null");
+    fprintf(f, "}\n");
+    return;
+  }
+
+  fprintf(f, "Profile:\n");
+  for (int i = PROF_MAIN; i < PROF_PHASES; i++) {
+    fprintf(f, "  %-10s %26.3f s\n", phases[i].name, p->main[i]/1e9);
+  }
+  fprintf(f, "  %-10s %26.3f s\n", "total", wall/1e9);
+  fprintf(f, "  phase           calls        time (s)   per call (us)  share  items\n");
+  for (int i = 0; i < PROF_MAIN; i++) {
+    fprintf(f, "  %-10s %10llu %15.3f %15.2f %5.1f%%", phases[i].name, calls[i], ns[i]/1e9,
+            calls[i] ? ns[i]/1e3/calls[i] : 0.0, total ? 100.0*ns[i]/total : 0.0);
+    if (phases[i].unit) fprintf(f, "  %llu %s", items[i], phases[i].unit);
+    fputc('\n', f);
+  }
+  fprintf(f, "  (time of all threads; a phase does not include the phases nested in it)\n");
+  fprintf(f, "  bytes written: %llu\n", items[PROF_WRITE]);
+  if (p->max_dir) fprintf(f, "  largest directory: %lu entries in '%s'\n", p->max_count, p->max_dir);
+}
+
+
+void prof_free(struct profile *p)
+{
+  if (!p) return;
+
+  while (p->threads) {
+    struct profthread *t = p->threads;
+    p->threads = t->next;
+    free(t);
+  }
+  free(p->max_dir);
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+}
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief per-phase profiling counters (--profile)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+/// @brief phases. The thread phases nest: a thread is in one phase at a time, and the time of a
+///        nested phase is not counted in the enclosing one. The main phases are wall-clock
+///        sections of the program and are added with prof_add().
+enum prof_phase {
+  PROF_WALK,                  ///< walk bookkeeping (dt_walk() outside the phases below)
+  PROF_WAIT,                  ///< walk waiting for a directory read ahead by the workers
+  PROF_OPEN,                  ///< opening directories (openat, fstat)
+  PROF_READDIR,               ///< reading directory entries (getdents64); items: entries
+  PROF_STAT,                  ///< metadata lookups (fstatat, io_uring); items: lookups
+  PROF_SORT,                  ///< filtering and sorting entries, hard link deduplication;
+                              ///< items: entries
+  PROF_SPILL,                 ///< writing and merging spilled runs
+  PROF_VISIT,                 ///< visitor callbacks (dirtree: output formatting)
+  PROF_IDS,                   ///< user and group name lookups
+  PROF_WRITE,                 ///< writing output (write, writev); items: bytes
+  PROF_SETUP,                 ///< main: options, preloading, snapshot and traversal setup
+  PROF_TRAVERSE,              ///< main: traversal and printing of all roots
+  PROF_REPORT,                ///< main: reports (--top, --dupes) and saving the snapshot
+  PROF_PHASES
+};
+
+#define PROF_MAIN   PROF_SETUP ///< first main phase
+
+/// @brief profile of a run: counters of all threads that entered a phase
+struct profile;
+
+/// @brief create a profile. Threads whose counters cannot be allocated are not counted.
+///
+/// @retval profile
+/// @retval NULL if out of memory
+struct profile *prof_create(void);
+
+/// @brief enter phase @a ph in the calling thread (use prof_enter())
+void prof_push(struct profile *p, enum prof_phase ph);
+
+/// @brief leave the current phase of the calling thread (use prof_leave())
+void prof_pop(struct profile *p);
+
+/// @brief add @a n items to phase @a ph of the calling thread (use prof_count())
+void prof_items(struct profile *p, enum prof_phase ph, unsigned long long n);
+
+/// @brief enter thread phase @a ph; nothing if @a p is NULL
+static inline void prof_enter(struct profile *p, enum prof_phase ph)
+{
+  if (p) prof_push(p, ph);
+}
+
+/// @brief leave the phase entered last; nothing if @a p is NULL
+static inline void prof_leave(struct profile *p)
+{
+  if (p) prof_pop(p);
+}
+
+/// @brief count @a n items of phase @a ph; nothing if @a p is NULL
+static inline void prof_count(struct profile *p, enum prof_phase ph, unsigned long long n)
+{
+  if (p) prof_items(p, ph, n);
+}
+
+/// @brief add @a ns nanoseconds of wall-clock time to main phase @a ph (thread-safe)
+///
+/// @param p profile or NULL
+/// @param ph main phase
+/// @param ns time in nanoseconds
+void prof_add(struct profile *p, enum prof_phase ph, unsigned long long ns);
+
+/// @brief offer a directory for the largest directory of the run (thread-safe)
+///
+/// @param p profile
+/// @param path path of the directory (a trailing '/' is dropped)
+/// @param len length of path
+/// @param count number of entries
+void prof_dir(struct profile *p, const char *path, size_t len, unsigned long count);
+
+/// @brief print profile @a p as a table or as a JSON object. No thread may be in a phase.
+///
+/// @param p profile
+/// @param f stream
+/// @param json non-zero for JSON
+void prof_print(struct profile *p, FILE *f, int json);
+
+/// @brief release profile @a p
+///
+/// @param p profile or NULL
+void prof_free(struct profile *p);
+
+#endif // __PROFILE_H__
@@ -0,0 +1,227 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief machine-readable entry records (NDJSON and binary)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <dirent.h>
+#include "record.h"
+
+
+/// @brief JSON name of the file type in @a mode
+static const char *typeName(mode_t mode)
+{
+  if (S_ISREG(mode)) return "file";
+  if (S_ISDIR(mode)) return "dir";
+  if (S_ISLNK(mode)) return "link";
+  if (S_ISFIFO(mode)) return "fifo";
+  if (S_ISSOCK(mode)) return "sock";
+  if (S_ISCHR(mode)) return "chr";
+  if (S_ISBLK(mode)) return "blk";
+  return "unknown";
+}
+
+
+/// @brief length of the valid UTF-8 sequence at @a s (@a n bytes available)
+///
+/// @retval 1..4 length of the sequence
+/// @retval 0 if @a s does not start with a valid sequence (stray continuation byte, truncated or
+///         overlong sequence, surrogate, or a code point above U+10FFFF)
+static size_t utf8Len(const unsigned char *s, size_t n)
+{
+  unsigned char c = s[0];
+  uint32_t cp, min;
+  size_t len;
+
+  if (c < 0x80) return 1;
+  if ((c & 0xe0) == 0xc0) { len = 2; cp = c & 0x1f; min = 0x80; }
+  else if ((c & 0xf0) == 0xe0) { len = 3; cp = c & 0x0f; min = 0x800; }
+  else if ((c & 0xf8) == 0xf0) { len = 4; cp = c & 0x07; min = 0x10000; }
+  else return 0;
+
+  if (len > n) return 0;
+  for (size_t i = 1; i < len; i++) {
+    if ((s[i] & 0xc0) != 0x80) return 0;
+    cp = (cp << 6) | (s[i] & 0x3f);
+  }
+  if ((cp < min) || (cp > 0x10ffff) || ((cp >= 0xd800) && (cp <= 0xdfff))) return 0;
+
+  return len;
+}
+
+
+/// @brief append @a n bytes of @a s as the contents of a JSON string. Quotes, backslashes and
+///        control characters are escaped; every byte that is not part of a valid UTF-8 sequence
+///        is replaced by U+FFFD, so the output is always valid UTF-8. All other bytes are copied
+///        unchanged.
+///
+/// @retval number of bytes replaced by U+FFFD
+static size_t jsonEscape(struct outbuf *o, const char *s, size_t n)
+{
+  static const char hex[] = "0123456789abcdef";
+  size_t run = 0, invalid = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = s[i];
+    if (c >= 0x80) {
+      size_t len = utf8Len((const unsigned char*)s + i, n - i);
+      if (len) {
+        i += len - 1;
+        continue;
+      }
+    }
+    else if ((c >= 0x20) && (c != '"') && (c != '\\')) continue;
+
+    // copy the run of plain characters before c
+    ob_write(o, s + run, i - run);
+    run = i + 1;
+
+    if (c >= 0x80) {
+      ob_write(o, "\\ufffd", 6);
+      invalid++;
+      continue;
+    }
+    ob_putc(o, '\\');
+    switch (c) {
+      case '"':  ob_putc(o, '"'); break;
+      case '\\': ob_putc(o, '\\'); break;
+      case '\n': ob_putc(o, 'n'); break;
+      case '\t': ob_putc(o, 't'); break;
+      default:
+        ob_write(o, "u00", 3);
+        ob_putc(o, hex[c >> 4]);
+        ob_putc(o, hex[c & 0xf]);
+    }
+  }
+  ob_write(o, s + run, n - run);
+
+  return invalid;
+}
+
+
+/// @brief append the base64 encoding (RFC 4648, padded) of @a a (@a na bytes) followed by @a b
+///        (@a nb bytes)
+static void base64(struct outbuf *o, const char *a, size_t na, const char *b, size_t nb)
+{
+  static const char tab[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t n = na + nb;
+
+  for (size_t i = 0; i < n; i += 3) {
+    uint32_t v = 0;
+
+    for (size_t k = i; k < i + 3; k++) {
+      unsigned char c = k < na ? a[k] : (k < n ? b[k - na] : 0);
+      v = (v << 8) | c;
+    }
+
+    char q[4] = { tab[(v >> 18) & 63], tab[(v >> 12) & 63],
+                  i + 1 < n ? tab[(v >> 6) & 63] : '=', i + 2 < n ? tab[v & 63] : '=' };
+    ob_write(o, q, 4);
+  }
+}
+
+
+/// @brief append the path @a dir + @a name as the "path" field of a JSON record. If the path is
+///        not valid UTF-8, the exact bytes follow base64-encoded in a "path_b64" field.
+static void jsonPath(struct outbuf *o, const char *dir, size_t dlen, const char *name, size_t nlen)
+{
+  size_t invalid;
+
+  ob_write(o, "{\"path\":\"", 9);
+  invalid = jsonEscape(o, dir, dlen);
+  invalid += jsonEscape(o, name, nlen);
+  ob_putc(o, '"');
+
+  if (invalid) {
+    ob_write(o, ",\"path_b64\":\"", 13);
+    base64(o, dir, dlen, name, nlen);
+    ob_putc(o, '"');
+  }
+}
+
+
+/// @brief append a binary record with path @a dir + @a name
+static void binRecord(struct outbuf *o, struct binrec *r, const char *dir, size_t dlen,
+                      const char *name, size_t nlen)
+{
+  static const char zero[8];
+  size_t len = sizeof(struct binrec) + dlen + nlen + 1;
+  size_t pad = (8 - (len & 7)) & 7;
+
+  r->len = (uint32_t)(len + pad);
+  r->plen = (uint32_t)(dlen + nlen);
+  memset(r->reserved, 0, sizeof(r->reserved));
+
+  ob_write(o, (const char*)r, sizeof(struct binrec));
+  ob_write(o, dir, dlen);
+  ob_write(o, name, nlen);
+  ob_write(o, zero, pad + 1);
+}
+
+
+void rec_begin(struct outbuf *o, enum recformat fmt)
+{
+  if (fmt == REC_BIN) {
+    struct binheader h = { BIN_MAGIC, BIN_VERSION, BIN_BOM };
+    ob_write(o, (const char*)&h, sizeof(h));
+  }
+}
+
+
+void rec_entry(struct outbuf *o, enum recformat fmt, const char *dir, size_t dlen,
+               const char *name, unsigned int depth, const struct stat *st)
+{
+  if (fmt == REC_BIN) {
+    struct binrec r;
+
+    r.uid = st->st_uid;
+    r.gid = st->st_gid;
+    r.size = st->st_size;
+    r.blocks = st->st_blocks;
+    r.depth = depth;
+    r.type = IFTODT(st->st_mode);
+    binRecord(o, &r, dir, dlen, name, strlen(name));
+  } else {
+    jsonPath(o, dir, dlen, name, strlen(name));
+    ob_write(o, ",\"type\":\"", 9);
+    ob_puts(o, typeName(st->st_mode));
+    ob_write(o, "\",\"uid\":", 8);
+    ob_uint(o, st->st_uid, 0);
+    ob_write(o, ",\"gid\":", 7);
+    ob_uint(o, st->st_gid, 0);
+    ob_write(o, ",\"size\":", 8);
+    ob_int(o, st->st_size, 0);
+    ob_write(o, ",\"blocks\":", 10);
+    ob_uint(o, st->st_blocks, 0);
+    ob_write(o, ",\"depth\":", 9);
+    ob_uint(o, depth, 0);
+    ob_write(o, "}\n", 2);
+  }
+}
+
+
+void rec_error(struct outbuf *o, enum recformat fmt, const char *path, size_t plen,
+               unsigned int depth, int err)
+{
+  if (fmt == REC_BIN) {
+    struct binrec r;
+
+    memset(&r, 0, sizeof(r));
+    r.size = err;
+    r.depth = depth;
+    r.type = REC_ERROR;
+    binRecord(o, &r, path, plen, "", 0);
+  } else {
+    jsonPath(o, path, plen, "", 0);
+    ob_write(o, ",\"depth\":", 9);
+    ob_uint(o, depth, 0);
+    ob_write(o, ",\"error\":\"", 10);
+    ob_puts(o, strerror(err));
+    ob_write(o, "\"}\n", 3);
+  }
+}
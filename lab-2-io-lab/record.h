@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief machine-readable entry records (NDJSON and binary)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __RECORD_H__
+#define __RECORD_H__
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "outbuf.h"
+
+/// @brief binary stream layout (--format=bin)
+///
+/// A stream starts with a struct binheader followed by one record per entry. Each record is a
+/// struct binrec followed by the path (binrec.plen bytes plus a terminating null byte) and zero
+/// padding up to the next multiple of 8 bytes; binrec.len is the total size of the record. All
+/// integers are in host byte order (see binheader.bom), records are 8-byte aligned so that a
+/// mapped stream can be scanned in place by skipping binrec.len bytes at a time.
+#define BIN_MAGIC   "DTRB"    ///< binheader.magic
+#define BIN_VERSION 1         ///< binheader.version
+#define BIN_BOM     0xfeff    ///< binheader.bom as written by the producer
+
+/// @brief header of a binary stream
+struct binheader {
+  char magic[4];              ///< BIN_MAGIC
+  uint16_t version;           ///< BIN_VERSION
+  uint16_t bom;               ///< BIN_BOM; reads 0xfffe if the byte order differs
+};
+
+/// @brief fixed-size part of a binary record
+struct binrec {
+  uint32_t len;               ///< total length of the record (header, path, padding)
+  uint32_t plen;              ///< length of the path (without the null byte)
+  uint32_t uid;               ///< user id
+  uint32_t gid;               ///< group id
+  uint64_t size;              ///< size in bytes; errno value for error records
+  uint64_t blocks;            ///< number of 512-byte blocks
+  uint32_t depth;             ///< depth below the root (entries of the root have depth 1)
+  uint8_t type;               ///< file type (DT_*), or REC_ERROR
+  uint8_t reserved[3];        ///< zero
+};
+
+#define REC_ERROR   0xff      ///< binrec.type of a directory that could not be read
+
+/// @brief record formats
+enum recformat {
+  REC_NDJSON,                 ///< one JSON object per line
+  REC_BIN,                    ///< length-prefixed binary records
+};
+
+/// @brief write the stream header of format @a fmt (if any)
+///
+/// @param o output buffer
+/// @param fmt record format
+void rec_begin(struct outbuf *o, enum recformat fmt);
+
+/// @brief write the record of an entry. The path is the concatenation of @a dir (@a dlen bytes,
+///        including the trailing separator) and @a name.
+///
+/// @param o output buffer
+/// @param fmt record format
+/// @param dir path of the directory containing the entry
+/// @param dlen length of @a dir
+/// @param name entry name
+/// @param depth depth of the entry
+/// @param st metadata of the entry
+void rec_entry(struct outbuf *o, enum recformat fmt, const char *dir, size_t dlen,
+               const char *name, unsigned int depth, const struct stat *st);
+
+/// @brief write the record of a directory that could not be read
+///
+/// @param o output buffer
+/// @param fmt record format
+/// @param path path of the directory
+/// @param plen length of @a path
+/// @param depth depth of the directory
+/// @param err error code (errno)
+void rec_error(struct outbuf *o, enum recformat fmt, const char *path, size_t plen,
+               unsigned int depth, int err);
+
+#endif // __RECORD_H__
@@ -0,0 +1,381 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief persistent directory snapshot index (--snapshot)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include "snapshot.h"
+#include "util.h"
+
+#define ALIGN8(s)   (((s) + 7) & ~(uint64_t)7)
+
+/// @brief a mapped snapshot file
+struct snapshot {
+  void *map;                  ///< mapping of the file
+  size_t size;                ///< size of the mapping
+  const struct snaphdr *hdr;  ///< header
+  const struct snapdir *dirs; ///< directory records
+  const uint32_t *slots;      ///< hash index
+  const struct snapent *ents; ///< entry records
+  const char *strs;           ///< string table
+};
+
+/// @brief snapshot under construction
+struct snapwriter {
+  unsigned int flags;         ///< SNAP_* flags
+  struct snapdir *dirs;       ///< directory records
+  size_t ndirs, sdirs;        ///< number of used/allocated directory records
+  struct snapent *ents;       ///< entry records
+  size_t nents, sents;        ///< number of used/allocated entry records
+  char *strs;                 ///< string table
+  size_t nstrs, sstrs;        ///< used/allocated size of the string table
+  uint32_t *path;             ///< indices of the directories entered and not yet left
+  size_t depth, spath;        ///< number of used/allocated elements of path
+};
+
+
+/// @brief make sure array @a p with @a *cap elements of @a esize bytes can hold @a n elements
+static void *grow(void *p, size_t *cap, size_t n, size_t esize)
+{
+  if (n <= *cap) return p;
+
+  size_t ncap = *cap ? *cap : 256;
+  while (ncap < n) ncap *= 2;
+  p = realloc(p, ncap*esize);
+  if (!p) oom();
+  *cap = ncap;
+
+  return p;
+}
+
+
+/// @brief check that table [@a off, @a off + @a n * @a esize) lies within a file of @a size bytes
+static int inFile(uint64_t off, uint64_t n, uint64_t esize, size_t size)
+{
+  return (off <= size) && (off % 8 == 0) && (n <= (size - off) / esize);
+}
+
+
+struct snapshot *snap_load(const char *fn)
+{
+  struct snapshot *s;
+  const struct snaphdr *h;
+  struct stat st;
+  void *map;
+  int fd = open(fn, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) return NULL;
+  if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(struct snaphdr))) {
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+
+  // the tables are used as they are; only check that they lie within the file
+  h = (const struct snaphdr *)map;
+  if (memcmp(h->magic, SNAP_MAGIC, 4) || (h->version != SNAP_VERSION) || (h->bom != SNAP_BOM) ||
+      (h->nslots == 0) || (h->nslots & (h->nslots - 1)) ||
+      !inFile(h->dirs, h->ndirs, sizeof(struct snapdir), st.st_size) ||
+      !inFile(h->slots, h->nslots, sizeof(uint32_t), st.st_size) ||
+      !inFile(h->ents, h->nents, sizeof(struct snapent), st.st_size) ||
+      !inFile(h->strs, h->strsize, 1, st.st_size)) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  s = malloc(sizeof(struct snapshot));
+  if (!s) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  s->map = map;
+  s->size = st.st_size;
+  s->hdr = h;
+  s->dirs = (const struct snapdir *)((const char *)map + h->dirs);
+  s->slots = (const uint32_t *)((const char *)map + h->slots);
+  s->ents = (const struct snapent *)((const char *)map + h->ents);
+  s->strs = (const char *)map + h->strs;
+
+  return s;
+}
+
+
+void snap_unload(struct snapshot *s)
+{
+  if (!s) return;
+
+  munmap(s->map, s->size);
+  free(s);
+}
+
+
+const struct snapdir *snap_find(const struct snapshot *s, const struct stat *st)
+{
+  const struct snaphdr *h = s->hdr;
+  uint32_t i = snapHash(st->st_dev, st->st_ino, h->nslots);
+
+  // changes in the second the snapshot run started may not have changed the timestamps
+  if ((st->st_mtim.tv_sec >= h->time) || (st->st_ctim.tv_sec >= h->time)) return NULL;
+
+  for (uint32_t probes = 0; (probes < h->nslots) && s->slots[i]; probes++) {
+    uint32_t k = s->slots[i] - 1;
+    const struct snapdir *d = &s->dirs[k];
+
+    if ((k < h->ndirs) && (d->dev == (uint64_t)st->st_dev) && (d->ino == (uint64_t)st->st_ino)) {
+      if ((d->mtime != st->st_mtim.tv_sec) || (d->mtime_ns != st->st_mtim.tv_nsec) ||
+          (d->ctime != st->st_ctim.tv_sec) || (d->ctime_ns != st->st_ctim.tv_nsec)) return NULL;
+      return d;
+    }
+    i = (i + 1) & (h->nslots - 1);
+  }
+
+  return NULL;
+}
+
+
+const struct snapent *snap_entries(const struct snapshot *s, const struct snapdir *d)
+{
+  if ((d->first > s->hdr->nents) || (d->count > s->hdr->nents - d->first)) return NULL;
+
+  return &s->ents[d->first];
+}
+
+
+const char *snap_name(const struct snapshot *s, const struct snapent *e)
+{
+  if ((uint64_t)e->name + e->len >= s->hdr->strsize) return NULL;
+  if (s->strs[e->name + e->len] != '\0') return NULL;
+
+  return s->strs + e->name;
+}
+
+
+/// @brief append the @a len bytes of @a name plus a null byte to the string table of @a w
+///
+/// @retval string table offset
+static uint32_t addString(struct snapwriter *w, const char *name, size_t len)
+{
+  uint32_t off = (uint32_t)w->nstrs;
+
+  w->strs = grow(w->strs, &w->sstrs, w->nstrs + len + 1, 1);
+  memcpy(w->strs + w->nstrs, name, len);
+  w->strs[w->nstrs + len] = '\0';
+  w->nstrs += len + 1;
+
+  return off;
+}
+
+
+struct snapwriter *snapw_create(unsigned int flags)
+{
+  struct snapwriter *w = calloc(1, sizeof(struct snapwriter));
+  if (!w) oom();
+
+  w->flags = flags;
+
+  return w;
+}
+
+
+void snapw_enter(struct snapwriter *w, const struct stat *st, const char *name)
+{
+  struct snapdir *d;
+
+  w->dirs = grow(w->dirs, &w->sdirs, w->ndirs + 1, sizeof(struct snapdir));
+  d = &w->dirs[w->ndirs];
+  memset(d, 0, sizeof(struct snapdir));
+  d->dev = st->st_dev;
+  d->ino = st->st_ino;
+  d->mtime = st->st_mtim.tv_sec;
+  d->mtime_ns = st->st_mtim.tv_nsec;
+  d->ctime = st->st_ctim.tv_sec;
+  d->ctime_ns = st->st_ctim.tv_nsec;
+  d->first = (uint32_t)w->nents;
+  d->name = addString(w, name, strlen(name));
+  d->parent = w->depth ? w->path[w->depth-1] : SNAP_NONE;
+
+  w->path = grow(w->path, &w->spath, w->depth + 1, sizeof(uint32_t));
+  w->path[w->depth++] = (uint32_t)w->ndirs++;
+}
+
+
+void snapw_entry(struct snapwriter *w, uint64_t ino, const char *name, size_t len, uint8_t type,
+                 const struct stat *st)
+{
+  struct snapdir *d = &w->dirs[w->path[w->depth-1]];
+  struct snapent *e;
+  mode_t mode = st ? st->st_mode : DTTOIF(type);
+
+  w->ents = grow(w->ents, &w->sents, w->nents + 1, sizeof(struct snapent));
+  e = &w->ents[w->nents++];
+  e->ino = ino;
+  e->name = addString(w, name, len);
+  e->len = (uint16_t)len;
+  e->type = type;
+  e->reserved = 0;
+  d->count++;
+
+  // same classification as the summary of dirtree
+  if (S_ISDIR(mode)) d->total.dirs++;
+  else if (S_ISFIFO(mode)) d->total.fifos++;
+  else if (S_ISLNK(mode)) d->total.links++;
+  else if (S_ISSOCK(mode)) d->total.socks++;
+  else if (!S_ISCHR(mode) && !S_ISBLK(mode)) d->total.files++;
+  if (st) {
+    d->total.size += st->st_size;
+    d->total.blocks += st->st_blocks;
+  }
+}
+
+
+void snapw_leave(struct snapwriter *w)
+{
+  uint32_t d = w->path[--w->depth];
+  const struct snaptotal *t = &w->dirs[d].total;
+  struct snaptotal *p;
+
+  if (w->dirs[d].parent == SNAP_NONE) return;
+
+  p = &w->dirs[w->dirs[d].parent].total;
+  p->files += t->files;
+  p->dirs += t->dirs;
+  p->links += t->links;
+  p->fifos += t->fifos;
+  p->socks += t->socks;
+  p->size += t->size;
+  p->blocks += t->blocks;
+}
+
+
+void snapw_merge(struct snapwriter *w, const struct snapwriter *src)
+{
+  uint32_t d0 = (uint32_t)w->ndirs, e0 = (uint32_t)w->nents, s0 = (uint32_t)w->nstrs;
+
+  w->dirs = grow(w->dirs, &w->sdirs, w->ndirs + src->ndirs, sizeof(struct snapdir));
+  w->ents = grow(w->ents, &w->sents, w->nents + src->nents, sizeof(struct snapent));
+  w->strs = grow(w->strs, &w->sstrs, w->nstrs + src->nstrs, 1);
+
+  // the records of src refer to each other by index; shift the indices past those of w
+  for (size_t i = 0; i < src->ndirs; i++) {
+    struct snapdir *d = &w->dirs[w->ndirs++];
+    *d = src->dirs[i];
+    d->first += e0;
+    d->name += s0;
+    if (d->parent != SNAP_NONE) d->parent += d0;
+  }
+  for (size_t i = 0; i < src->nents; i++) {
+    struct snapent *e = &w->ents[w->nents++];
+    *e = src->ents[i];
+    e->name += s0;
+  }
+  if (src->nstrs) memcpy(w->strs + w->nstrs, src->strs, src->nstrs);
+  w->nstrs += src->nstrs;
+}
+
+
+/// @brief write @a len bytes of @a buf followed by zero padding to the next multiple of 8
+static int writeTable(FILE *f, const void *buf, size_t len)
+{
+  static const char zero[8];
+  size_t pad = ALIGN8(len) - len;
+
+  if (len && (fwrite(buf, 1, len, f) != len)) return -1;
+  if (pad && (fwrite(zero, 1, pad, f) != pad)) return -1;
+
+  return 0;
+}
+
+
+int snapw_save(struct snapwriter *w, const char *fn, time_t start)
+{
+  struct snaphdr h;
+  uint32_t *slots;
+  char *tmp;
+  FILE *f;
+  int res = 0;
+
+  // offsets and counts are 32 bits wide
+  if ((w->ndirs >= SNAP_NONE/2) || (w->nents >= SNAP_NONE) || (w->nstrs >= SNAP_NONE)) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, SNAP_MAGIC, 4);
+  h.version = SNAP_VERSION;
+  h.bom = SNAP_BOM;
+  h.flags = w->flags;
+  h.ndirs = (uint32_t)w->ndirs;
+  h.nents = (uint32_t)w->nents;
+  h.time = start;
+  h.strsize = w->nstrs;
+
+  // hash index with a load factor of at most 1/2; the first record of a directory wins
+  h.nslots = 16;
+  while (h.nslots < 2*h.ndirs) h.nslots *= 2;
+  slots = calloc(h.nslots, sizeof(uint32_t));
+  if (!slots) oom();
+  for (uint32_t k = 0; k < h.ndirs; k++) {
+    uint32_t i = snapHash(w->dirs[k].dev, w->dirs[k].ino, h.nslots);
+    while (slots[i] &&
+           ((w->dirs[slots[i]-1].dev != w->dirs[k].dev) || (w->dirs[slots[i]-1].ino != w->dirs[k].ino))) {
+      i = (i + 1) & (h.nslots - 1);
+    }
+    if (!slots[i]) slots[i] = k + 1;
+  }
+
+  h.dirs = ALIGN8(sizeof(h));
+  h.slots = h.dirs + ALIGN8((uint64_t)h.ndirs*sizeof(struct snapdir));
+  h.ents = h.slots + ALIGN8((uint64_t)h.nslots*sizeof(uint32_t));
+  h.strs = h.ents + ALIGN8((uint64_t)h.nents*sizeof(struct snapent));
+
+  // write to a temporary file and rename it so that readers never see a partial snapshot
+  if (asprintf(&tmp, "%s.tmp", fn) < 0) oom();
+  f = fopen(tmp, "wb");
+  if (!f) res = -1;
+  else {
+    if ((writeTable(f, &h, sizeof(h)) < 0) ||
+        (writeTable(f, w->dirs, h.ndirs*sizeof(struct snapdir)) < 0) ||
+        (writeTable(f, slots, h.nslots*sizeof(uint32_t)) < 0) ||
+        (writeTable(f, w->ents, h.nents*sizeof(struct snapent)) < 0) ||
+        (writeTable(f, w->strs, w->nstrs) < 0)) res = -1;
+    if (fclose(f) != 0) res = -1;
+    if (res == 0) res = rename(tmp, fn);
+    if (res < 0) {
+      int err = errno;
+      unlink(tmp);
+      errno = err;
+    }
+  }
+
+  free(tmp);
+  free(slots);
+
+  return res;
+}
+
+
+void snapw_free(struct snapwriter *w)
+{
+  if (!w) return;
+
+  free(w->dirs);
+  free(w->ents);
+  free(w->strs);
+  free(w->path);
+  free(w);
+}
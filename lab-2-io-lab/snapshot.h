@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief persistent directory snapshot index (--snapshot)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+
+/// @brief snapshot file layout
+///
+/// A snapshot starts with a struct snaphdr followed by four tables at the offsets given in the
+/// header: the directory records (struct snapdir), a hash index over the directory records, the
+/// entry records (struct snapent) of all directories and a string table holding null-terminated
+/// names. All tables are 8-byte aligned and use host byte order, so a snapshot is used in place
+/// after mmap() without any parsing.
+///
+/// The hash index has snaphdr.nslots (a power of two) 32-bit slots, each holding 0 (empty) or
+/// the index of a directory record plus one. Directories are keyed by (dev, ino) and found with
+/// linear probing starting at snapHash().
+#define SNAP_MAGIC    "DTSN"  ///< snaphdr.magic
+#define SNAP_VERSION  1       ///< snaphdr.version
+#define SNAP_BOM      0xfeff  ///< snaphdr.bom as written by the producer
+#define SNAP_NONE     0xffffffffu ///< snapdir.parent of a root directory
+
+#define SNAP_SIZES    0x1     ///< snaphdr.flags: snaptotal.size and .blocks are valid
+
+/// @brief snapshot header
+struct snaphdr {
+  char magic[4];              ///< SNAP_MAGIC
+  uint16_t version;           ///< SNAP_VERSION
+  uint16_t bom;               ///< SNAP_BOM
+  uint32_t flags;             ///< SNAP_* flags
+  uint32_t ndirs;             ///< number of directory records
+  uint32_t nslots;            ///< number of hash index slots
+  uint32_t nents;             ///< number of entry records
+  int64_t time;               ///< start time of the run that wrote the snapshot
+  uint64_t strsize;           ///< size of the string table
+  uint64_t dirs;              ///< file offset of the directory records
+  uint64_t slots;             ///< file offset of the hash index
+  uint64_t ents;              ///< file offset of the entry records
+  uint64_t strs;              ///< file offset of the string table
+};
+
+/// @brief totals of a subtree (the directory and everything below it)
+struct snaptotal {
+  uint32_t files;             ///< number of files
+  uint32_t dirs;              ///< number of directories
+  uint32_t links;             ///< number of links
+  uint32_t fifos;             ///< number of pipes
+  uint32_t socks;             ///< number of sockets
+  uint32_t reserved;          ///< zero
+  uint64_t size;              ///< total size (in bytes), see SNAP_SIZES
+  uint64_t blocks;            ///< total number of blocks, see SNAP_SIZES
+};
+
+/// @brief directory record
+struct snapdir {
+  uint64_t dev;               ///< device
+  uint64_t ino;               ///< inode number
+  int64_t mtime;              ///< modification time (seconds)
+  int64_t ctime;              ///< status change time (seconds)
+  uint32_t mtime_ns;          ///< modification time (nanoseconds)
+  uint32_t ctime_ns;          ///< status change time (nanoseconds)
+  uint32_t first;             ///< index of the first entry record
+  uint32_t count;             ///< number of entries
+  uint32_t name;              ///< string table offset of the name (path for roots)
+  uint32_t parent;            ///< index of the parent directory record or SNAP_NONE
+  struct snaptotal total;     ///< totals of the subtree
+};
+
+/// @brief entry record. The entries of a directory are stored in display order.
+struct snapent {
+  uint64_t ino;               ///< inode number
+  uint32_t name;              ///< string table offset of the name
+  uint16_t len;               ///< length of the name
+  uint8_t type;               ///< file type (DT_*)
+  uint8_t reserved;           ///< zero
+};
+
+/// @brief hash index slot of directory (@a dev, @a ino) in a table with @a nslots slots
+static inline uint32_t snapHash(uint64_t dev, uint64_t ino, uint32_t nslots)
+{
+  return (uint32_t)(((ino ^ (dev << 32)) * 0x9e3779b97f4a7c15ull) >> 32) & (nslots - 1);
+}
+
+/// @brief a loaded (mapped) snapshot
+struct snapshot;
+
+/// @brief map snapshot file @a fn
+///
+/// @param fn file name
+/// @retval snapshot on success
+/// @retval NULL if the file does not exist or is not a valid snapshot of this version, or if out
+///         of memory
+struct snapshot *snap_load(const char *fn);
+
+/// @brief unmap snapshot @a s
+///
+/// @param s snapshot or NULL
+void snap_unload(struct snapshot *s);
+
+/// @brief look up the record of directory @a st. A record is only returned if the directory has
+///        not been modified since the snapshot was taken (same mtime and ctime) and it was not
+///        modified in the second the snapshot run started (where a change could go unnoticed).
+///
+/// @param s snapshot
+/// @param st metadata of the directory
+/// @retval directory record or NULL if the directory is unknown or has changed
+const struct snapdir *snap_find(const struct snapshot *s, const struct stat *st);
+
+/// @brief entry records of directory @a d
+///
+/// @param s snapshot
+/// @param d directory record
+/// @retval array of d->count entries or NULL if the record is corrupt
+const struct snapent *snap_entries(const struct snapshot *s, const struct snapdir *d);
+
+/// @brief name of entry @a e
+///
+/// @param s snapshot
+/// @param e entry record
+/// @retval null-terminated name or NULL if the record is corrupt
+const char *snap_name(const struct snapshot *s, const struct snapent *e);
+
+/// @brief builds a new snapshot in memory while the tree is walked
+struct snapwriter;
+
+/// @brief create a snapshot writer
+///
+/// @param flags SNAP_* flags of the snapshot
+/// @retval snapshot writer
+struct snapwriter *snapw_create(unsigned int flags);
+
+/// @brief enter directory @a st. The directory becomes a child of the directory entered last that
+///        has not been left yet (or a root). Its entries must be added next with snapw_entry(),
+///        before any other directory is entered.
+///
+/// @param w snapshot writer
+/// @param st metadata of the directory
+/// @param name name of the directory (path for roots)
+void snapw_enter(struct snapwriter *w, const struct stat *st, const char *name);
+
+/// @brief add an entry to the directory entered last
+///
+/// @param w snapshot writer
+/// @param ino inode number
+/// @param name entry name
+/// @param len length of @a name
+/// @param type file type (DT_*)
+/// @param st metadata of the entry or NULL if only the type is known
+void snapw_entry(struct snapwriter *w, uint64_t ino, const char *name, size_t len, uint8_t type,
+                 const struct stat *st);
+
+/// @brief leave the directory entered last once its subtree is complete; adds its totals to its
+///        parent
+///
+/// @param w snapshot writer
+void snapw_leave(struct snapwriter *w);
+
+/// @brief append the directories and entries of @a src to @a w. Both writers must be between
+///        trees (every directory entered has been left); @a src is left unchanged.
+///
+/// @param w snapshot writer
+/// @param src snapshot writer whose records are appended
+void snapw_merge(struct snapwriter *w, const struct snapwriter *src);
+
+/// @brief write the snapshot to file @a fn (atomically, through a temporary file)
+///
+/// @param w snapshot writer
+/// @param fn file name
+/// @param start start time of the run
+/// @retval 0 on success
+/// @retval -1 on error (errno is set)
+int snapw_save(struct snapwriter *w, const char *fn, time_t start);
+
+/// @brief release snapshot writer @a w
+///
+/// @param w snapshot writer or NULL
+void snapw_free(struct snapwriter *w);
+
+#endif // __SNAPSHOT_H__
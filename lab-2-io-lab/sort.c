@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief key-prefix sort of directory entries
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#include <string.h>
+#include "sort.h"
+
+#define INSERTION_MAX 32      ///< ranges up to this size are sorted by insertion sort
+
+
+/// @brief the (up to) 8 bytes at @a s as a big-endian number; stops at the terminating null byte
+static uint64_t load8(const char *s)
+{
+  uint64_t v = 0;
+  int i;
+
+  for (i = 0; (i < 8) && s[i]; i++) v = (v << 8) | (unsigned char)s[i];
+
+  return i ? v << (8*(8 - i)) : 0;
+}
+
+
+/// @brief non-zero if one of the bytes of @a v is zero
+static int hasZero(uint64_t v)
+{
+  return ((v - 0x0101010101010101ull) & ~v & 0x8080808080808080ull) != 0;
+}
+
+
+uint64_t sort_key(const char *name, int dir)
+{
+  return ((uint64_t)(dir == 0) << 63) | (load8(name) >> 1);
+}
+
+
+/// @brief sort the @a n elements of @a a by key (insertion sort)
+static void insertionSort(struct sortkey *a, size_t n)
+{
+  for (size_t i = 1; i < n; i++) {
+    struct sortkey x = a[i];
+    size_t j = i;
+    while ((j > 0) && (a[j-1].key > x.key)) {
+      a[j] = a[j-1];
+      j--;
+    }
+    a[j] = x;
+  }
+}
+
+
+/// @brief sort the @a n elements of @a a by key (LSD radix sort, one byte per pass). Passes over
+///        bytes that are equal in all keys (common prefixes, short names) are skipped.
+static void radixSort(struct sortkey *a, struct sortkey *tmp, size_t n)
+{
+  size_t count[8][256];
+  struct sortkey *src = a, *dst = tmp;
+
+  memset(count, 0, sizeof(count));
+  for (size_t i = 0; i < n; i++) {
+    uint64_t k = a[i].key;
+    for (int b = 0; b < 8; b++) count[b][(k >> (8*b)) & 0xff]++;
+  }
+
+  for (int b = 0; b < 8; b++) {
+    size_t *c = count[b], sum = 0;
+
+    if (c[(a[0].key >> (8*b)) & 0xff] == n) continue;
+
+    for (int v = 0; v < 256; v++) {
+      size_t t = c[v];
+      c[v] = sum;
+      sum += t;
+    }
+    for (size_t i = 0; i < n; i++) dst[c[(src[i].key >> (8*b)) & 0xff]++] = src[i];
+
+    struct sortkey *t = src;
+    src = dst;
+    dst = t;
+  }
+
+  if (src != a) memcpy(a, src, n*sizeof(struct sortkey));
+}
+
+
+/// @brief sort the @a n elements of @a a by key
+static void sortRange(struct sortkey *a, struct sortkey *tmp, size_t n)
+{
+  if (n <= INSERTION_MAX) insertionSort(a, n);
+  else radixSort(a, tmp, n);
+}
+
+
+/// @brief @a a is sorted by keys formed from the name bytes at offset @a depth; sort each group of
+///        equal keys by the following bytes of the names
+static void refine(struct sortkey *a, struct sortkey *tmp, size_t n, size_t depth,
+                   sort_name_fn name, void *ctx)
+{
+  size_t i = 0;
+
+  while (i < n) {
+    size_t j = i + 1;
+    while ((j < n) && (a[j].key == a[i].key)) j++;
+
+    if (j - i > 1) {
+      // the first key holds the directory bit and only 7 full name bytes
+      uint64_t prefix = depth ? a[i].key : (a[i].key << 1) | 0xff;
+      size_t next = depth ? depth + 8 : 7;
+
+      // if the names end within the prefix, they are all equal
+      if (!hasZero(prefix)) {
+        for (size_t k = i; k < j; k++) a[k].key = load8(name(ctx, a[k].idx) + next);
+        sortRange(a + i, tmp, j - i);
+        refine(a + i, tmp, j - i, next, name, ctx);
+      }
+    }
+    i = j;
+  }
+}
+
+
+void sort_keys(struct sortkey *a, struct sortkey *tmp, size_t n, sort_name_fn name, void *ctx)
+{
+  if (n < 2) return;
+
+  sortRange(a, tmp, n);
+  refine(a, tmp, n, 0, name, ctx);
+}
+
+
+void sort_by_key(struct sortkey *a, struct sortkey *tmp, size_t n)
+{
+  if (n < 2) return;
+
+  sortRange(a, tmp, n);
+}
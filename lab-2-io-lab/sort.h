@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief key-prefix sort of directory entries
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __SORT_H__
+#define __SORT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief sort element: key prefix and index of the entry
+///
+/// The key of an entry is its name as a big-endian number with the directory bit folded into the
+/// most significant bit: bit 63 is 0 for directories and 1 for everything else, bits 62..0 hold
+/// the first 63 bits of the name (padded with zeroes). Comparing keys as integers thus orders
+/// directories first and then by name (as strcmp() would) as far as the prefix reaches.
+struct sortkey {
+  uint64_t key;               ///< key prefix, see sort_key()
+  uint32_t idx;               ///< index of the entry
+  uint32_t reserved;          ///< unused (keeps the element 16 bytes)
+};
+
+/// @brief callback returning the name of entry @a idx
+typedef const char *(*sort_name_fn)(void *ctx, uint32_t idx);
+
+/// @brief key prefix of an entry
+///
+/// @param name entry name
+/// @param dir non-zero if the entry is a directory
+/// @retval key
+uint64_t sort_key(const char *name, int dir);
+
+/// @brief sort @a n elements by key; names are only looked up for elements whose key prefixes
+///        are equal. Uses an LSD radix sort over the key bytes (skipping bytes that are equal in
+///        all keys) and refines groups of equal keys on the next 8 bytes of their names.
+///
+/// @param a elements to sort
+/// @param tmp scratch array of @a n elements
+/// @param n number of elements
+/// @param name callback returning the name of an entry
+/// @param ctx context passed to @a name
+void sort_keys(struct sortkey *a, struct sortkey *tmp, size_t n, sort_name_fn name, void *ctx);
+
+/// @brief sort @a n elements by key only (the order of equal keys is unspecified)
+///
+/// @param a elements to sort
+/// @param tmp scratch array of @a n elements
+/// @param n number of elements
+void sort_by_key(struct sortkey *a, struct sortkey *tmp, size_t n);
+
+#endif // __SORT_H__
@@ -0,0 +1,394 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief sorted runs of directory entries spilled to a temporary file
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "outbuf.h"
+#include "spill.h"
+
+#define SPILL_WBUF    (256*1024) ///< size of the write buffer
+#define SPILL_RBUF    (64*1024)  ///< maximum size of the read buffer of each run during the merge
+#define SPILL_RMIN    (4*1024)   ///< minimum size of the read buffer of each run (holds at least
+                                 ///< one record of a name of NAME_MAX bytes)
+#define SPILL_MERGE   (4*1024*1024) ///< memory for the read buffers of all runs of a merge
+#define SPILL_FANIN   (SPILL_MERGE/SPILL_RMIN) ///< maximum number of runs merged at once
+#define ALIGN8(s)     (((s) + 7) & ~(size_t)7)
+
+/// @brief record header in the spill file; followed by the null-terminated name and padding to
+///        the next multiple of 8 bytes
+struct spillrec {
+  uint64_t ino;               ///< inode number
+  uint64_t dev;               ///< st_dev
+  uint64_t size;              ///< st_size
+  uint64_t blocks;            ///< st_blocks
+  uint32_t mode;              ///< st_mode
+  uint32_t uid;               ///< st_uid
+  uint32_t gid;               ///< st_gid
+  uint16_t len;               ///< length of the name
+  uint8_t type;               ///< file type (DT_*)
+  uint8_t flags;              ///< SR_* flags
+};
+
+/// @brief spill record flags; the upper bits hold spillent.flags
+#define SR_STAT       0x1     ///< the metadata fields are valid
+#define SR_SHIFT      1       ///< position of spillent.flags
+
+/// @brief read position in one run during the merge
+struct cursor {
+  off_t off;                  ///< file offset of the next byte to read into buf
+  off_t end;                  ///< end of the run
+  char *buf;                  ///< read buffer
+  size_t size;                ///< size of buf
+  size_t pos;                 ///< offset of the current record in buf
+  size_t len;                 ///< number of valid bytes in buf
+  struct spillent ent;        ///< current entry
+  struct stat st;             ///< metadata of the current entry
+};
+
+struct spill {
+  int fd;                     ///< temporary file
+  struct outbuf out;          ///< write buffer while runs are added
+  off_t *runs;                ///< start offset of each run, plus the end of the last run
+  int nruns;                  ///< number of runs, including those written by merge passes
+  int added;                  ///< number of runs added with spill_endrun()
+  int sruns;                  ///< allocated size of runs
+  off_t start;                ///< start offset of the current run
+  struct cursor *cur;         ///< one cursor per run being merged
+  int ncur;                   ///< number of cursors
+  int *heap;                  ///< binary min-heap of cursor indices (merge)
+  int nheap;                  ///< number of cursors in the heap
+  int last;                   ///< cursor of the entry returned last, or -1
+};
+
+
+int spill_tmpfile(void)
+{
+  const char *dir = getenv("TMPDIR");
+  int fd;
+
+  if (!dir || !*dir) dir = "/tmp";
+
+  // an O_TMPFILE file never has a name; otherwise remove the name right away
+  fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    char *path;
+    if (asprintf(&path, "%s/dirtree-XXXXXX", dir) < 0) {
+      errno = ENOMEM;
+      return -1;
+    }
+    fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0) unlink(path);
+    free(path);
+  }
+
+  return fd;
+}
+
+
+struct spill *spill_create(void)
+{
+  struct spill *s;
+  int fd = spill_tmpfile();
+
+  if (fd < 0) return NULL;
+
+  s = calloc(1, sizeof(struct spill));
+  if (!s || (ob_open(&s->out, fd, SPILL_WBUF) < 0)) {
+    free(s);
+    close(fd);
+    errno = ENOMEM;
+    return NULL;
+  }
+  s->fd = fd;
+  s->last = -1;
+
+  return s;
+}
+
+
+void spill_add(struct spill *s, const struct spillent *e)
+{
+  static const char zero[8];
+  struct spillrec r;
+  size_t len = sizeof(r) + e->len + 1;
+
+  memset(&r, 0, sizeof(r));
+  r.ino = e->ino;
+  r.len = e->len;
+  r.type = e->type;
+  r.flags = (uint8_t)(e->flags << SR_SHIFT);
+  if (e->st) {
+    r.flags |= SR_STAT;
+    r.dev = e->st->st_dev;
+    r.mode = e->st->st_mode;
+    r.uid = e->st->st_uid;
+    r.gid = e->st->st_gid;
+    r.size = e->st->st_size;
+    r.blocks = e->st->st_blocks;
+  }
+
+  ob_write(&s->out, (const char *)&r, sizeof(r));
+  ob_write(&s->out, e->name, e->len);
+  ob_write(&s->out, zero, ALIGN8(len) - len + 1);
+}
+
+
+/// @brief current write offset of spill file @a s
+static off_t tell(const struct spill *s)
+{
+  return (off_t)(s->out.written + s->out.len);
+}
+
+
+/// @brief end the current run of spill file @a s
+///
+/// @retval 0 on success
+/// @retval -1 if a write of the run failed or out of memory (errno is set)
+static int endRun(struct spill *s)
+{
+  if (s->out.err) {
+    errno = s->out.err;
+    return -1;
+  }
+  if (s->nruns + 2 > s->sruns) {
+    int n = s->sruns ? s->sruns*2 : 16;
+    off_t *runs = realloc(s->runs, n*sizeof(off_t));
+    if (!runs) return -1;
+    s->runs = runs;
+    s->sruns = n;
+  }
+
+  s->runs[s->nruns++] = s->start;
+  s->start = tell(s);
+  s->runs[s->nruns] = s->start;
+
+  return 0;
+}
+
+
+int spill_endrun(struct spill *s)
+{
+  if (endRun(s) < 0) return -1;
+  s->added++;
+
+  return 0;
+}
+
+
+int spill_runs(const struct spill *s)
+{
+  return s->added;
+}
+
+
+/// @brief make the next record of cursor @a c its current entry
+///
+/// @retval 1 on success
+/// @retval 0 if the run is exhausted
+/// @retval -1 on read error
+static int load(struct spill *s, struct cursor *c)
+{
+  struct spillrec r;
+  size_t need;
+
+  // make sure the record header and then the whole record are in the buffer
+  for (need = sizeof(r); ; need = ALIGN8(sizeof(r) + r.len + 1)) {
+    while (c->len - c->pos < need) {
+      size_t keep = c->len - c->pos;
+      ssize_t got;
+
+      if (c->off >= c->end) return keep ? (errno = EIO, -1) : 0;
+      memmove(c->buf, c->buf + c->pos, keep);
+      c->pos = 0;
+      c->len = keep;
+      size_t want = c->size - keep;
+      if ((off_t)want > c->end - c->off) want = c->end - c->off;
+      got = pread(s->fd, c->buf + keep, want, c->off);
+      if (got < 0) {
+        if (errno == EINTR) continue;
+        return -1;
+      }
+      if (got == 0) {
+        errno = EIO;
+        return -1;
+      }
+      c->off += got;
+      c->len += got;
+    }
+    memcpy(&r, c->buf + c->pos, sizeof(r));
+    if (need >= sizeof(r) + r.len + 1) break;
+  }
+
+  c->ent.ino = r.ino;
+  c->ent.name = c->buf + c->pos + sizeof(r);
+  c->ent.len = r.len;
+  c->ent.type = r.type;
+  c->ent.flags = r.flags >> SR_SHIFT;
+  c->ent.st = NULL;
+  if (r.flags & SR_STAT) {
+    memset(&c->st, 0, sizeof(c->st));
+    c->st.st_dev = r.dev;
+    c->st.st_ino = r.ino;
+    c->st.st_mode = r.mode;
+    c->st.st_uid = r.uid;
+    c->st.st_gid = r.gid;
+    c->st.st_size = r.size;
+    c->st.st_blocks = r.blocks;
+    c->ent.st = &c->st;
+  }
+  c->pos += need;
+
+  return 1;
+}
+
+
+/// @brief non-zero if the current entry of cursor @a a is displayed before that of cursor @a b
+///        (directories first, then by name)
+static int before(const struct spill *s, int a, int b)
+{
+  const struct spillent *e1 = &s->cur[a].ent;
+  const struct spillent *e2 = &s->cur[b].ent;
+
+  if ((e1->type == DT_DIR) != (e2->type == DT_DIR)) return e1->type == DT_DIR;
+
+  return strcmp(e1->name, e2->name) < 0;
+}
+
+
+/// @brief restore the heap property below position @a i
+static void siftDown(struct spill *s, int i)
+{
+  for (;;) {
+    int l = 2*i + 1, m = i;
+    if ((l < s->nheap) && before(s, s->heap[l], s->heap[m])) m = l;
+    if ((l+1 < s->nheap) && before(s, s->heap[l+1], s->heap[m])) m = l+1;
+    if (m == i) break;
+
+    int t = s->heap[i];
+    s->heap[i] = s->heap[m];
+    s->heap[m] = t;
+    i = m;
+  }
+}
+
+
+/// @brief release the cursors of the runs being merged
+static void closeRuns(struct spill *s)
+{
+  for (int i = 0; i < s->ncur; i++) free(s->cur[i].buf);
+  free(s->cur);
+  free(s->heap);
+  s->cur = NULL;
+  s->heap = NULL;
+  s->ncur = s->nheap = 0;
+  s->last = -1;
+}
+
+
+/// @brief prepare to read the @a n runs starting at run @a first in merged order. The runs share
+///        SPILL_MERGE bytes of read buffers, at least SPILL_RMIN and at most SPILL_RBUF each.
+///
+/// @retval 0 on success
+/// @retval -1 on read error or if out of memory (errno is set)
+static int openRuns(struct spill *s, int first, int n)
+{
+  size_t size = SPILL_MERGE/(n ? n : 1);
+
+  if (size < SPILL_RMIN) size = SPILL_RMIN;
+  if (size > SPILL_RBUF) size = SPILL_RBUF;
+
+  s->cur = calloc(n ? n : 1, sizeof(struct cursor));
+  s->heap = malloc((n ? n : 1)*sizeof(int));
+  if (!s->cur || !s->heap) return -1;
+  s->ncur = n;
+
+  for (int i = 0; i < n; i++) {
+    struct cursor *c = &s->cur[i];
+    c->off = s->runs[first+i];
+    c->end = s->runs[first+i+1];
+    c->size = size;
+    c->buf = malloc(size);
+    if (!c->buf) return -1;
+
+    int res = load(s, c);
+    if (res < 0) return -1;
+    if (res > 0) s->heap[s->nheap++] = i;
+  }
+  for (int i = s->nheap/2 - 1; i >= 0; i--) siftDown(s, i);
+
+  return 0;
+}
+
+
+int spill_merge(struct spill *s)
+{
+  int first = 0;
+
+  // with more than SPILL_FANIN runs, merge passes combine groups of SPILL_FANIN runs into longer
+  // runs appended to the file, so that the final merge reads at most SPILL_FANIN runs
+  while (s->nruns - first > SPILL_FANIN) {
+    int end = s->nruns, n, res;
+    struct spillent e;
+
+    for (; first < end; first += n) {
+      n = end - first < SPILL_FANIN ? end - first : SPILL_FANIN;
+
+      ob_flush(&s->out);
+      if (openRuns(s, first, n) < 0) return -1;
+      while ((res = spill_next(s, &e)) > 0) spill_add(s, &e);
+      closeRuns(s);
+      if ((res < 0) || (endRun(s) < 0)) return -1;
+    }
+  }
+  ob_free(&s->out);
+  if (s->out.err) {
+    errno = s->out.err;
+    return -1;
+  }
+
+  return openRuns(s, first, s->nruns - first);
+}
+
+
+int spill_next(struct spill *s, struct spillent *e)
+{
+  // advance the run that supplied the previous entry
+  if (s->last >= 0) {
+    int res = load(s, &s->cur[s->last]);
+    if (res < 0) return -1;
+    if (res == 0) s->heap[0] = s->heap[--s->nheap];
+    siftDown(s, 0);
+    s->last = -1;
+  }
+
+  if (s->nheap == 0) return 0;
+
+  s->last = s->heap[0];
+  *e = s->cur[s->last].ent;
+
+  return 1;
+}
+
+
+void spill_free(struct spill *s)
+{
+  if (!s) return;
+
+  if (s->out.buf) free(s->out.buf);
+  closeRuns(s);
+  free(s->runs);
+  close(s->fd);
+  free(s);
+}
@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief sorted runs of directory entries spilled to a temporary file
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __SPILL_H__
+#define __SPILL_H__
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+/// @brief a directory entry written to or read from a spill file
+struct spillent {
+  uint64_t ino;               ///< inode number
+  const char *name;           ///< null-terminated name
+  unsigned short len;         ///< length of the name
+  unsigned char type;         ///< file type (DT_*)
+  unsigned char flags;        ///< entry flags of the caller (bits 0..6), preserved
+  const struct stat *st;      ///< metadata or NULL. Only st_dev, st_mode, st_uid, st_gid, st_size
+                              ///< and st_blocks are preserved; st_ino is set to ino.
+};
+
+/// @brief temporary file holding sorted runs of entries
+struct spill;
+
+/// @brief create an unnamed temporary file in $TMPDIR or /tmp (also used for other temporary
+///        output)
+///
+/// @retval file descriptor (open for reading and writing) on success
+/// @retval -1 on error (errno is set)
+int spill_tmpfile(void);
+
+/// @brief create an (unnamed) spill file in $TMPDIR or /tmp
+///
+/// @retval spill file on success
+/// @retval NULL on error (errno is set)
+struct spill *spill_create(void);
+
+/// @brief append entry @a e to the current run of spill file @a s. The entries of a run must be
+///        added in display order: directories first, then by name. A failed write is reported by
+///        spill_endrun().
+///
+/// @param s spill file
+/// @param e entry
+void spill_add(struct spill *s, const struct spillent *e);
+
+/// @brief end the current run of spill file @a s; the next entry starts a new run
+///
+/// @param s spill file
+/// @retval 0 on success
+/// @retval -1 if the entries could not be written or out of memory (errno is set)
+int spill_endrun(struct spill *s);
+
+/// @brief prepare to read the entries of all runs of @a s in merged order. The read buffers of a
+///        merge take at most 4 MiB; with more than 1024 runs, groups of 1024 runs are first
+///        merged into longer runs appended to the file.
+///
+/// @param s spill file
+/// @retval 0 on success
+/// @retval -1 on a read or write error or if out of memory (errno is set)
+int spill_merge(struct spill *s);
+
+/// @brief read the next entry in merged order. The name and metadata of the entry stay valid until
+///        the next call.
+///
+/// @param s spill file
+/// @param e entry
+/// @retval 1 on success
+/// @retval 0 if there are no more entries
+/// @retval -1 on error (errno is set)
+int spill_next(struct spill *s, struct spillent *e);
+
+/// @brief number of runs added to spill file @a s (without those of merge passes)
+///
+/// @param s spill file
+/// @retval number of runs
+int spill_runs(const struct spill *s);
+
+/// @brief close and release spill file @a s
+///
+/// @param s spill file or NULL
+void spill_free(struct spill *s);
+
+#endif // __SPILL_H__
@@ -0,0 +1,133 @@
+#!/bin/bash
+#---------------------------------------------------------------------------------------------------
+# Lab 2: I/O Lab                          Fall 2020                               System Programming
+#
+# traversal benchmark: generates a synthetic tree (tools/mktree) and runs dirtree on it in tree,
+# summary and verbose mode with warm and cold caches. Every run is reported on one line:
+#
+#   mode cache entries seconds entries/s syscalls syscalls/entry maxrss(KiB)
+#
+# The times are the median of the runs, the system calls are counted once per mode by tracing
+# dirtree (tools/benchrun -s). The tree only depends on the parameters, so results of different
+# commits are comparable when the same parameters are used on the same machine.
+#
+# Cold runs drop the page, dentry and inode caches before each run; this requires root. Otherwise
+# only warm runs are made.
+#
+
+TOOLS=${0%/*}
+DIRTREE=${TOOLS}/../dirtree
+WORKDIR=${TMPDIR:-/tmp}/dirtree-bench
+DEPTH=3
+FANOUT=10
+FILES=100
+LENGTH=8-16
+SYMLINKS=5
+HARDLINKS=0
+FIFOS=1
+SEED=1
+RUNS=3
+MODES="tree summary verbose"
+OPTIONS=
+
+function usage() {
+  echo "Usage: $0 [-d DEPTH] [-f FANOUT] [-n FILES] [-l LEN[-LEN]] [-L PCT] [-H PCT] [-p PCT]"
+  echo "       [-S SEED] [-r RUNS] [-m MODES] [-o 'DIRTREE OPTIONS'] [-b DIRTREE] [-w WORKDIR]"
+  echo
+  echo "The tree parameters are those of tools/mktree; the tree is generated in WORKDIR once and"
+  echo "reused. MODES is a list of tree, summary and verbose (default all). RUNS is the number of"
+  echo "timed runs per mode and cache state (default $RUNS). The DIRTREE OPTIONS (e.g. '-j 8')"
+  echo "are added to every run."
+  exit 1
+}
+
+while getopts "d:f:n:l:L:H:p:S:r:m:o:b:w:h" opt; do
+  case $opt in
+    d) DEPTH=$OPTARG ;;
+    f) FANOUT=$OPTARG ;;
+    n) FILES=$OPTARG ;;
+    l) LENGTH=$OPTARG ;;
+    L) SYMLINKS=$OPTARG ;;
+    H) HARDLINKS=$OPTARG ;;
+    p) FIFOS=$OPTARG ;;
+    S) SEED=$OPTARG ;;
+    r) RUNS=$OPTARG ;;
+    m) MODES=$OPTARG ;;
+    o) OPTIONS=$OPTARG ;;
+    b) DIRTREE=$OPTARG ;;
+    w) WORKDIR=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+
+for tool in "$TOOLS/mktree" "$TOOLS/benchrun" "$DIRTREE"; do
+  if [[ ! -x $tool ]]; then
+    echo "Cannot execute '$tool' (run 'make bench')."
+    exit 1
+  fi
+done
+
+# generate the tree unless a previous run did; the counts of mktree are kept next to it
+SPEC=d${DEPTH}-f${FANOUT}-n${FILES}-l${LENGTH}-L${SYMLINKS}-H${HARDLINKS}-p${FIFOS}-S${SEED}
+TREE=$WORKDIR/$SPEC
+if [[ ! -r $TREE.counts ]]; then
+  echo "Generating tree '$TREE'..."
+  mkdir -p "$WORKDIR" && rm -rf "$TREE" || exit 1
+  "$TOOLS/mktree" -d $DEPTH -f $FANOUT -n $FILES -l $LENGTH -L $SYMLINKS -H $HARDLINKS \
+    -p $FIFOS -S $SEED "$TREE" > "$TREE.counts.tmp" || exit 1
+  mv "$TREE.counts.tmp" "$TREE.counts"
+fi
+read -a COUNTS < "$TREE.counts"
+ENTRIES=${COUNTS[11]}
+
+# cold runs need permission to drop the caches
+COLD=
+if [[ -w /proc/sys/vm/drop_caches ]]; then
+  COLD=cold
+fi
+
+function dropCaches() {
+  sync
+  echo 3 > /proc/sys/vm/drop_caches
+}
+
+# median of the arguments
+function median() {
+  printf "%s\n" "$@" | sort -g | awk '{ v[NR] = $1 } END { print v[int((NR+1)/2)] }'
+}
+
+REV=$(git -C "$TOOLS" describe --always --dirty 2>/dev/null || echo unknown)
+echo "# dirtree benchmark, revision $REV, $(date -u +%Y-%m-%dT%H:%M:%SZ), $(nproc) cpus"
+echo "# tree $SPEC: ${COUNTS[*]}"
+echo "# options '$OPTIONS', $RUNS runs, ${COLD:-warm only (cannot drop caches)}"
+printf "%-8s %-5s %10s %8s %10s %10s %8s %10s\n" \
+  mode cache entries seconds entries/s syscalls sc/entry maxrss
+for mode in $MODES; do
+  case $mode in
+    tree) FLAGS=-t ;;
+    summary) FLAGS=-s ;;
+    verbose) FLAGS=-v ;;
+    *) echo "Unknown mode '$mode'."; exit 1 ;;
+  esac
+
+  # count the system calls once; the tracing run also warms the caches
+  OUT=$("$TOOLS/benchrun" -s "$DIRTREE" $FLAGS $OPTIONS "$TREE") || exit 1
+  read -a R <<< "$OUT"
+  SYSCALLS=${R[4]}
+
+  for cache in warm $COLD; do
+    TIMES=()
+    RSS=0
+    for ((i=0; i<RUNS; i++)); do
+      [[ $cache == cold ]] && dropCaches
+      OUT=$("$TOOLS/benchrun" "$DIRTREE" $FLAGS $OPTIONS "$TREE") || exit 1
+      read -a R <<< "$OUT"
+      TIMES+=(${R[0]})
+      (( R[3] > RSS )) && RSS=${R[3]}
+    done
+    T=$(median "${TIMES[@]}")
+    awk -v m=$mode -v c=$cache -v e=$ENTRIES -v t=$T -v s=$SYSCALLS -v r=$RSS 'BEGIN {
+      printf "%-8s %-5s %10d %8.3f %10.0f %10d %8.3f %10d\n", m, c, e, t, (t > 0 ? e/t : 0), s, s/e, r
+    }'
+  done
+done
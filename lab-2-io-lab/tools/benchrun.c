@@ -0,0 +1,151 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief run a command and report its wall time, CPU time, peak RSS and number of system calls
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+//
+// The system calls are counted by tracing the command and all its threads with ptrace(); this
+// slows the command down considerably, so counting runs are not timed. Standard output of the
+// command is discarded.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+
+/// @brief current time of the monotonic clock in seconds
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+/// @brief resume the traced threads of the command until it exits and count their system call
+///        stops (one at the entry and one at the exit of each call)
+///
+/// @param pid process id of the command
+/// @param status exit status of the command
+/// @param ru resource usage of the command
+/// @retval number of system call stops
+static unsigned long long trace(pid_t pid, int *status, struct rusage *ru)
+{
+  unsigned long long stops = 0;
+  int st;
+
+  ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+  ptrace(PTRACE_SYSCALL, pid, 0, 0);
+
+  for(;;){
+    struct rusage r;
+    pid_t tid = wait4(-1, &st, __WALL, &r);
+    int sig = 0;
+
+    if (tid < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (WIFEXITED(st) || WIFSIGNALED(st)) {
+      if (tid == pid) {
+        *status = st;
+        *ru = r;
+      }
+      continue;
+    }
+    if (!WIFSTOPPED(st)) continue;
+
+    // system call stops, clone events and the initial stop of new threads are swallowed; any
+    // other signal is delivered
+    sig = WSTOPSIG(st);
+    if (sig == (SIGTRAP | 0x80)) {
+      stops++;
+      sig = 0;
+    }
+    else if ((sig == SIGTRAP) || (sig == SIGSTOP)) sig = 0;
+    ptrace(PTRACE_SYSCALL, tid, 0, sig);
+  }
+
+  return stops;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int count = 0, first = 1, status = 0;
+  unsigned long long stops = 0;
+  struct rusage ru;
+  double t0, t1;
+  pid_t pid;
+
+  if ((argc > 1) && !strcmp(argv[1], "-s")) {
+    count = 1;
+    first++;
+  }
+  if (first >= argc) {
+    fprintf(stderr, "Usage %s [-s] command [args...]\n"
+                    "Run command with standard output discarded and print 'wall user sys maxrss\n"
+                    "syscalls' (seconds, KiB). With -s, the system calls are counted (slow; the\n"
+                    "times are then not meaningful), otherwise syscalls is '-'.\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  t0 = now();
+  pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return EXIT_FAILURE;
+  }
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) dup2(null, STDOUT_FILENO);
+    if (count) {
+      ptrace(PTRACE_TRACEME, 0, 0, 0);
+      raise(SIGSTOP);
+    }
+    execvp(argv[first], &argv[first]);
+    perror(argv[first]);
+    _exit(127);
+  }
+
+  memset(&ru, 0, sizeof(ru));
+  if (count) {
+    int st;
+    if ((waitpid(pid, &st, __WALL) < 0) || !WIFSTOPPED(st)) {
+      fprintf(stderr, "Cannot trace '%s'\n", argv[first]);
+      return EXIT_FAILURE;
+    }
+    stops = trace(pid, &status, &ru);
+  }
+  else {
+    while ((wait4(pid, &status, 0, &ru) < 0) && (errno == EINTR));
+  }
+  t1 = now();
+
+  if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+    fprintf(stderr, "'%s' failed\n", argv[first]);
+    return EXIT_FAILURE;
+  }
+
+  printf("%.3f %.3f %.3f %ld ", t1 - t0, ru.ru_utime.tv_sec + ru.ru_utime.tv_usec/1e6,
+         ru.ru_stime.tv_sec + ru.ru_stime.tv_usec/1e6, ru.ru_maxrss);
+  if (count) printf("%llu\n", (stops + 1)/2);
+  else printf("-\n");
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+#!/bin/bash
+#---------------------------------------------------------------------------------------------------
+# Lab 2: I/O Lab                          Fall 2020                               System Programming
+#
+# regression checks of dirtree (make check). Every check builds the trees it needs in a temporary
+# directory and prints one line with 'ok' or 'FAILED' and the reason. The exit status is the number
+# of failed checks.
+#
+
+TOOLS=${0%/*}
+DIRTREE=${TOOLS}/../dirtree
+WORKDIR=
+
+function usage() {
+  echo "Usage: $0 [-b DIRTREE] [-w WORKDIR]"
+  echo
+  echo "The trees are generated in a new directory in WORKDIR (default \$TMPDIR) that is removed"
+  echo "at the end."
+  exit 1
+}
+
+while getopts "b:w:h" opt; do
+  case $opt in
+    b) DIRTREE=$OPTARG ;;
+    w) WORKDIR=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+
+for tool in "$TOOLS/mktree" "$TOOLS/benchrun" "$DIRTREE"; do
+  if [[ ! -x $tool ]]; then
+    echo "Cannot execute '$tool' (run 'make check')."
+    exit 1
+  fi
+done
+
+TMP=$(mktemp -d "${WORKDIR:-${TMPDIR:-/tmp}}/dirtree-check.XXXXXX") || exit 1
+trap 'rm -rf "$TMP"' EXIT
+FAILED=0
+
+# report the result of check $1: ok if $2 is empty, otherwise the reason $2
+function result() {
+  if [[ -z $2 ]]; then
+    printf "%-40s ok\n" "$1"
+  else
+    printf "%-40s FAILED: %s\n" "$1" "$2"
+    ((FAILED++))
+  fi
+}
+
+# peak RSS (KiB) of dirtree with options $1 on tree $2
+function maxrss() {
+  local OUT
+  OUT=$("$TOOLS/benchrun" "$DIRTREE" $1 "$2") || return 1
+  read -a R <<< "$OUT"
+  echo ${R[3]}
+}
+
+
+# the directories read ahead by the workers are bounded: the peak RSS of a parallel run must not
+# grow with the size of the tree
+function checkReadahead() {
+  local SMALL=$TMP/ra-small LARGE=$TMP/ra-large
+  local MSG=
+
+  "$TOOLS/mktree" -d 3 -f 8 -n 50 "$SMALL" > /dev/null &&
+  "$TOOLS/mktree" -d 4 -f 8 -n 50 "$LARGE" > /dev/null || { result "$1" "cannot generate trees"; return; }
+
+  for opts in "-v -j 4" "-s -j 4"; do
+    local S L
+    S=$(maxrss "$opts" "$SMALL") && L=$(maxrss "$opts" "$LARGE") || { MSG="dirtree failed"; break; }
+    # 8x the entries; allow 50% plus 2 MiB of noise
+    if (( L > S*3/2 + 2048 )); then
+      MSG="'$opts': peak RSS $S KiB on the small tree, $L KiB on a tree 8x as large"
+      break
+    fi
+  done
+  result "$1" "$MSG"
+}
+
+
+# NDJSON records are valid UTF-8 and JSON for any file name; names that are not UTF-8 are given
+# exactly in path_b64
+function checkUtf8() {
+  local DIR=$TMP/utf8 OUT=$TMP/utf8.ndjson
+  local BAD=$'bad\xffname' MSG=
+
+  mkdir -p "$DIR/sub"$'\xfe' && touch "$DIR/$BAD" "$DIR/caf"$'\xc3\xa9' "$DIR/q\"\\" \
+    "$DIR/sub"$'\xfe'/x || { result "$1" "cannot generate tree"; return; }
+  "$DIRTREE" --format=ndjson "$DIR" > "$OUT" || { result "$1" "dirtree failed"; return; }
+
+  if ! iconv -f UTF-8 -t UTF-8 "$OUT" > /dev/null 2>&1; then
+    MSG="output is not valid UTF-8"
+  elif command -v jq > /dev/null && ! jq -e . "$OUT" > /dev/null 2>&1; then
+    MSG="output is not valid JSON"
+  elif [[ $(grep -c path_b64 "$OUT") != 3 ]]; then
+    MSG="expected path_b64 for the three paths that are not UTF-8"
+  elif ! grep -q '"path":"[^"]*/bad\\ufffdname","path_b64":"' "$OUT"; then
+    MSG="invalid byte not replaced by U+FFFD"
+  elif [[ $(sed -n 's/.*bad\\ufffdname","path_b64":"\([^"]*\)".*/\1/p' "$OUT" | base64 -d) != "$DIR/$BAD" ]]; then
+    MSG="path_b64 does not decode to the path"
+  fi
+  result "$1" "$MSG"
+}
+
+
+# with --dedup-links, the link counted is the first one in the output: the totals do not depend on
+# the number of threads or on which root a worker reads first
+function checkDedup() {
+  local R1=$TMP/links/r1 R2=$TMP/links/r2
+  local REF MSG=
+
+  mkdir -p "$R1" "$R2" || { result "$1" "cannot generate tree"; return; }
+  for ((i = 1; i <= 300; i++)); do
+    mkdir "$R1/d$i" "$R2/d$i" &&
+    head -c $((i*37)) /dev/zero > "$R1/f$i" && head -c $((i*41)) /dev/zero > "$R1/d$i/f" &&
+    ln "$R1/f$i" "$R2/d$i/g" && ln "$R1/d$i/f" "$R2/g$i" || { result "$1" "cannot generate tree"; return; }
+  done
+
+  REF=$("$DIRTREE" -s -v -j 1 --dedup-links "$R1" "$R2") || { result "$1" "dirtree failed"; return; }
+  for opts in "-j 4" "-j 4 --roots 2"; do
+    for ((k = 0; k < 5; k++)); do
+      local OUT
+      OUT=$("$DIRTREE" -s -v $opts --dedup-links "$R1" "$R2") || { MSG="'$opts' failed"; break 2; }
+      if [[ $OUT != "$REF" ]]; then
+        MSG="'$opts' differs from '-j 1'"
+        break 2
+      fi
+    done
+  done
+  result "$1" "$MSG"
+}
+
+
+checkReadahead "bounded read-ahead (-j)"
+checkUtf8 "ndjson file names that are not UTF-8"
+checkDedup "hard links counted in display order"
+
+exit $FAILED
@@ -0,0 +1,216 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief generate a synthetic directory tree for benchmarks
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+//
+// Every directory above the given depth has 'fanout' subdirectories; every directory has 'files'
+// further entries: regular files, symbolic links, hard links and named pipes in the given mix.
+// Names have a random length in the given range. The tree only depends on the parameters and
+// the seed, so the same command line generates the same tree on every run and machine.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define MAX_NAME 255          ///< maximum name length
+
+/// @brief parameters of the tree
+struct params {
+  unsigned int depth;         ///< depth of the deepest directories (the root is at depth 0)
+  unsigned int fanout;        ///< number of subdirectories per directory
+  unsigned int files;         ///< number of other entries per directory
+  unsigned int len_min;       ///< minimum name length
+  unsigned int len_max;       ///< maximum name length
+  unsigned int symlinks;      ///< percentage of symbolic links among the other entries
+  unsigned int hardlinks;     ///< percentage of hard links among the other entries
+  unsigned int fifos;         ///< percentage of named pipes among the other entries
+  off_t size;                 ///< (sparse) size of the regular files
+};
+
+/// @brief counts of the generated entries
+struct counts {
+  unsigned long long dirs, files, symlinks, hardlinks, fifos, errors;
+};
+
+static unsigned long long rng;  ///< state of the random number generator
+
+
+/// @brief next pseudo-random number (xorshift64*)
+static unsigned long long rnd(void)
+{
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+
+  return rng * 0x2545f4914f6cdd1dull;
+}
+
+
+/// @brief unique name for entry @a idx of a directory: the index in base 36 followed by random
+///        letters up to a random length in the configured range
+static void makeName(const struct params *p, unsigned int idx, char *name)
+{
+  static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  unsigned int len = p->len_min + (unsigned int)(rnd() % (p->len_max - p->len_min + 1));
+  unsigned int n = 0;
+  char tmp[16];
+
+  do {
+    tmp[n++] = digits[idx % 36];
+    idx /= 36;
+  } while (idx);
+  for (unsigned int i = 0; i < n; i++) name[i] = tmp[n-1-i];
+  for (; n < len; n++) name[n] = 'a' + rnd() % 26;
+  name[n] = '\0';
+}
+
+
+/// @brief report a failed operation on @a name
+static void failed(struct counts *c, const char *what, const char *name)
+{
+  if (c->errors++ < 10) fprintf(stderr, "Cannot create %s '%s': %s\n", what, name, strerror(errno));
+}
+
+
+/// @brief fill directory @a dfd at @a depth
+static void fill(const struct params *p, int dfd, unsigned int depth, struct counts *c)
+{
+  char name[MAX_NAME+1], first[MAX_NAME+1] = "";
+  unsigned int idx = 0;
+
+  for (unsigned int i = 0; i < p->files; i++, idx++) {
+    unsigned int r = rnd() % 100;
+
+    makeName(p, idx, name);
+    if ((r < p->symlinks) && first[0]) {
+      if (symlinkat(first, dfd, name) == 0) c->symlinks++;
+      else failed(c, "symbolic link", name);
+    }
+    else if ((r < p->symlinks + p->hardlinks) && first[0]) {
+      if (linkat(dfd, first, dfd, name, 0) == 0) c->hardlinks++;
+      else failed(c, "hard link", name);
+    }
+    else if ((r < p->symlinks + p->hardlinks + p->fifos) && first[0]) {
+      if (mknodat(dfd, name, S_IFIFO | 0644, 0) == 0) c->fifos++;
+      else failed(c, "pipe", name);
+    }
+    else {
+      // links point to the first regular file of the directory
+      int fd = openat(dfd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+      if ((fd >= 0) && (!p->size || (ftruncate(fd, p->size) == 0))) c->files++;
+      else failed(c, "file", name);
+      if (fd >= 0) close(fd);
+      if (!first[0]) strcpy(first, name);
+    }
+  }
+
+  if (depth >= p->depth) return;
+
+  for (unsigned int i = 0; i < p->fanout; i++, idx++) {
+    int sub;
+
+    makeName(p, idx, name);
+    if ((mkdirat(dfd, name, 0755) < 0) ||
+        ((sub = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)) {
+      failed(c, "directory", name);
+      continue;
+    }
+    c->dirs++;
+    fill(p, sub, depth+1, c);
+    close(sub);
+  }
+}
+
+
+/// @brief parse the unsigned number @a s into @a v
+///
+/// @retval 0 on success
+/// @retval -1 if @a s is not a number
+static int number(const char *s, unsigned long long *v)
+{
+  char *end;
+
+  errno = 0;
+  *v = strtoull(s, &end, 10);
+
+  return (end == s) || *end || errno ? -1 : 0;
+}
+
+
+/// @brief print program syntax and exit
+static void syntax(const char *argv0)
+{
+  fprintf(stderr, "Usage %s [-d DEPTH] [-f FANOUT] [-n FILES] [-l LEN[-LEN]] [-L PCT] [-H PCT]\n"
+                  "       [-p PCT] [-s SIZE] [-S SEED] dir\n"
+                  "Generate a synthetic directory tree in 'dir' (which must not exist).\n"
+                  "\n"
+                  " -d DEPTH  depth of the deepest directories (default 3)\n"
+                  " -f FANOUT subdirectories per directory above DEPTH (default 10)\n"
+                  " -n FILES  other entries per directory (default 100)\n"
+                  " -l LEN[-LEN]  name length or range of name lengths (default 8-16)\n"
+                  " -L PCT    percentage of symbolic links among the other entries (default 5)\n"
+                  " -H PCT    percentage of hard links among the other entries (default 0)\n"
+                  " -p PCT    percentage of named pipes among the other entries (default 1)\n"
+                  " -s SIZE   size of the regular files in bytes, sparse (default 0)\n"
+                  " -S SEED   random seed (default 1)\n",
+                  argv0);
+  exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char *argv[])
+{
+  struct params p = { 3, 10, 100, 8, 16, 5, 0, 1, 0 };
+  struct counts c = { 0 };
+  unsigned long long v, seed = 1;
+  int opt, dfd;
+
+  while ((opt = getopt(argc, argv, "d:f:n:l:L:H:p:s:S:h")) != -1) {
+    char *dash;
+    switch (opt) {
+      case 'd': if (number(optarg, &v) || (v > 64)) syntax(argv[0]); p.depth = v; break;
+      case 'f': if (number(optarg, &v) || (v > 100000)) syntax(argv[0]); p.fanout = v; break;
+      case 'n': if (number(optarg, &v) || (v > 10000000)) syntax(argv[0]); p.files = v; break;
+      case 'l':
+        if ((dash = strchr(optarg, '-'))) *dash = '\0';
+        if (number(optarg, &v) || (v < 1) || (v > MAX_NAME)) syntax(argv[0]);
+        p.len_min = p.len_max = v;
+        if (dash && (number(dash+1, &v) || (v < p.len_min) || (v > MAX_NAME))) syntax(argv[0]);
+        if (dash) p.len_max = v;
+        break;
+      case 'L': if (number(optarg, &v) || (v > 100)) syntax(argv[0]); p.symlinks = v; break;
+      case 'H': if (number(optarg, &v) || (v > 100)) syntax(argv[0]); p.hardlinks = v; break;
+      case 'p': if (number(optarg, &v) || (v > 100)) syntax(argv[0]); p.fifos = v; break;
+      case 's': if (number(optarg, &v)) syntax(argv[0]); p.size = v; break;
+      case 'S': if (number(optarg, &seed)) syntax(argv[0]); break;
+      default: syntax(argv[0]);
+    }
+  }
+  if ((optind != argc-1) || (p.symlinks + p.hardlinks + p.fifos > 100)) syntax(argv[0]);
+
+  rng = seed ? seed : 1;
+  if ((mkdir(argv[optind], 0755) < 0) ||
+      ((dfd = open(argv[optind], O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)) {
+    fprintf(stderr, "Cannot create directory '%s': %s\n", argv[optind], strerror(errno));
+    return EXIT_FAILURE;
+  }
+  fill(&p, dfd, 0, &c);
+  close(dfd);
+
+  // one line that scripts can parse; entries counts everything below the root
+  printf("dirs %llu files %llu symlinks %llu hardlinks %llu fifos %llu entries %llu errors %llu\n",
+         c.dirs, c.files, c.symlinks, c.hardlinks, c.fifos,
+         c.dirs + c.files + c.symlinks + c.hardlinks + c.fifos, c.errors);
+
+  return c.errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief bounded selection of the K largest items (--top)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "topk.h"
+#include "util.h"
+
+
+/// @brief restore the heap property below position @a i
+static void siftDown(struct topk *t, int i)
+{
+  for (;;) {
+    int l = 2*i + 1, m = i;
+    if ((l < t->n) && (t->heap[l].size < t->heap[m].size)) m = l;
+    if ((l+1 < t->n) && (t->heap[l+1].size < t->heap[m].size)) m = l+1;
+    if (m == i) break;
+
+    struct topitem x = t->heap[i];
+    t->heap[i] = t->heap[m];
+    t->heap[m] = x;
+    i = m;
+  }
+}
+
+
+/// @brief restore the heap property above position @a i
+static void siftUp(struct topk *t, int i)
+{
+  while (i > 0) {
+    int p = (i - 1)/2;
+    if (t->heap[p].size <= t->heap[i].size) break;
+
+    struct topitem x = t->heap[i];
+    t->heap[i] = t->heap[p];
+    t->heap[p] = x;
+    i = p;
+  }
+}
+
+
+struct topk *topk_create(int k)
+{
+  struct topk *t = calloc(1, sizeof(struct topk));
+  if (!t) oom();
+
+  t->heap = malloc(k*sizeof(struct topitem));
+  if (!t->heap) oom();
+  t->k = k;
+
+  return t;
+}
+
+
+void topk_add(struct topk *t, unsigned long long size, unsigned long long blocks,
+              const char *dir, size_t dlen, const char *name)
+{
+  size_t nlen = strlen(name);
+  struct topitem *it;
+
+  if (!topk_admits(t, size)) return;
+
+  // the smallest item makes room; its slot is reused
+  if (t->n == t->k) {
+    it = &t->heap[0];
+    free(it->path);
+  }
+  else it = &t->heap[t->n++];
+
+  it->size = size;
+  it->blocks = blocks;
+  it->path = malloc(dlen + nlen + 1);
+  if (!it->path) oom();
+  memcpy(it->path, dir, dlen);
+  memcpy(it->path + dlen, name, nlen + 1);
+
+  if (it == &t->heap[0]) siftDown(t, 0);
+  else siftUp(t, t->n - 1);
+}
+
+
+void topk_merge(struct topk *t, const struct topk *src)
+{
+  for (int i = 0; i < src->n; i++) {
+    const struct topitem *it = &src->heap[i];
+    topk_add(t, it->size, it->blocks, it->path, strlen(it->path), "");
+  }
+}
+
+
+/// @brief qsort() comparison: decreasing size, then by path
+static int compareItems(const void *a, const void *b)
+{
+  const struct topitem *x = (const struct topitem*)a;
+  const struct topitem *y = (const struct topitem*)b;
+
+  if (x->size != y->size) return x->size < y->size ? 1 : -1;
+
+  return strcmp(x->path, y->path);
+}
+
+
+struct topitem *topk_sort(struct topk *t)
+{
+  qsort(t->heap, t->n, sizeof(struct topitem), compareItems);
+
+  return t->heap;
+}
+
+
+void topk_free(struct topk *t)
+{
+  if (!t) return;
+
+  for (int i = 0; i < t->n; i++) free(t->heap[i].path);
+  free(t->heap);
+  free(t);
+}
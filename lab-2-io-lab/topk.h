@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief bounded selection of the K largest items (--top)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __TOPK_H__
+#define __TOPK_H__
+
+#include <stddef.h>
+
+/// @brief an item of a top-K set
+struct topitem {
+  unsigned long long size;    ///< size in bytes (the ranking key)
+  unsigned long long blocks;  ///< number of 512-byte blocks
+  char *path;                 ///< path (owned by the set)
+};
+
+/// @brief the K largest items seen so far, kept in a min-heap of at most K items so that an item
+///        smaller than all K is rejected with a single comparison
+struct topk {
+  struct topitem *heap;       ///< min-heap by size
+  int n;                      ///< number of items in the heap
+  int k;                      ///< capacity
+};
+
+/// @brief create a set of the @a k largest items
+///
+/// @param k number of items to keep (>= 1)
+/// @retval set
+struct topk *topk_create(int k);
+
+/// @brief non-zero if an item of @a size would enter set @a t. Callers use this to avoid building
+///        the path of items that are rejected anyway.
+///
+/// @param t set
+/// @param size size of the item
+static inline int topk_admits(const struct topk *t, unsigned long long size)
+{
+  return (t->n < t->k) || (size > t->heap[0].size);
+}
+
+/// @brief offer an item whose path is the concatenation of @a dir (@a dlen bytes) and @a name
+///
+/// @param t set
+/// @param size size in bytes
+/// @param blocks number of blocks
+/// @param dir first part of the path
+/// @param dlen length of @a dir
+/// @param name second part of the path (null-terminated)
+void topk_add(struct topk *t, unsigned long long size, unsigned long long blocks,
+              const char *dir, size_t dlen, const char *name);
+
+/// @brief offer all items of @a src to @a t
+///
+/// @param t set
+/// @param src set whose items are offered (unchanged)
+void topk_merge(struct topk *t, const struct topk *src);
+
+/// @brief sort the items of @a t by decreasing size (ties by path). The set must not be added to
+///        afterwards.
+///
+/// @param t set
+/// @retval the items in t->heap[0..t->n)
+struct topitem *topk_sort(struct topk *t);
+
+/// @brief release set @a t
+///
+/// @param t set or NULL
+void topk_free(struct topk *t);
+
+#endif // __TOPK_H__
@@ -0,0 +1,222 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief batched statx() through io_uring
+/// @author <yourname>
+/// @studid <studentid>
+///
+/// The ring is driven through the raw io_uring_setup/io_uring_enter/io_uring_register system
+/// calls so that no additional library is required.
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+
+/// @brief io_uring instance
+struct uring {
+  int fd;                     ///< ring file descriptor
+
+  void *sq_ptr;               ///< mapped submission queue ring
+  size_t sq_size;             ///< size of the sq_ptr mapping
+  unsigned *sq_tail;          ///< submission queue tail (written by us)
+  unsigned *sq_mask;          ///< submission queue index mask
+  unsigned *sq_array;         ///< submission queue index array
+  unsigned sq_entries;        ///< number of submission queue entries
+
+  struct io_uring_sqe *sqes;  ///< mapped submission queue entries
+  size_t sqes_size;           ///< size of the sqes mapping
+
+  void *cq_ptr;               ///< mapped completion queue ring (may alias sq_ptr)
+  size_t cq_size;             ///< size of the cq_ptr mapping
+  unsigned *cq_head;          ///< completion queue head (written by us)
+  unsigned *cq_tail;          ///< completion queue tail (written by the kernel)
+  unsigned *cq_mask;          ///< completion queue index mask
+  struct io_uring_cqe *cqes;  ///< completion queue entries
+
+  struct statx *stx;          ///< statx buffers, one per submission queue entry
+};
+
+
+/// @brief check whether the kernel supports IORING_OP_STATX on ring @a fd
+static int probe_statx(int fd)
+{
+  size_t len = sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = calloc(1, len);
+  int res = 0;
+
+  if (!probe) return 0;
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+    res = (probe->last_op >= IORING_OP_STATX) &&
+          (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+  }
+  free(probe);
+
+  return res;
+}
+
+
+struct uring *uring_create(unsigned int entries)
+{
+  struct io_uring_params p;
+  struct uring *r = calloc(1, sizeof(struct uring));
+  if (!r) return NULL;
+
+  memset(&p, 0, sizeof(p));
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0) {
+    free(r);
+    return NULL;
+  }
+  if (!probe_statx(r->fd)) {
+    close(r->fd);
+    free(r);
+    return NULL;
+  }
+
+  r->sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  r->cq_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+    r->cq_size = 0;
+  }
+
+  r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQ_RING);
+  if (r->sq_ptr == MAP_FAILED) r->sq_ptr = NULL;
+
+  if (r->cq_size > 0) {
+    r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_ptr == MAP_FAILED) r->cq_ptr = NULL;
+  } else {
+    r->cq_ptr = r->sq_ptr;
+  }
+
+  r->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 r->fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) r->sqes = NULL;
+
+  r->stx = malloc(p.sq_entries*sizeof(struct statx));
+
+  if (!r->sq_ptr || !r->cq_ptr || !r->sqes || !r->stx) {
+    uring_destroy(r);
+    return NULL;
+  }
+
+  r->sq_entries = p.sq_entries;
+  r->sq_tail  = (unsigned*)((char*)r->sq_ptr + p.sq_off.tail);
+  r->sq_mask  = (unsigned*)((char*)r->sq_ptr + p.sq_off.ring_mask);
+  r->sq_array = (unsigned*)((char*)r->sq_ptr + p.sq_off.array);
+  r->cq_head  = (unsigned*)((char*)r->cq_ptr + p.cq_off.head);
+  r->cq_tail  = (unsigned*)((char*)r->cq_ptr + p.cq_off.tail);
+  r->cq_mask  = (unsigned*)((char*)r->cq_ptr + p.cq_off.ring_mask);
+  r->cqes     = (struct io_uring_cqe*)((char*)r->cq_ptr + p.cq_off.cqes);
+
+  return r;
+}
+
+
+void uring_destroy(struct uring *r)
+{
+  if (!r) return;
+
+  if (r->sqes) munmap(r->sqes, r->sqes_size);
+  if (r->cq_ptr && (r->cq_ptr != r->sq_ptr)) munmap(r->cq_ptr, r->cq_size);
+  if (r->sq_ptr) munmap(r->sq_ptr, r->sq_size);
+  close(r->fd);
+  free(r->stx);
+  free(r);
+}
+
+
+/// @brief convert statx() result @a sx into a struct stat
+static void statx_to_stat(const struct statx *sx, struct stat *st)
+{
+  memset(st, 0, sizeof(struct stat));
+  st->st_dev = makedev(sx->stx_dev_major, sx->stx_dev_minor);
+  st->st_ino = sx->stx_ino;
+  st->st_mode = sx->stx_mode;
+  st->st_nlink = sx->stx_nlink;
+  st->st_uid = sx->stx_uid;
+  st->st_gid = sx->stx_gid;
+  st->st_rdev = makedev(sx->stx_rdev_major, sx->stx_rdev_minor);
+  st->st_size = sx->stx_size;
+  st->st_blksize = sx->stx_blksize;
+  st->st_blocks = sx->stx_blocks;
+  st->st_atim.tv_sec = sx->stx_atime.tv_sec;
+  st->st_atim.tv_nsec = sx->stx_atime.tv_nsec;
+  st->st_mtim.tv_sec = sx->stx_mtime.tv_sec;
+  st->st_mtim.tv_nsec = sx->stx_mtime.tv_nsec;
+  st->st_ctim.tv_sec = sx->stx_ctime.tv_sec;
+  st->st_ctim.tv_nsec = sx->stx_ctime.tv_nsec;
+}
+
+
+int uring_stat(struct uring *r, int dfd, const char **names, int n, struct stat *st, int *err)
+{
+  for (int base = 0; base < n; base += r->sq_entries) {
+    unsigned batch = (n - base < (int)r->sq_entries) ? (unsigned)(n - base) : r->sq_entries;
+    unsigned tail = *r->sq_tail;
+    unsigned mask = *r->sq_mask;
+
+    // queue one statx request per entry of this batch
+    for (unsigned i = 0; i < batch; i++) {
+      unsigned idx = tail & mask;
+      struct io_uring_sqe *sqe = &r->sqes[idx];
+
+      memset(sqe, 0, sizeof(struct io_uring_sqe));
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = dfd;
+      sqe->addr = (unsigned long)names[base + i];
+      sqe->len = STATX_BASIC_STATS;
+      sqe->off = (unsigned long)&r->stx[i];
+      sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+      sqe->user_data = i;
+      r->sq_array[idx] = idx;
+      tail++;
+    }
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+    // submit the batch and reap its completions
+    unsigned submitted = 0, completed = 0;
+    while (completed < batch) {
+      unsigned to_submit = batch - submitted;
+      int res = syscall(__NR_io_uring_enter, r->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        return -1;
+      }
+      submitted += res;
+
+      unsigned head = *r->cq_head;
+      while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        unsigned i = (unsigned)cqe->user_data;
+
+        if (cqe->res < 0) {
+          err[base + i] = -cqe->res;
+        } else {
+          err[base + i] = 0;
+          statx_to_stat(&r->stx[i], &st[base + i]);
+        }
+        head++;
+        completed++;
+      }
+      __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+  }
+
+  return 0;
+}
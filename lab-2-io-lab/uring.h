@@ -0,0 +1,43 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief batched statx() through io_uring
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <sys/stat.h>
+
+/// @brief opaque io_uring instance. An instance must only be used by one thread at a time.
+struct uring;
+
+/// @brief set up an io_uring instance with room for @a entries in-flight requests
+///
+/// @param entries submission queue size (rounded up to a power of two by the kernel)
+/// @retval ring on success
+/// @retval NULL if io_uring is not available or does not support statx
+struct uring *uring_create(unsigned int entries);
+
+/// @brief tear down an io_uring instance
+///
+/// @param r ring (may be NULL)
+void uring_destroy(struct uring *r);
+
+/// @brief lstat @a n entries of directory @a dfd. The requests are submitted in batches of up to
+///        the ring size and the completions are reaped before returning.
+///
+/// @param r ring
+/// @param dfd open directory the names are relative to
+/// @param names entry names
+/// @param n number of entries
+/// @param st metadata of each entry (left untouched for entries that could not be stat'ed)
+/// @param err 0 or the errno of each entry
+/// @retval 0 on success (individual entries may still have failed, see @a err)
+/// @retval -1 if the ring itself failed; the caller should fall back to fstatat()
+int uring_stat(struct uring *r, int dfd, const char **names, int n, struct stat *st, int *err);
+
+#endif // __URING_H__
@@ -0,0 +1,35 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief small helpers shared by the modules (internal, header only)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __UTIL_H__
+#define __UTIL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/// @brief abort the program on allocation failure. Only for the modules of the dirtree program;
+///        libdirtree reports running out of memory to its caller.
+static inline void oom(void)
+{
+  fprintf(stderr, "Out of memory\n");
+  exit(EXIT_FAILURE);
+}
+
+/// @brief current time of the monotonic clock in nanoseconds
+static inline unsigned long long nsec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+#endif // __UTIL_H__
@@ -0,0 +1,615 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief live directory tree totals maintained through inotify (--watch)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include "watch.h"
+#include "util.h"
+
+#define MAX_INSTANCES 8       ///< maximum number of inotify instances
+#define EVENT_BUF     65536   ///< size of the event read buffer
+
+/// @brief events that change the totals of the watched directory
+#define WATCH_MASK    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | \
+                       IN_ONLYDIR | IN_EXCL_UNLINK)
+
+/// @brief a watched directory
+struct wnode {
+  struct wnode *parent;       ///< parent directory (NULL for a root)
+  struct wnode *child;        ///< first subdirectory
+  struct wnode *next, *prev;  ///< siblings
+  struct wnode *dnext, *dprev;///< list of changed directories
+  char *name;                 ///< name (path as given for a root)
+  int wd;                     ///< watch descriptor, -1 if not watched
+  int inst;                   ///< inotify instance
+  int dirty;                  ///< in the list of changed directories
+  int stale;                  ///< the watch was removed by the kernel: the directory is gone
+  struct watch_totals own;    ///< totals of the entries in this directory
+  struct watch_totals total;  ///< totals of the subtree
+};
+
+/// @brief an inotify instance
+struct winst {
+  int fd;                     ///< inotify file descriptor
+  struct wnode **map;         ///< watch descriptor -> directory
+  int mapsize;                ///< size of map
+};
+
+struct watch {
+  struct wnode **roots;       ///< roots
+  int nroots;                 ///< number of roots
+  struct winst inst[MAX_INSTANCES]; ///< inotify instances
+  int ninst;                  ///< number of inotify instances
+  int nextinst;               ///< instance of the next top-level subtree
+  struct wnode *dirty;        ///< changed directories
+  unsigned long unwatched;    ///< number of directories without a watch (but not gone)
+  int warned;                 ///< the watch limit has been reported
+  struct watch_stats st;      ///< statistics
+  char *path;                 ///< path buffer
+  size_t psize;               ///< allocated size of path
+  struct wnode **order;       ///< node buffer of buildTree()
+  size_t osize;               ///< allocated size of order
+  char *names;                ///< subdirectory names read by scanDir()
+  size_t nlen, nsize;         ///< used and allocated size of names
+  size_t *offs;               ///< offsets of the names
+  size_t noffs, soffs;        ///< number and allocated size of offs
+  struct watch_totals *tot;   ///< totals passed to the report function
+};
+
+
+/// @brief make sure @a *buf of @a *size bytes holds at least @a len bytes
+static void grow(void **buf, size_t *size, size_t len)
+{
+  if (len <= *size) return;
+  while (*size < len) *size = *size ? *size*2 : 256;
+  *buf = realloc(*buf, *size);
+  if (!*buf) oom();
+}
+
+
+/// @brief add (@a sign > 0) or subtract (@a sign < 0) totals @a b to @a a
+static void addTotals(struct watch_totals *a, const struct watch_totals *b, int sign)
+{
+  unsigned long long *x = (unsigned long long *)a;
+  const unsigned long long *y = (const unsigned long long *)b;
+
+  for (size_t i = 0; i < sizeof(struct watch_totals)/sizeof(unsigned long long); i++) {
+    if (sign > 0) x[i] += y[i];
+    else x[i] -= y[i];
+  }
+}
+
+
+/// @brief add (@a sign > 0) or subtract (@a sign < 0) @a t to the subtree totals of @a n and all
+///        its ancestors
+static void propagate(struct wnode *n, const struct watch_totals *t, int sign)
+{
+  for (; n; n = n->parent) addTotals(&n->total, t, sign);
+}
+
+
+/// @brief path of directory @a n in w->path
+static const char *nodePath(struct watch *w, const struct wnode *n)
+{
+  size_t len = 0, pos;
+
+  for (const struct wnode *p = n; p; p = p->parent) len += strlen(p->name) + 1;
+  grow((void **)&w->path, &w->psize, len);
+
+  pos = len - 1;
+  w->path[pos] = '\0';
+  for (const struct wnode *p = n; p; p = p->parent) {
+    size_t l = strlen(p->name);
+    pos -= l;
+    memcpy(w->path + pos, p->name, l);
+    if (pos > 0) w->path[--pos] = '/';
+  }
+
+  return w->path;
+}
+
+
+/// @brief add @a n to the list of changed directories
+static void markDirty(struct watch *w, struct wnode *n)
+{
+  if (n->dirty) return;
+
+  n->dirty = 1;
+  n->dprev = NULL;
+  n->dnext = w->dirty;
+  if (w->dirty) w->dirty->dprev = n;
+  w->dirty = n;
+}
+
+
+/// @brief remove @a n from the list of changed directories
+static void unmarkDirty(struct watch *w, struct wnode *n)
+{
+  if (!n->dirty) return;
+
+  if (n->dprev) n->dprev->dnext = n->dnext;
+  else w->dirty = n->dnext;
+  if (n->dnext) n->dnext->dprev = n->dprev;
+  n->dirty = 0;
+}
+
+
+/// @brief next directory after @a n in a pre-order walk of the subtree of @a top
+static struct wnode *nextNode(struct wnode *n, const struct wnode *top)
+{
+  if (n->child) return n->child;
+  while ((n != top) && !n->next) n = n->parent;
+
+  return n == top ? NULL : n->next;
+}
+
+
+/// @brief add a watch for directory @a n
+static void addWatch(struct watch *w, struct wnode *n)
+{
+  struct winst *in = &w->inst[n->inst];
+  // like the walk, symbolic links are followed for roots only
+  int wd = inotify_add_watch(in->fd, nodePath(w, n), WATCH_MASK | (n->parent ? IN_DONT_FOLLOW : 0));
+
+  if (wd < 0) {
+    if ((errno == ENOSPC) && !w->warned) {
+      fprintf(stderr, "Cannot watch all directories (see fs.inotify.max_user_watches); unwatched "
+                      "directories are read at every refresh\n");
+      w->warned = 1;
+    }
+    w->unwatched++;
+    return;
+  }
+
+  if (wd >= in->mapsize) {
+    int nsize = in->mapsize ? in->mapsize : 1024;
+    while (nsize <= wd) nsize *= 2;
+    in->map = (struct wnode **)realloc(in->map, nsize*sizeof(struct wnode*));
+    if (!in->map) oom();
+    memset(in->map + in->mapsize, 0, (nsize - in->mapsize)*sizeof(struct wnode*));
+    in->mapsize = nsize;
+  }
+
+  // a directory moved within the tree keeps its watch; it now belongs to the new node
+  if (in->map[wd] && (in->map[wd] != n)) {
+    in->map[wd]->wd = -1;
+    w->st.watched--;
+    w->unwatched++;
+  }
+  in->map[wd] = n;
+  n->wd = wd;
+  w->st.watched++;
+}
+
+
+/// @brief remove the watch of directory @a n (if any)
+static void removeWatch(struct watch *w, struct wnode *n)
+{
+  struct winst *in = &w->inst[n->inst];
+
+  if (n->wd < 0) {
+    if (!n->stale) w->unwatched--;
+    return;
+  }
+  if (in->map[n->wd] == n) {
+    inotify_rm_watch(in->fd, n->wd);
+    in->map[n->wd] = NULL;
+  }
+  n->wd = -1;
+  w->st.watched--;
+}
+
+
+/// @brief create the node of subdirectory @a name of @a parent (NULL for root @a name)
+static struct wnode *newNode(struct watch *w, struct wnode *parent, const char *name)
+{
+  struct wnode *n = (struct wnode *)calloc(1, sizeof(struct wnode));
+  if (!n) oom();
+
+  n->name = strdup(name);
+  if (!n->name) oom();
+  n->wd = -1;
+  n->parent = parent;
+
+  // roots and their subdirectories start new subtrees that are spread over the instances
+  if (!parent || !parent->parent) {
+    n->inst = w->nextinst;
+    w->nextinst = (w->nextinst + 1) % w->ninst;
+  }
+  else n->inst = parent->inst;
+
+  if (parent) {
+    n->next = parent->child;
+    if (parent->child) parent->child->prev = n;
+    parent->child = n;
+  }
+  w->st.dirs++;
+
+  return n;
+}
+
+
+/// @brief remove the subtree of @a n from the tree and its totals from those of the ancestors
+static void removeTree(struct watch *w, struct wnode *n)
+{
+  struct wnode *p = n->parent, *x = n;
+
+  if (p) {
+    propagate(p, &n->total, -1);
+    if (n->prev) n->prev->next = n->next;
+    else p->child = n->next;
+    if (n->next) n->next->prev = n->prev;
+  }
+
+  // leaves first; a leaf is always the first child of its parent
+  for (;;) {
+    while (x->child) x = x->child;
+
+    struct wnode *up = x->parent;
+    int last = (x == n);
+
+    if (!last) {
+      up->child = x->next;
+      if (x->next) x->next->prev = NULL;
+    }
+    unmarkDirty(w, x);
+    removeWatch(w, x);
+    w->st.dirs--;
+    free(x->name);
+    free(x);
+
+    if (last) break;
+    x = up;
+  }
+}
+
+
+/// @brief read directory @a n (one level) into @a n->own; the names of its subdirectories are
+///        left in w->names at w->offs. An unreadable directory has no entries.
+static void scanDir(struct watch *w, struct wnode *n)
+{
+  const char *path = nodePath(w, n);
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (n->parent ? O_NOFOLLOW : 0));
+  DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+  struct dirent *de;
+
+  memset(&n->own, 0, sizeof(n->own));
+  w->nlen = w->noffs = 0;
+  w->st.rescans++;
+
+  if (!dir) {
+    // a directory that is gone has no entries; its parent drops it when it is read again
+    if (fd >= 0) close(fd);
+    else if ((errno != ENOENT) && (errno != ENOTDIR)) fprintf(stderr, "Cannot read '%s': %s\n", path, strerror(errno));
+    return;
+  }
+
+  while ((de = readdir(dir))) {
+    struct stat st;
+
+    if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+    if (fstatat(dirfd(dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+
+    // counted as in the summary of the walk
+    if (S_ISDIR(st.st_mode)) n->own.dirs++;
+    else if (S_ISFIFO(st.st_mode)) n->own.fifos++;
+    else if (S_ISLNK(st.st_mode)) n->own.links++;
+    else if (S_ISSOCK(st.st_mode)) n->own.socks++;
+    else if (!S_ISCHR(st.st_mode) && !S_ISBLK(st.st_mode)) n->own.files++;
+    n->own.size += st.st_size;
+    n->own.blocks += st.st_blocks;
+
+    if (S_ISDIR(st.st_mode)) {
+      size_t len = strlen(de->d_name) + 1;
+      grow((void **)&w->names, &w->nsize, w->nlen + len);
+      grow((void **)&w->offs, &w->soffs, (w->noffs + 1)*sizeof(size_t));
+      memcpy(w->names + w->nlen, de->d_name, len);
+      w->offs[w->noffs++] = w->nlen;
+      w->nlen += len;
+    }
+  }
+  closedir(dir);
+}
+
+
+/// @brief walk the new subtree of @a top: watch each directory, then read it. The subtree's
+///        totals are added to the ancestors of @a top.
+static void buildTree(struct watch *w, struct wnode *top)
+{
+  size_t n = 0;
+
+  // breadth-first: every directory comes after its parent
+  grow((void **)&w->order, &w->osize, sizeof(struct wnode*));
+  w->order[n++] = top;
+  for (size_t i = 0; i < n; i++) {
+    struct wnode *d = w->order[i];
+
+    addWatch(w, d);
+    scanDir(w, d);
+    d->total = d->own;
+    grow((void **)&w->order, &w->osize, (n + w->noffs)*sizeof(struct wnode*));
+    for (size_t k = 0; k < w->noffs; k++) w->order[n++] = newNode(w, d, w->names + w->offs[k]);
+  }
+
+  // subtree totals bottom-up
+  while (--n > 0) addTotals(&w->order[n]->parent->total, &w->order[n]->total, 1);
+  if (top->parent) propagate(top->parent, &top->total, 1);
+}
+
+
+static const char *sortNames; ///< name buffer of compareNames()
+
+/// @brief qsort() comparison of name offsets in sortNames
+static int compareNames(const void *a, const void *b)
+{
+  return strcmp(sortNames + *(const size_t *)a, sortNames + *(const size_t *)b);
+}
+
+
+/// @brief read changed directory @a n again: update its totals, drop subdirectories that are
+///        gone and walk new ones
+static void rescanDir(struct watch *w, struct wnode *n)
+{
+  struct watch_totals old = n->own;
+  unsigned char *seen;
+
+  unmarkDirty(w, n);
+
+  // a directory without a watch tries again; one that was replaced is read from scratch
+  if (n->wd < 0) {
+    if (n->stale) {
+      while (n->child) removeTree(w, n->child);
+      n->stale = 0;
+    }
+    else w->unwatched--;
+    addWatch(w, n);
+  }
+
+  scanDir(w, n);
+  propagate(n, &old, -1);
+  propagate(n, &n->own, 1);
+
+  sortNames = w->names;
+  qsort(w->offs, w->noffs, sizeof(size_t), compareNames);
+  seen = (unsigned char *)calloc(w->noffs + 1, 1);
+  if (!seen) oom();
+
+  for (struct wnode *c = n->child, *next; c; c = next) {
+    size_t lo = 0, hi = w->noffs;
+    next = c->next;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      if (strcmp(w->names + w->offs[mid], c->name) < 0) lo = mid + 1;
+      else hi = mid;
+    }
+    if ((lo < w->noffs) && !strcmp(w->names + w->offs[lo], c->name)) seen[lo] = 1;
+    else removeTree(w, c);
+  }
+
+  // buildTree() reuses the name buffer: the new names are copied first
+  size_t nnew = 0, len = 0;
+  for (size_t k = 0; k < w->noffs; k++) {
+    if (!seen[k]) {
+      nnew++;
+      len += strlen(w->names + w->offs[k]) + 1;
+    }
+  }
+  if (nnew) {
+    char *names = (char *)malloc(len), *p = names;
+    if (!names) oom();
+    for (size_t k = 0; k < w->noffs; k++) {
+      if (!seen[k]) p = stpcpy(p, w->names + w->offs[k]) + 1;
+    }
+    p = names;
+    for (size_t k = 0; k < nnew; k++, p += strlen(p) + 1) buildTree(w, newNode(w, n, p));
+    free(names);
+  }
+  free(seen);
+}
+
+
+/// @brief handle the events in @a buf (@a len bytes) read from instance @a k
+static void handleEvents(struct watch *w, int k, const char *buf, ssize_t len)
+{
+  struct winst *in = &w->inst[k];
+
+  for (const char *p = buf; p < buf + len; ) {
+    const struct inotify_event *ev = (const struct inotify_event *)p;
+    struct wnode *n = (ev->wd >= 0) && (ev->wd < in->mapsize) ? in->map[ev->wd] : NULL;
+
+    p += sizeof(struct inotify_event) + ev->len;
+    w->st.events++;
+
+    // events were lost: the subtrees of this instance are read again
+    if (ev->mask & IN_Q_OVERFLOW) {
+      w->st.overflows++;
+      for (int r = 0; r < w->nroots; r++) {
+        for (struct wnode *x = w->roots[r]; x; x = nextNode(x, w->roots[r])) {
+          if (x->inst == k) markDirty(w, x);
+        }
+      }
+      continue;
+    }
+    if (!n) continue;
+
+    // the directory is gone (or its file system was unmounted); the parent sees the change
+    if (ev->mask & IN_IGNORED) {
+      in->map[ev->wd] = NULL;
+      n->wd = -1;
+      n->stale = 1;
+      w->st.watched--;
+      markDirty(w, n->parent ? n->parent : n);
+      continue;
+    }
+    markDirty(w, n);
+  }
+}
+
+
+/// @brief read all changed directories again and report the totals
+static void refresh(struct watch *w, watch_fn report, void *ctx)
+{
+  // directories without a watch cannot tell whether they changed
+  if (w->unwatched) {
+    for (int r = 0; r < w->nroots; r++) {
+      for (struct wnode *x = w->roots[r]; x; x = nextNode(x, w->roots[r])) {
+        if (x->wd < 0) markDirty(w, x);
+      }
+    }
+  }
+
+  while (w->dirty) rescanDir(w, w->dirty);
+
+  for (int r = 0; r < w->nroots; r++) w->tot[r] = w->roots[r]->total;
+  report(ctx, w->tot, w->nroots);
+}
+
+
+struct watch *watch_create(const char **roots, int n)
+{
+  struct watch *w = (struct watch *)calloc(1, sizeof(struct watch));
+  if (!w) oom();
+
+  // one instance per top-level subtree up to MAX_INSTANCES (the per-user limit is often 128)
+  for (int i = 0; i < MAX_INSTANCES; i++) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) break;
+    w->inst[w->ninst++].fd = fd;
+  }
+  if (w->ninst == 0) {
+    int err = errno;
+    free(w);
+    errno = err;
+    return NULL;
+  }
+  w->st.instances = w->ninst;
+
+  w->roots = (struct wnode **)calloc(n ? n : 1, sizeof(struct wnode*));
+  w->tot = (struct watch_totals *)calloc(n ? n : 1, sizeof(struct watch_totals));
+  if (!w->roots || !w->tot) oom();
+  for (int i = 0; i < n; i++) {
+    w->roots[w->nroots++] = newNode(w, NULL, roots[i]);
+    buildTree(w, w->roots[i]);
+  }
+
+  return w;
+}
+
+
+int watch_run(struct watch *w, unsigned int interval, watch_fn report, void *ctx)
+{
+  struct pollfd pfd[MAX_INSTANCES + 1];
+  struct timespec next, now;
+  sigset_t mask;
+  char *buf;
+  int sfd;
+
+  // the signals are read from a signal file descriptor along with the events
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGUSR1);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) return -1;
+  if ((sfd = signalfd(-1, &mask, SFD_CLOEXEC)) < 0) return -1;
+
+  buf = (char *)malloc(EVENT_BUF);
+  if (!buf) oom();
+  for (int k = 0; k < w->ninst; k++) {
+    pfd[k].fd = w->inst[k].fd;
+    pfd[k].events = POLLIN;
+  }
+  pfd[w->ninst].fd = sfd;
+  pfd[w->ninst].events = POLLIN;
+
+  refresh(w, report, ctx);
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  next.tv_sec += interval;
+
+  for (;;) {
+    int timeout = -1, due = 0;
+
+    if (interval) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      long long ms = (next.tv_sec - now.tv_sec)*1000LL + (next.tv_nsec - now.tv_nsec)/1000000;
+      timeout = ms > 0 ? (int)ms : 0;
+    }
+
+    int res = poll(pfd, w->ninst + 1, timeout);
+    if ((res < 0) && (errno != EINTR)) break;
+
+    for (int k = 0; (res > 0) && (k < w->ninst); k++) {
+      if (!(pfd[k].revents & POLLIN)) continue;
+      ssize_t len;
+      while ((len = read(pfd[k].fd, buf, EVENT_BUF)) > 0) handleEvents(w, k, buf, len);
+    }
+
+    if ((res > 0) && (pfd[w->ninst].revents & POLLIN)) {
+      struct signalfd_siginfo si;
+      if (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+        if (si.ssi_signo != SIGUSR1) {
+          free(buf);
+          close(sfd);
+          return 0;
+        }
+        due = 1;
+      }
+    }
+
+    if (interval) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if ((now.tv_sec > next.tv_sec) || ((now.tv_sec == next.tv_sec) && (now.tv_nsec >= next.tv_nsec))) {
+        due = 1;
+        next = now;
+        next.tv_sec += interval;
+      }
+    }
+    if (due) refresh(w, report, ctx);
+  }
+
+  free(buf);
+  close(sfd);
+  return -1;
+}
+
+
+void watch_stats(struct watch *w, struct watch_stats *st)
+{
+  *st = w->st;
+}
+
+
+void watch_free(struct watch *w)
+{
+  if (!w) return;
+
+  for (int r = 0; r < w->nroots; r++) removeTree(w, w->roots[r]);
+  for (int k = 0; k < w->ninst; k++) {
+    close(w->inst[k].fd);
+    free(w->inst[k].map);
+  }
+  free(w->roots);
+  free(w->tot);
+  free(w->path);
+  free(w->order);
+  free(w->names);
+  free(w->offs);
+  free(w);
+}
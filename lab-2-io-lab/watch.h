@@ -0,0 +1,80 @@
+//--------------------------------------------------------------------------------------------------
+// System Programming                         I/O Lab                                    Fall 2020
+//
+/// @file
+/// @brief live directory tree totals maintained through inotify (--watch)
+/// @author <yourname>
+/// @studid <studentid>
+//--------------------------------------------------------------------------------------------------
+
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+/// @brief totals of a directory tree (entries below the directory, not the directory itself)
+struct watch_totals {
+  unsigned long long files;   ///< number of regular files
+  unsigned long long dirs;    ///< number of directories
+  unsigned long long links;   ///< number of symbolic links
+  unsigned long long fifos;   ///< number of pipes
+  unsigned long long socks;   ///< number of sockets
+  unsigned long long size;    ///< total size (in bytes)
+  unsigned long long blocks;  ///< total number of blocks (512 byte blocks)
+};
+
+/// @brief statistics of a watched tree
+struct watch_stats {
+  unsigned long long events;  ///< number of inotify events read
+  unsigned long long rescans; ///< number of directories read again
+  unsigned long overflows;    ///< number of event queue overflows
+  unsigned long dirs;         ///< number of directories in the tree
+  unsigned long watched;      ///< number of directories with a watch
+  int instances;              ///< number of inotify instances
+};
+
+/// @brief watched directory trees. Every directory has its own totals (of the entries directly in
+///        it) and the totals of its subtree. The first walk adds an inotify watch to each
+///        directory before reading it. Afterwards, events only mark their directory as changed;
+///        changed directories are read again (one level, new subdirectories in full) when the
+///        totals are next needed, and the difference is added to their ancestors.
+///
+///        The watches are spread over several inotify instances by top-level subtree, so that if
+///        the event queue of an instance overflows, only the subtrees of that instance are read
+///        again. Directories for which no watch can be added (fs.inotify.max_user_watches) are
+///        read again at every refresh.
+struct watch;
+
+/// @brief report of refreshed totals; @a t[i] holds the totals of root @a i of @a n
+typedef void (*watch_fn)(void *ctx, const struct watch_totals *t, int n);
+
+/// @brief walk the @a n trees at @a roots and start watching them
+///
+/// @param roots paths of the roots (must remain valid)
+/// @param n number of roots
+/// @retval watched trees
+/// @retval NULL if inotify is not available (errno is set)
+struct watch *watch_create(const char **roots, int n);
+
+/// @brief report the totals through @a report right away, then every @a interval seconds (0:
+///        never) and whenever SIGUSR1 is received, until SIGINT or SIGTERM is received. The
+///        signals are blocked in the calling thread.
+///
+/// @param w watched trees
+/// @param interval seconds between reports, 0 for reports on SIGUSR1 only
+/// @param report report function
+/// @param ctx context passed to @a report
+/// @retval 0 when terminated by a signal
+/// @retval -1 on error (errno is set)
+int watch_run(struct watch *w, unsigned int interval, watch_fn report, void *ctx);
+
+/// @brief get the statistics of @a w
+///
+/// @param w watched trees
+/// @param st statistics
+void watch_stats(struct watch *w, struct watch_stats *st);
+
+/// @brief stop watching and release @a w
+///
+/// @param w watched trees or NULL
+void watch_free(struct watch *w);
+
+#endif // __WATCH_H__
@@ -17,11 +17,34 @@
 // The data segment for the heap is provided by the dataseg module. A 'word' in the heap is
 // eight bytes.
 //
-// Implicit free list:
-// -------------------
+// Explicit free block index:
+// ---------------------------
 // - minimal block size: 32 bytes (header +footer + 2 data words)
 // - h,f: header/footer of free block
 // - H,F: header/footer of allocated block
+// - n,p: next/previous free block in the same bin (stored in the first two payload words of a
+//        free block, so every free block fits them)
+// - l,r: left/right child in the tree of free blocks (stored in the same two payload words)
+//
+// - first and next fit: free blocks are kept in NBINS size classes (bins) of powers of two: bin
+//   i holds the free blocks of BS*2^i to BS*2^(i+1)-1 bytes, the last bin all larger ones. Each
+//   bin is a doubly linked, NULL-terminated list; blocks are inserted at the head.
+//
+//       bins[i] --> +---+---+---+-------+---+       +---+---+---+-------+---+
+//                   | h | n | p |  ...  | f |  -->  | h | n | p |  ...  | f |  --> NULL
+//                   +---+---+---+-------+---+  <--  +---+---+---+-------+---+
+//
+// - best fit: free blocks are kept in a treap (a binary search tree that is also a heap on
+//   random priorities, so its expected depth is O(log n)) ordered by (size, address). The two
+//   payload words hold the left (l) and right (r) child; the priority is a hash of the block's
+//   address and needs no space.
+//
+//       tree_root --> +---+---+---+-------+---+
+//                     | h | l | r |  ...  | f |
+//                     +---+---+---+-------+---+
+//                           |   |
+//                           |   +--> blocks after it: larger, or same size at a higher address
+//                           +------> blocks before it: smaller, or same size at a lower address
 //
 // - state after initialization
 //
@@ -37,9 +60,18 @@
 //                       |                                         |
 //               32-byte aligned                           32-byte aligned
 //
-// - allocation policies: first, next, best fit
-// - block splitting: always at 32-byte boundaries
-// - immediate coalescing upon free
+// - allocation policies: first, next, best fit. Only free blocks are ever visited. First and
+//   next fit search the bins, starting at the bin of the requested size and moving on to the
+//   larger bins until a block is found.
+//   - first fit: the first block in the bin that fits
+//   - next fit:  like first fit, but the search of a bin continues where the previous one in the
+//                same bin left off (one rover per bin)
+//   - best fit:  the smallest fitting block with the lowest address: a lower-bound lookup of
+//                (size, 0) in the tree, in O(log n). This is the block a scan of the whole heap
+//                picks, so the heap is laid out exactly as with an implicit list.
+// - block splitting: always at 32-byte boundaries; the remainder goes to the free block index
+// - immediate coalescing upon free; the free neighbors are taken out of the index and the
+//   coalesced block is put into it
 //
 
 
@@ -61,7 +93,6 @@ static void *ds_heap_start = NULL;                     ///< physical start of da
 static void *ds_heap_brk   = NULL;                     ///< physical end of data segment
 static void *heap_start    = NULL;                     ///< logical start of heap
 static void *heap_end      = NULL;                     ///< logical end of heap
-static void *recent_block  = NULL;                     ///< the block accessed latest
 static int  PAGESIZE       = 0;                        ///< memory system page size
 static int  mm_initialized = 0;                        ///< initialized flag (yes: 1, otherwise 0)
 static int  mm_loglevel    = 0;                        ///< log level (0: off; 1: info; 2: verbose)
@@ -69,6 +100,9 @@ static void* (*get_block)(size_t size) = NULL;  // <-- this is a function pointe
                                         // it can point to any function that
                                         // - returns void*
                                         // - takes one size_t argument
+static void (*insert_block)(void *block) = NULL; ///< put a free block into the free block index
+static void (*remove_block)(void *block) = NULL; ///< take a free block out of the free block index
+static AllocationPolicy policy;                  ///< allocation policy
 #define MAX(a, b)          ((a) > (b) ? (a) : (b))     ///< MAX function
 
 #define TYPE               unsigned long               ///< word type of heap
@@ -107,7 +141,22 @@ static void* (*get_block)(size_t size) = NULL;  // <-- this is a function pointe
 
 #define NEXT_BLOCK(p)      ((p)+GET_SIZE(p))           ///< get pointer to next block of p
 #define PREV_BLOCK(p)      ((p)-GET_SIZE((p)-TYPE_SIZE)) ///< get pointer to previous block of p
-// TODO add more macros as needed
+
+#define NEXT_FREE(p)       (*(void**)((p)+TYPE_SIZE))  ///< next free block in the bin of free block p
+#define PREV_FREE(p)       (*(void**)((p)+2*TYPE_SIZE)) ///< previous free block in the bin of free block p
+
+#define NBINS              20                          ///< number of size classes; the last one
+                                                       ///< holds all blocks of BS*2^(NBINS-1) bytes
+                                                       ///< and more
+
+#define LEFT(p)            (*(void**)((p)+TYPE_SIZE))  ///< left child of free block p in the tree
+#define RIGHT(p)           (*(void**)((p)+2*TYPE_SIZE)) ///< right child of free block p in the tree
+#define PRIORITY(p)        ((WORD(p)/BS*0x9e3779b97f4a7c15ul) >> 16) ///< treap priority of block p
+
+static void *bins[NBINS];                              ///< head of the free list of each size class
+static void *rovers[NBINS];                            ///< next fit: where the next search of each
+                                                       ///< bin starts (NULL: at the head)
+static void *tree_root;                                ///< best fit: root of the tree of free blocks
 
 /// @brief print a log message if level <= mm_loglevel. The variadic argument is a printf format
 ///        string followed by its parametrs
@@ -158,6 +207,10 @@ static void mm_panic(const char *func, ...)
 static void *ff_get_free_block(size_t size);
 static void *nf_get_free_block(size_t size);
 static void *bf_get_free_block(size_t size);
+static void bin_insert(void *block);
+static void bin_remove(void *block);
+static void tree_insert(void *block);
+static void tree_remove(void *block);
 
 void mm_init(AllocationPolicy ap)
 {
@@ -169,6 +222,10 @@ void mm_init(AllocationPolicy ap)
     case ap_BestFit: get_block = bf_get_free_block;break;
     default: PANIC("Invalid allocation policy.");
   }
+  // best fit keeps the free blocks in a tree, first and next fit in the bins
+  insert_block = ap == ap_BestFit ? tree_insert : bin_insert;
+  remove_block = ap == ap_BestFit ? tree_remove : bin_remove;
+  policy = ap;
   //
   // retrieve heap status and perform a few initial sanity checks
   //
@@ -214,68 +271,194 @@ void mm_init(AllocationPolicy ap)
   PUT(heap_start, bdrytag);
   PUT(heap_end-TYPE_SIZE, bdrytag);
 
-  recent_block = heap_start;
+  // the free block index holds the one free block
+  memset(bins, 0, sizeof(bins));
+  memset(rovers, 0, sizeof(rovers));
+  tree_root = NULL;
+  insert_block(heap_start);
   //
   // heap is initialized
   //
   mm_initialized = 1;
 }
 
+/// @brief size class of blocks of @a size bytes
+static int bin_index(size_t size)
+{
+  int bin = 0;
+
+  size /= BS;
+  while ((size >>= 1) && (bin < NBINS-1)) bin++;
+
+  return bin;
+}
+
+/// @brief insert free block @a block at the head of the list of its bin
+static void bin_insert(void *block)
+{
+  int bin = bin_index(GET_SIZE(block));
+
+  LOG(2, "  bin_insert(%p) into bin %d", block, bin);
+
+  NEXT_FREE(block) = bins[bin];
+  PREV_FREE(block) = NULL;
+  if (bins[bin] != NULL) PREV_FREE(bins[bin]) = block;
+  bins[bin] = block;
+}
+
+/// @brief remove free block @a block from the list of its bin. Must be called before the size in
+///        the header of @a block changes.
+static void bin_remove(void *block)
+{
+  int bin = bin_index(GET_SIZE(block));
+  void *next = NEXT_FREE(block), *prev = PREV_FREE(block);
+
+  LOG(2, "  bin_remove(%p) from bin %d", block, bin);
+
+  if (prev != NULL) NEXT_FREE(prev) = next;
+  else bins[bin] = next;
+  if (next != NULL) PREV_FREE(next) = prev;
+
+  // the next search of the bin continues with the following block
+  if (rovers[bin] == block) rovers[bin] = next;
+}
+
 static void* nf_get_free_block(size_t size)
 {
   LOG(1, "nf_get_free_block(0x%lx (%lu))", size, size);
 
   assert(mm_initialized);
-  
-  void *block = recent_block;
-  size_t bsize, bstatus;
-  LOG(2, "  starting search at %p", block);
-  do{
-    bstatus = GET_STATUS(block);
-    bsize = GET_SIZE(block);
-    LOG(2, "  %p: size: %lx (%lu), status: %s", block, bsize, bsize, bstatus == ALLOC ? "allcated" : "free");
-
-    if((bstatus == FREE) && (bsize >= size)) {
-      //found block
-      LOG(2, " --> match");
-      recent_block = block;// this block will be used right after now
-      return block;
-    }
-    
-    block += bsize;
-    if(GET_SIZE(block)==0) block = heap_start;//if block arrives at heap_end, return to heap_start
-  } while(block!=recent_block);//travel once all block => cannot find block
+
+  for (int bin = bin_index(size); bin < NBINS; bin++) {
+    void *start = rovers[bin] != NULL ? rovers[bin] : bins[bin];
+    void *block = start;
+
+    if (block == NULL) continue;
+    LOG(2, "  bin %d: starting search at %p", bin, block);
+    do {
+      size_t bsize = GET_SIZE(block);
+      LOG(2, "  %p: size: %lx (%lu)", block, bsize, bsize);
+
+      if (bsize >= size) {
+        LOG(2, "  --> match");
+        rovers[bin] = block;
+        return block;
+      }
+
+      // wrap around at the end of the list
+      block = NEXT_FREE(block) != NULL ? NEXT_FREE(block) : bins[bin];
+    } while (block != start);
+  }
 
   LOG(2, "no suitable block found");
   return NULL;
 }
+/// @brief non-zero if free block @a a comes before free block @a b in the tree: it is smaller,
+///        or it has the same size and a lower address
+static int tree_less(void *a, void *b)
+{
+  return (GET_SIZE(a) < GET_SIZE(b)) || ((GET_SIZE(a) == GET_SIZE(b)) && (a < b));
+}
+
+/// @brief split the tree @a t into the blocks before @a block (@a l) and the others (@a r)
+static void tree_split(void *t, void *block, void **l, void **r)
+{
+  if (t == NULL) {
+    *l = *r = NULL;
+  } else if (tree_less(t, block)) {
+    tree_split(RIGHT(t), block, &RIGHT(t), r);
+    *l = t;
+  } else {
+    tree_split(LEFT(t), block, l, &LEFT(t));
+    *r = t;
+  }
+}
+
+/// @brief merge the trees @a l and @a r; all blocks of @a l come before those of @a r
+static void* tree_merge(void *l, void *r)
+{
+  if (l == NULL) return r;
+  if (r == NULL) return l;
+
+  if (PRIORITY(l) > PRIORITY(r)) {
+    RIGHT(l) = tree_merge(RIGHT(l), r);
+    return l;
+  } else {
+    LEFT(r) = tree_merge(l, LEFT(r));
+    return r;
+  }
+}
+
+/// @brief insert free block @a block into the tree @a t
+/// @retval void* new root of the tree
+static void* tree_add(void *t, void *block)
+{
+  if ((t == NULL) || (PRIORITY(block) > PRIORITY(t))) {
+    // block becomes the root of this subtree
+    tree_split(t, block, &LEFT(block), &RIGHT(block));
+    return block;
+  }
+
+  if (tree_less(block, t)) LEFT(t) = tree_add(LEFT(t), block);
+  else RIGHT(t) = tree_add(RIGHT(t), block);
+
+  return t;
+}
+
+/// @brief remove free block @a block from the tree @a t
+/// @retval void* new root of the tree
+static void* tree_del(void *t, void *block)
+{
+  if (t == NULL) PANIC("Free block %p not in tree.", block);
+
+  if (t == block) return tree_merge(LEFT(t), RIGHT(t));
+
+  if (tree_less(block, t)) LEFT(t) = tree_del(LEFT(t), block);
+  else RIGHT(t) = tree_del(RIGHT(t), block);
+
+  return t;
+}
+
+/// @brief insert free block @a block into the tree of free blocks
+static void tree_insert(void *block)
+{
+  LOG(2, "  tree_insert(%p)", block);
+
+  tree_root = tree_add(tree_root, block);
+}
+
+/// @brief remove free block @a block from the tree of free blocks. Must be called before the size
+///        in the header of @a block changes.
+static void tree_remove(void *block)
+{
+  LOG(2, "  tree_remove(%p)", block);
+
+  tree_root = tree_del(tree_root, block);
+}
+
 static void* bf_get_free_block(size_t size)
 {
   LOG(1, "bf_get_free_block(0x%lx (%lu))", size, size);
 
   assert(mm_initialized);
 
-  void *block = heap_start;
+  // lower bound of (size, 0): the smallest fitting block with the lowest address
   void *bf_block = NULL;
-  size_t bsize, bstatus, bf_size=-1;
-  LOG(2, "  starting search at %p", block);
-  do{
-    bstatus = GET_STATUS(block);
-    bsize = GET_SIZE(block);
-
-    LOG(2, "  %p: size: %lx (%lu), status: %s", block, bsize, bsize, bstatus == ALLOC ? "allocated" : "free");
-    if((bstatus == FREE) && (bsize >= size)) {
-      //found qualified block
-      if(bf_size==-1 || bsize<bf_size){// until this block, this block is the best
-        bf_block = block;
-        bf_size = bsize;
-      }
+  LOG(2, "  starting search at %p", tree_root);
+  for (void *block = tree_root; block != NULL; ) {
+    size_t bsize = GET_SIZE(block);
+    LOG(2, "  %p: size: %lx (%lu)", block, bsize, bsize);
+
+    if (bsize >= size) {
+      // until this block, this block is the best
+      bf_block = block;
+      block = LEFT(block);
+    } else {
+      block = RIGHT(block);
     }
-    
-    block += bsize;
-  } while(GET_SIZE(block)>0);
+  }
 
-  if(bf_size==-1){
+  if (bf_block == NULL) {
     LOG(2, "  no suitable block found");
     return NULL;
   } else {
@@ -289,25 +472,19 @@ static void* ff_get_free_block(size_t size)
 
   assert(mm_initialized);
 
-  void *block = heap_start;
-  size_t bsize, bstatus;
-  LOG(2, "  starting search at %p", block);
-  do{
-    bstatus = GET_STATUS(block);
-    bsize = GET_SIZE(block);
+  for (int bin = bin_index(size); bin < NBINS; bin++) {
+    LOG(2, "  bin %d: starting search at %p", bin, bins[bin]);
+    for (void *block = bins[bin]; block != NULL; block = NEXT_FREE(block)) {
+      size_t bsize = GET_SIZE(block);
+      LOG(2, "  %p: size: %lx (%lu)", block, bsize, bsize);
 
-    LOG(2, "  %p: size: %lx (%lu), status: %s", block, bsize, bsize, bstatus == ALLOC ? "allocated" : "free");
-
-    if((bstatus == FREE) && (bsize >= size)) {
-      // found block
-      LOG(2, "  --> match");
-      return block;
+      if (bsize >= size) {
+        // found block
+        LOG(2, "  --> match");
+        return block;
+      }
     }
-    
-    // next block
-    block += bsize;
-
-  } while (GET_SIZE(block)>0); // only the sentinel at the end has size == 0
+  }
 
   // no block found
   LOG(2, " no suitable block found");
@@ -315,7 +492,11 @@ static void* ff_get_free_block(size_t size)
 
 }
 
-static void coalesce(void *block)
+/// @brief coalesce free block @a block, which is not in the free block index, with its free
+///        neighbors and put the coalesced block into the index
+/// @param block free block
+/// @retval void* the coalesced block
+static void* coalesce(void *block)
 {
   LOG(1, "coalesce(%p)", block);
   assert(mm_initialized);
@@ -324,34 +505,36 @@ static void coalesce(void *block)
   TYPE size = GET_SIZE(block);
   void *hdr = block;
   void *ftr = HDR2FTR(hdr);
- // recent_block = block;// recently touched block
 
   // can we coalesce with following block?
   if(GET_STATUS(NEXT_BLOCK(block)) == FREE) {
     LOG(2, "  coalescing with suceeding block");
+    remove_block(NEXT_BLOCK(block));
     // size of coalesced block: size of block + size of following block
     size += GET_SIZE(NEXT_BLOCK(block));
     // compute new location of footer tag of coalesced block
     ftr = hdr + size - TYPE_SIZE;
-    if(NEXT_BLOCK(block)==recent_block) recent_block = block+size;
   }
   
 
   // can we coalesce with preceeding block?
   if(GET_STATUS(block-TYPE_SIZE) == FREE) {
     LOG(2, "  coalescing with previous block");
+    remove_block(PREV_BLOCK(block));
 
     // size of coalesced block: size + size of preceeding block
     size += GET_SIZE(PREV_BLOCK(block));
     // compute new location of header tag of coalesced block
     hdr = PREV_BLOCK(block);
-    if(block == recent_block) recent_block = block+size;// recently touched block
   }
 
   if(size > GET_SIZE(block)) {// if coalesced, add new hdr, ftr
     PUT(hdr, PACK(size, FREE));
     PUT(ftr, PACK(size, FREE));
   }
+  insert_block(hdr);
+
+  return hdr;
 }
 
 void* expand_heap(size_t blocksize){
@@ -371,8 +554,7 @@ void* expand_heap(size_t blocksize){
   PUT(prev_heap_end, bdrytag);
   PUT(heap_end-TYPE_SIZE, bdrytag);
   
-  coalesce(prev_heap_end);
-  return PREV_BLOCK(heap_end);
+  return coalesce(prev_heap_end);
 }
 
 void* mm_malloc(size_t size)
@@ -402,8 +584,10 @@ void* mm_malloc(size_t size)
     }
     block = expand_heap(TO_CHUNKSIZE(request_size));
   }
+  remove_block(block);
 
-  // split block
+  // split block; the remainder goes to the free block index (its successor is allocated,
+  // since free blocks are always coalesced)
   size_t bsize = GET_SIZE(block);
   if(blocksize < bsize) {
     void *next_block = block + blocksize;
@@ -411,6 +595,7 @@ void* mm_malloc(size_t size)
 
     PUT(next_block, PACK(next_size, FREE)); // header of next_block
     PUT(next_block + next_size - TYPE_SIZE, PACK(next_size, FREE));
+    insert_block(next_block);
   }
 
   PUT(block, PACK(blocksize, ALLOC));
@@ -481,6 +666,43 @@ void mm_setloglevel(int level)
 }
 
 
+/// @brief check the subtree @a t of the tree of free blocks: its blocks are free, in order between
+///        @a lo and @a hi (exclusive; NULL: unbounded) and no priority is higher than that of the
+///        parent. Errors are printed and counted in @a errors.
+/// @param t subtree
+/// @param lo, hi bounds
+/// @param level level of @a t (root: 1)
+/// @param max maximum number of blocks; the check stops there (cycles)
+/// @param depth depth of the tree (updated)
+/// @param errors number of errors (updated)
+/// @retval long number of blocks in @a t
+static long tree_check(void *t, void *lo, void *hi, int level, long max, int *depth, long *errors)
+{
+  if (t == NULL) return 0;
+
+  if ((t < heap_start) || (t >= heap_end) || (GET_STATUS(t) != FREE) ||
+      ((lo != NULL) && !tree_less(lo, t)) || ((hi != NULL) && !tree_less(t, hi))) {
+    (*errors)++;
+    printf("    --> ERROR: invalid block %p at level %d\n", t, level);
+    return 0;
+  }
+  if (level > max) {
+    (*errors)++;
+    printf("    --> ERROR: tree deeper than the number of free blocks\n");
+    return 0;
+  }
+  if (((LEFT(t) != NULL) && (PRIORITY(LEFT(t)) > PRIORITY(t))) ||
+      ((RIGHT(t) != NULL) && (PRIORITY(RIGHT(t)) > PRIORITY(t)))) {
+    (*errors)++;
+    printf("    --> ERROR: block %p: child with higher priority\n", t);
+  }
+
+  if (level > *depth) *depth = level;
+
+  return 1 + tree_check(LEFT(t), lo, t, level+1, max, depth, errors)
+           + tree_check(RIGHT(t), t, hi, level+1, max, depth, errors);
+}
+
 void mm_check(void)
 {
   assert(mm_initialized);
@@ -526,6 +748,47 @@ void mm_check(void)
     }
   }
 
+  // every free block must be in the free block index exactly once, and every block in the index
+  // must be free
+  long nfree = 0, nlisted = 0;
+  for (p = heap_start; (p < heap_end) && (GET_SIZE(p) > 0); p += GET_SIZE(p)) {
+    if (GET_STATUS(p) == FREE) nfree++;
+  }
+
+  printf("\n");
+  if (policy == ap_BestFit) {
+    int depth = 0;
+
+    printf("  free block tree:\n");
+    nlisted = tree_check(tree_root, NULL, NULL, 1, nfree, &depth, &errors);
+    printf("    %ld blocks, depth %d\n", nlisted, depth);
+  }
+  else printf("  free lists:\n");
+  for (int bin = 0; (policy != ap_BestFit) && (bin < NBINS); bin++) {
+    long n = 0;
+    void *prev = NULL;
+
+    for (void *b = bins[bin]; b != NULL; prev = b, b = NEXT_FREE(b)) {
+      if ((b < heap_start) || (b >= heap_end) || (GET_STATUS(b) != FREE) ||
+          (bin_index(GET_SIZE(b)) != bin) || (PREV_FREE(b) != prev)) {
+        errors++;
+        printf("    --> ERROR: bin %d: invalid block %p\n", bin, b);
+        break;
+      }
+      if (++n > nfree) {
+        errors++;
+        printf("    --> ERROR: bin %d: list does not end\n", bin);
+        break;
+      }
+    }
+    if (n > 0) printf("    bin %2d (%6lx+): %ld blocks\n", bin, (TYPE)BS << bin, n);
+    nlisted += n;
+  }
+  if (nlisted != nfree) {
+    errors++;
+    printf("    --> ERROR: %ld free blocks, but %ld blocks in the free block index\n", nfree, nlisted);
+  }
+
   printf("\n");
   if ((p == heap_end) && (errors == 0)) printf("  Block structure coherent.\n");
   printf("-------------------------------------------------------------------------------------------------\n");